@@ -64,10 +64,26 @@ struct cbufp_info {
 	u32_t cbid;
 	int size;
 	char *mem;
+	struct cbufp_subpage *sp; /* the shared page of a sub-page cbuf */
 	struct cbufp_maps owner;
 	struct cbufp_info *next, *prev;
 };
 
+/* 
+ * A page shared by the sub-page cbufs of a bin, and the bitmap of
+ * which of its slots (of the bin's size) are used.
+ */
+#define CBUFP_SUBPAGE_NSLOTS (PAGE_SIZE >> CBUFP_MIN_ORDER)
+
+struct cbufp_subpage {
+	char *mem;
+	vaddr_t dest;
+	int nused;
+	u32_t used[CBUFP_SUBPAGE_NSLOTS / 32];
+	struct cbufp_bin *bin;
+	struct cbufp_subpage *next, *prev;
+};
+
 /* Per-component information */
 struct cbufp_meta_range {
 	struct cbuf_meta *m;
@@ -80,6 +96,9 @@ struct cbufp_meta_range {
 struct cbufp_bin {
 	int size;
 	struct cbufp_info *c;
+	struct cbufp_subpage *pages; /* sub-page sizes only */
+	struct cbufp_ring *ring; /* NULL until cbufp_ring_map */
+	vaddr_t ring_dest;
 };
 
 struct cbufp_comp_info {
@@ -176,8 +195,11 @@ cbufp_comp_info_bin_get(struct cbufp_comp_info *cci, int sz)
 static struct cbufp_bin *
 cbufp_comp_info_bin_add(struct cbufp_comp_info *cci, int sz)
 {
-	if (sz == CBUFP_MAX_NSZ) return NULL;
-	cci->cbufs[cci->nbin].size = sz;
+	if (cci->nbin == CBUFP_MAX_NSZ) return NULL;
+	cci->cbufs[cci->nbin].size  = sz;
+	cci->cbufs[cci->nbin].c     = NULL;
+	cci->cbufs[cci->nbin].pages = NULL;
+	cci->cbufs[cci->nbin].ring  = NULL;
 	cci->nbin++;
 
 	return &cci->cbufs[cci->nbin-1];
@@ -254,6 +276,79 @@ cbufp_references_clear(struct cbufp_info *cbi)
 	return;
 }
 
+/* 
+ * Allocate a sub-page cbuf for the bin from one of its shared pages
+ * with a free slot, or from a new page mapped into the client.
+ */
+static int
+cbufp_subpage_alloc(struct cbufp_bin *bin, spdid_t spdid, struct cbufp_info *cbi)
+{
+	struct cbufp_subpage *sp = bin->pages;
+	int slot, nslots = PAGE_SIZE / bin->size;
+
+	if (sp) {
+		do {
+			if (sp->nused < nslots) goto found;
+			sp = FIRST_LIST(sp, next, prev);
+		} while (sp != bin->pages);
+	}
+	sp = malloc(sizeof(struct cbufp_subpage));
+	if (!sp) return -1;
+	memset(sp, 0, sizeof(struct cbufp_subpage));
+	if (cbufp_alloc_map(spdid, &sp->dest, (void **)&sp->mem, PAGE_SIZE)) {
+		free(sp);
+		return -1;
+	}
+	sp->bin = bin;
+	INIT_LIST(sp, next, prev);
+	if (bin->pages) ADD_LIST(bin->pages, sp, next, prev);
+	else            bin->pages = sp;
+found:
+	for (slot = 0 ; sp->used[slot/32] & (1 << (slot%32)) ; slot++) ;
+	assert(slot < nslots);
+	sp->used[slot/32] |= 1 << (slot%32);
+	sp->nused++;
+
+	cbi->sp         = sp;
+	cbi->mem        = sp->mem  + slot * bin->size;
+	cbi->owner.addr = sp->dest + slot * bin->size;
+
+	return 0;
+}
+
+/* Free the slot of a sub-page cbuf, and the page with its last one */
+static void
+cbufp_subpage_free(struct cbufp_info *cbi)
+{
+	struct cbufp_subpage *sp = cbi->sp;
+	struct cbufp_bin *bin = sp->bin;
+	int slot = (cbi->mem - sp->mem) / cbi->size;
+
+	assert(sp->used[slot/32] & (1 << (slot%32)));
+	sp->used[slot/32] &= ~(1 << (slot%32));
+	if (--sp->nused) return;
+
+	if (bin->pages == sp) bin->pages = FIRST_LIST(sp, next, prev);
+	if (bin->pages == sp) bin->pages = NULL;
+	REM_LIST(sp, next, prev);
+	mman_revoke_page(cos_spd_id(), (vaddr_t)sp->mem, 0);
+	valloc_free(cos_spd_id(), cbi->owner.spdid, (void *)sp->dest, 1);
+	page_free(sp->mem, 1);
+	free(sp);
+}
+
+/* The number of pages the cbuf is mapped with */
+static inline int
+cbufp_npages(struct cbufp_info *cbi) { return cbi->sp ? 1 : cbi->size/PAGE_SIZE; }
+
+/* The meta's size field, see cbuf_meta.h */
+static u16_t
+cbufp_meta_sz(struct cbufp_info *cbi)
+{
+	if (!cbi->sp) return cbi->size >> PAGE_ORDER;
+	return cbufm_sz_subpage(ones(cbi->size-1), (u32_t)cbi->mem & (PAGE_SIZE-1));
+}
+
 static void
 cbufp_free_unmap(spdid_t spdid, struct cbufp_info *cbi)
 {
@@ -272,9 +367,15 @@ cbufp_free_unmap(spdid_t spdid, struct cbufp_info *cbi)
 		m = FIRST_LIST(m, next, prev);
 	} while (m != &cbi->owner);
 	
-	/* Unmap all of the pages from the clients */
-	for (off = 0 ; off < cbi->size ; off += PAGE_SIZE) {
-		mman_revoke_page(cos_spd_id(), (vaddr_t)ptr + off, 0);
+	/* 
+	 * Unmap all of the pages from the clients.  The owner's
+	 * mapping of a shared page remains for the other cbufs in it,
+	 * so only the receivers' are removed.
+	 */
+	if (!cbi->sp) {
+		for (off = 0 ; off < cbi->size ; off += PAGE_SIZE) {
+			mman_revoke_page(cos_spd_id(), (vaddr_t)ptr + off, 0);
+		}
 	}
 
 	/* 
@@ -287,17 +388,90 @@ cbufp_free_unmap(spdid_t spdid, struct cbufp_info *cbi)
 
 		next = FIRST_LIST(m, next, prev);
 		REM_LIST(m, next, prev);
-		valloc_free(cos_spd_id(), m->spdid, (void*)m->addr, cbi->size/PAGE_SIZE);
+		if (!cbi->sp) {
+			valloc_free(cos_spd_id(), m->spdid, (void*)m->addr, cbi->size/PAGE_SIZE);
+		} else if (m != &cbi->owner) {
+			mman_release_page(m->spdid, round_to_page(m->addr), 0);
+			valloc_free(cos_spd_id(), m->spdid, (void*)round_to_page(m->addr), 1);
+		}
 		if (m != &cbi->owner) free(m);
 		m = next;
 	} while (m != &cbi->owner);
 
 	/* deallocate/unlink our data-structures */
-	page_free(ptr, cbi->size/PAGE_SIZE);
+	if (cbi->sp) cbufp_subpage_free(cbi);
+	else         page_free(ptr, cbi->size/PAGE_SIZE);
 	cmap_del(&cbufs, cbi->cbid);
 	free(cbi);
 }
 
+/* 
+ * Allocate a new cbuf in the bin, and map it into the client.
+ *
+ * Precondition: cbufp lock is taken.
+ */
+static struct cbufp_info *
+cbufp_info_create(struct cbufp_bin *bin, spdid_t spdid)
+{
+	struct cbufp_info *cbi;
+
+	cbi = malloc(sizeof(struct cbufp_info));
+	if (!cbi) return NULL;
+
+	cbi->cbid        = cmap_add(&cbufs, cbi);
+	cbi->size        = bin->size;
+	cbi->sp          = NULL;
+	cbi->owner.m     = NULL;
+	cbi->owner.spdid = spdid;
+	INIT_LIST(&cbi->owner, next, prev);
+	INIT_LIST(cbi, next, prev);
+
+	if (cbi->size < PAGE_SIZE ? cbufp_subpage_alloc(bin, spdid, cbi) :
+	    cbufp_alloc_map(spdid, &(cbi->owner.addr), (void**)&(cbi->mem), cbi->size)) {
+		cmap_del(&cbufs, cbi->cbid);
+		free(cbi);
+		return NULL;
+	}
+	if (bin->c) ADD_LIST(bin->c, cbi, next, prev);
+	else        bin->c = cbi;
+
+	return cbi;
+}
+
+/* 
+ * Now we know we have a cbid, a backing structure for it, a
+ * component structure, and the meta mapped in for the cbuf.  Update
+ * the meta with the correct addresses and flags!  Cbufs given to the
+ * client to use have a reference and are touched; free cbufs
+ * (created in a batch) are neither.
+ */
+static void
+cbufp_meta_init(struct cbufp_info *cbi, struct cbuf_meta *meta, int used)
+{
+	cbi->owner.m = meta;
+	memset(meta, 0, sizeof(struct cbuf_meta));
+	meta->nfo.c.flags |= CBUFM_OWNER | CBUFM_WRITABLE;
+	meta->nfo.c.ptr    = cbi->owner.addr >> PAGE_ORDER;
+	meta->sz           = cbufp_meta_sz(cbi);
+	if (!used) return;
+	meta->nfo.c.flags |= CBUFM_TOUCHED;
+	meta->nfo.c.refcnt++;
+}
+
+/* The bin for the size class of size, created if it doesn't exist */
+static struct cbufp_bin *
+cbufp_bin_get(struct cbufp_comp_info *cci, int size)
+{
+	struct cbufp_bin *bin;
+
+	size = cbufp_size_class(size);
+	if (!size) return NULL;
+	bin = cbufp_comp_info_bin_get(cci, size);
+	if (!bin) bin = cbufp_comp_info_bin_add(cci, size);
+
+	return bin;
+}
+
 int
 cbufp_create(spdid_t spdid, int size, long cbid)
 {
@@ -319,27 +493,12 @@ cbufp_create(spdid_t spdid, int size, long cbid)
 	if (!cbid) {
 		struct cbufp_bin *bin;
 
- 		cbi = malloc(sizeof(struct cbufp_info));
-		if (!cbi) goto done;
-
+		bin = cbufp_bin_get(cci, size);
+		if (!bin) goto done;
 		/* Allocate and map in the cbuf. */
-		cbid = cmap_add(&cbufs, cbi);
-		cbi->cbid        = cbid;
-		size             = round_up_to_page(size);
-		cbi->size        = size;
-		cbi->owner.m     = NULL;
-		cbi->owner.spdid = spdid;
-		INIT_LIST(&cbi->owner, next, prev);
-		INIT_LIST(cbi, next, prev);
-
-		bin = cbufp_comp_info_bin_get(cci, size);
-		if (!bin) bin = cbufp_comp_info_bin_add(cci, size);
-		if (!bin) goto free;
-
-		if (cbufp_alloc_map(spdid, &(cbi->owner.addr), 
-				    (void**)&(cbi->mem), size)) goto free;
-		if (bin->c) ADD_LIST(bin->c, cbi, next, prev);
-		else        bin->c = cbi;
+		cbi = cbufp_info_create(bin, spdid);
+		if (!cbi) goto done;
+		cbid = cbi->cbid;
 	} 
 	/* If the client has a cbid, then make sure we agree! */
 	else {
@@ -353,29 +512,158 @@ cbufp_create(spdid_t spdid, int size, long cbid)
 		ret = cbid * -1;
 		goto done;
 	}
-	cbi->owner.m = meta;
-
-	/* 
-	 * Now we know we have a cbid, a backing structure for it, a
-	 * component structure, and the meta mapped in for the cbuf.
-	 * Update the meta with the correct addresses and flags!
-	 */
-	memset(meta, 0, sizeof(struct cbuf_meta));
-	meta->nfo.c.flags |= CBUFM_TOUCHED | 
-		             CBUFM_OWNER  | CBUFM_WRITABLE;
-	meta->nfo.c.ptr    = cbi->owner.addr >> PAGE_ORDER;
-	meta->sz           = cbi->size >> PAGE_ORDER;
-	if (meta->nfo.c.refcnt == CBUFP_REFCNT_MAX) assert(0);
-	meta->nfo.c.refcnt++;
+	cbufp_meta_init(cbi, meta, 1);
 	ret = cbid;
 done:
 	CBUFP_RELEASE();
 
 	return ret;
-free:
-	cmap_del(&cbufs, cbid);
-	free(cbi);
-	goto done;
+}
+
+/*
+ * The room left in the ring, or -1 if the tail is invalid.  The
+ * client writes the tail, so it can be anywhere: it is only valid if
+ * it is no further than CBUFP_RING_SZ behind the head, and not past
+ * it.  The client can only move it forward concurrently, which only
+ * makes more room.
+ */
+static int
+cbufp_ring_space(struct cbufp_ring *r)
+{
+	u32_t used = r->head - *(volatile u32_t *)&r->tail;
+
+	if (used > CBUFP_RING_SZ) return -1;
+	return CBUFP_RING_SZ - used;
+}
+
+/* The caller has made sure there is room with cbufp_ring_space */
+static void
+cbufp_ring_add(struct cbufp_ring *r, long cbid)
+{
+	u32_t head = r->head;
+
+	r->cbids[head & CBUFP_RING_MASK] = cbid;
+	/* the client can take it once the head moves past it */
+	cos_mem_fence();
+	r->head = head + 1;
+}
+
+vaddr_t
+cbufp_ring_map(spdid_t spdid, int size)
+{
+	struct cbufp_comp_info *cci;
+	struct cbufp_bin *bin;
+	void *p;
+	vaddr_t ret = 0;
+
+	printl("cbufp_ring_map\n");
+	CBUFP_TAKE();
+	cci = cbufp_comp_info_get(spdid);
+	if (!cci) goto done;
+	bin = cbufp_bin_get(cci, size);
+	if (!bin) goto done;
+	if (!bin->ring) {
+		if (cbufp_alloc_map(spdid, &bin->ring_dest, &p, PAGE_SIZE)) goto done;
+		bin->ring = p;
+	}
+	ret = bin->ring_dest;
+done:
+	CBUFP_RELEASE();
+	return ret;
+}
+
+/*
+ * Create up to n cbufps with a single invocation, and add them to
+ * the ring.  They aren't touched, so that collection doesn't return
+ * them until the client uses them.
+ */
+int
+cbufp_create_batch(spdid_t spdid, int size, int n)
+{
+	struct cbufp_comp_info *cci;
+	struct cbufp_bin *bin;
+	struct cbufp_info *cbi;
+	struct cbuf_meta *meta;
+	int i, space, ret = -EINVAL;
+
+	printl("cbufp_create_batch\n");
+	CBUFP_TAKE();
+	cci = cbufp_comp_info_get(spdid);
+	if (!cci) ERR_THROW(-ENOMEM, done);
+	bin = cbufp_bin_get(cci, size);
+	if (!bin || !bin->ring) goto done;
+	space = cbufp_ring_space(bin->ring);
+	if (space < 0) goto done;
+	if (n > space) n = space;
+
+	for (i = 0 ; i < n ; i++) {
+		cbi = cbufp_info_create(bin, spdid);
+		if (!cbi) break;
+		meta = cbufp_meta_lookup(cci, cbi->cbid);
+		if (meta) cbufp_meta_init(cbi, meta, 0);
+		cbufp_ring_add(bin->ring, meta ? (long)cbi->cbid : -(long)cbi->cbid);
+	}
+	ret = i;
+done:
+	CBUFP_RELEASE();
+	return ret;
+}
+
+/* Has the client used the cbuf since we last collected it? Untouch it if so. */
+static int
+cbufp_untouch(struct cbufp_info *cbi)
+{
+	struct cbuf_meta *meta = cbi->owner.m;
+	union cbufm_info old, new;
+
+	if (!meta) return 0;
+	do {
+		old.v = new.v = meta->nfo.v;
+		/* the client allocated it since we checked the references */
+		if (old.c.refcnt || !(old.c.flags & CBUFM_TOUCHED)) return 0;
+		new.c.flags &= ~CBUFM_TOUCHED;
+	} while (!cos_cas((unsigned long *)&meta->nfo.v, old.v, new.v));
+
+	return 1;
+}
+
+/* 
+ * cbufp_collect, but into the ring.  Cbufs that the client hasn't
+ * touched since they were last collected (or created in a batch) are
+ * already free in the client, so they aren't added again.
+ */
+int
+cbufp_collect_batch(spdid_t spdid, int size)
+{
+	struct cbufp_info *cbi;
+	struct cbufp_comp_info *cci;
+	struct cbufp_bin *bin;
+	int off = 0, space, ret = -EINVAL;
+
+	printl("cbufp_collect_batch\n");
+	CBUFP_TAKE();
+	cci = cbufp_comp_info_get(spdid);
+	if (!cci) ERR_THROW(-ENOMEM, done);
+	if (!cbufp_size_class(size)) goto done;
+	bin = cbufp_comp_info_bin_get(cci, cbufp_size_class(size));
+	if (!bin) ERR_THROW(0, done);
+	if (!bin->ring) goto done;
+	space = cbufp_ring_space(bin->ring);
+	if (space < 0) goto done;
+	cbi = bin->c;
+	do {
+		if (!cbi || off == space) break;
+		if (!cbufp_referenced(cbi) && cbufp_untouch(cbi)) {
+			cbufp_references_clear(cbi);
+			cbufp_ring_add(bin->ring, cbi->cbid);
+			off++;
+		}
+		cbi = FIRST_LIST(cbi, next, prev);
+	} while (cbi != bin->c);
+	ret = off;
+done:
+	CBUFP_RELEASE();
+	return ret;
 }
 
 /*
@@ -417,7 +705,8 @@ cbufp_collect(spdid_t spdid, int size, long cbid)
 	 * O(N*M), N = min(num cbufs, PAGE_SIZE/sizeof(int)), and M =
 	 * num components.
 	 */
-	bin = cbufp_comp_info_bin_get(cci, round_up_to_page(size));
+	if (!cbufp_size_class(size)) goto done;
+	bin = cbufp_comp_info_bin_get(cci, cbufp_size_class(size));
 	if (!bin) ERR_THROW(0, done);
 	cbi = bin->c;
 	do {
@@ -488,19 +777,22 @@ cbufp_retrieve(spdid_t spdid, int cbid, int size)
 
 	map        = malloc(sizeof(struct cbufp_maps));
 	if (!map) ERR_THROW(-ENOMEM, done);
-	if (size > cbi->size) goto done;
-	assert((int)round_to_page(cbi->size) == cbi->size);
-	size       = cbi->size;
+	if (size > cbi->size) goto free;
+	/* 
+	 * A sub-page cbuf is mapped with its whole page: the
+	 * receiver can read the other cbufs in it (see CBUFP_SUBPAGE).
+	 */
+	size       = cbufp_npages(cbi) * PAGE_SIZE;
 	dest       = (vaddr_t)valloc_alloc(cos_spd_id(), spdid, size/PAGE_SIZE);
 	if (!dest) goto free;
 
 	map->spdid = spdid;
 	map->m     = meta;
-	map->addr  = dest;
+	map->addr  = dest + ((u32_t)cbi->mem & (PAGE_SIZE-1));
 	INIT_LIST(map, next, prev);
 	ADD_LIST(&cbi->owner, map, next, prev);
 
-	page = cbi->mem;
+	page = (void *)round_to_page(cbi->mem);
 	assert(page);
 	for (off = 0 ; off < size ; off += PAGE_SIZE) {
 		if (dest+off != 
@@ -512,7 +804,7 @@ cbufp_retrieve(spdid_t spdid, int cbid, int size)
 
 	meta->nfo.c.flags |= CBUFM_TOUCHED;
 	meta->nfo.c.ptr    = map->addr >> PAGE_ORDER;
-	meta->sz           = cbi->size >> PAGE_ORDER;
+	meta->sz           = cbufp_meta_sz(cbi);
 	ret                = 0;
 done:
 	CBUFP_RELEASE();
@@ -549,6 +841,51 @@ done:
 	return ret;
 }
 
+/* 
+ * The use of each size class in each component: the number of cbufs,
+ * the number currently referenced, and the memory backing them.  The
+ * memory that isn't used is the difference between the bytes of
+ * cbufs, and the pages backing them.
+ */
+void
+cbufp_buf_report(void)
+{
+	struct cbufp_comp_info *cci;
+	struct cbufp_info *cbi;
+	struct cbufp_subpage *sp;
+	struct cbufp_bin *bin;
+	int i, j, nbufs, nref, npages;
+
+	CBUFP_TAKE();
+	for (i = 0 ; i < MAX_NUM_SPDS ; i++) {
+		cci = cvect_lookup(&components, i);
+		if (!cci) continue;
+		for (j = 0 ; j < cci->nbin ; j++) {
+			bin   = &cci->cbufs[j];
+			nbufs = nref = npages = 0;
+			cbi   = bin->c;
+			if (cbi) {
+				do {
+					nbufs++;
+					nref += cbufp_referenced(cbi);
+					if (!cbi->sp) npages += cbufp_npages(cbi);
+					cbi = FIRST_LIST(cbi, next, prev);
+				} while (cbi != bin->c);
+			}
+			sp = bin->pages;
+			if (sp) {
+				do {
+					npages++;
+					sp = FIRST_LIST(sp, next, prev);
+				} while (sp != bin->pages);
+			}
+			printc("cbufp spd %d size %d: %d cbufs (%d referenced), %d of %d bytes used\n",
+			       i, bin->size, nbufs, nref, nbufs * bin->size, npages * PAGE_SIZE);
+		}
+	}
+	CBUFP_RELEASE();
+}
+
 void
 cos_init(void)
 {
@@ -89,7 +89,8 @@ find_cell(spdid_t spd, vaddr_t addr, int *alias)
 /* 
  * Call to get a page of memory at a location.
  */
-vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags)
+static vaddr_t
+mh_get_page(spdid_t spd, vaddr_t addr)
 {
 	struct mem_cell *c;
 
@@ -152,7 +153,8 @@ err:
 /*
  * Call to give up a page of memory in an spd at an address.
  */
-int mman_release_page(spdid_t spd, vaddr_t addr, int flags)
+static int
+mh_release_page(spdid_t spd, vaddr_t addr, int flags)
 {
 	int alias;
 	struct mem_cell *mc;
@@ -167,6 +169,30 @@ int mman_release_page(spdid_t spd, vaddr_t addr, int flags)
 	return 0;
 }
 
+vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags)
+{
+	int npages = mman_npages(flags), i;
+
+	for (i = 0 ; i < npages ; i++) {
+		if (mh_get_page(spd, addr + i*PAGE_SIZE)) continue;
+		while (i--) mh_release_page(spd, addr + i*PAGE_SIZE, 0);
+		return 0;
+	}
+
+	return addr;
+}
+
+int mman_release_page(spdid_t spd, vaddr_t addr, int flags)
+{
+	int npages = mman_npages(flags), i, ret = 0;
+
+	for (i = 0 ; i < npages ; i++) {
+		if (mh_release_page(spd, addr + i*PAGE_SIZE, 0)) ret = -1;
+	}
+
+	return ret;
+}
+
 void mman_print_stats(void)
 {
 	int i, j, k, l;
@@ -457,13 +457,13 @@ mapping_del(struct mapping *m)
 /*** Public interface functions ***/
 /**********************************/
 
-vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags)
+static vaddr_t
+__mman_get_page(spdid_t spd, vaddr_t addr, int flags)
 {
 	struct frame *f;
 	struct mapping *m = NULL;
-	vaddr_t ret = -1;
+	vaddr_t ret = 0;
 	
-	LOCK();
 	if (flags & MAPPING_KMEM)
 		f = kern_frame_alloc();
 	else
@@ -479,13 +479,43 @@ vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags)
 	assert(m == mapping_lookup(spd, addr));
 	ret = m->addr;
 done:
-	UNLOCK();
 	return ret;
 dealloc:
 	frame_deref(f);
 	goto done;		/* -EINVAL */
 }
 
+/* Release the npages mappings at addr that exist */
+static void
+__mman_release_pages(spdid_t spd, vaddr_t addr, int npages)
+{
+	struct mapping *m;
+	int i;
+
+	for (i = 0 ; i < npages ; i++) {
+		m = mapping_lookup(spd, addr + i*PAGE_SIZE);
+		if (m) mapping_del(m);
+	}
+}
+
+vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags)
+{
+	int npages = mman_npages(flags), i;
+	vaddr_t ret = addr;
+
+	flags &= ~MMAN_NPAGES(MMAN_NPAGES_MAX);
+	LOCK();
+	for (i = 0 ; i < npages ; i++) {
+		if (__mman_get_page(spd, addr + i*PAGE_SIZE, flags)) continue;
+		__mman_release_pages(spd, addr, i);
+		ret = 0;
+		break;
+	}
+	UNLOCK();
+
+	return ret;
+}
+
 vaddr_t __mman_alias_page(spdid_t s_spd, vaddr_t s_addr, u32_t d_spd_flags, vaddr_t d_addr)
 {
 	struct mapping *m, *n;
@@ -529,16 +559,14 @@ done:
 
 int mman_release_page(spdid_t spd, vaddr_t addr, int flags)
 {
-	struct mapping *m;
 	int ret = 0;
 
 	LOCK();
-	m = mapping_lookup(spd, addr);
-	if (!m) {
+	if (!mapping_lookup(spd, addr)) {
 		ret = -1;	/* -EINVAL */
 		goto done;
 	}
-	mapping_del(m);
+	__mman_release_pages(spd, addr, mman_npages(flags));
 done:
 	UNLOCK();
 	return ret;
@@ -590,11 +590,105 @@ vas_free(mapping_t *m, parsec_ns_t *ns)
 	return ret;
 }
 
+/*****************************************/
+/*** Super-pages (4MB, one pgd entry)  ***/
+/*****************************************/
+
+/*
+ * Super-pages need physically contiguous, aligned frames, so a few
+ * are set aside at boot from the end of physical memory, and are
+ * never added to the frame freelists.  Each has a VAS_UNIT region of
+ * its own (without a PTE) at which it is mapped into a component.
+ */
+#define MM_NSUPER 8
+
+struct superpage {
+	vaddr_t cap;            /* of its first frame */
+	vaddr_t vaddr;
+	comp_t *comp;           /* the component it is mapped into, or NULL */
+	quie_time_t time_deact;
+} CACHE_ALIGNED;
+
+static struct superpage superpages[MM_NSUPER];
+static int n_super;
+
+static unsigned long cpu_get_lid(void);
+
+/*
+ * Set aside up to MM_NSUPER super-pages from the last aligned frames,
+ * leaving at least half of the frames.  Returns the id of the first
+ * frame set aside.
+ */
+static unsigned long
+superpage_reserve(vaddr_t frame_base, unsigned long n_frames)
+{
+	vaddr_t end = round_to_pgd_page(frame_base + n_frames * PAGE_SIZE);
+	int i;
+
+	for (i = 0; i < MM_NSUPER && end >= frame_base + (n_frames / 2) * PAGE_SIZE + VAS_UNIT; i++) {
+		end -= VAS_UNIT;
+		superpages[i].cap   = end;
+		superpages[i].vaddr = vas_region_alloc();
+	}
+	n_super = i;
+
+	return (end - frame_base) / PAGE_SIZE + 1;
+}
+
+static vaddr_t
+superpage_get(comp_t *comp)
+{
+	struct superpage *s = NULL;
+	int i;
+
+	for (i = 0; i < n_super; i++) {
+		s = &superpages[i];
+		if (s->comp || check_tlb_quiesce(s->time_deact)) continue;
+		if (cos_cas((unsigned long *)&s->comp, 0, (unsigned long)comp) == CAS_SUCCESS) break;
+	}
+	if (i == n_super) return 0;
+
+	if (call_cap_op(MM_CAPTBL_OWN_PGTBL, CAPTBL_OP_MEMACTIVATE_SUPER,
+			s->cap, comp_pt_cap(comp->id), s->vaddr, 0)) {
+		printc("MM super-page mapping to comp %d @ %p failed\n", comp->id, (void *)s->vaddr);
+		s->comp = NULL;
+		return 0;
+	}
+
+	return s->vaddr;
+}
+
+static int
+superpage_release(comp_t *comp, vaddr_t vaddr)
+{
+	struct superpage *s;
+	int i;
+
+	for (i = 0; i < n_super; i++) {
+		s = &superpages[i];
+		if (s->comp != comp || s->vaddr != vaddr) continue;
+
+		if (call_cap_op(comp_pt_cap(comp->id), CAPTBL_OP_MEMDEACTIVATE, vaddr, cpu_get_lid(), 0, 0)) {
+			printc("ERROR: unmap super-page @ vaddr %x failed", (unsigned int)vaddr);
+			return -EINVAL;
+		}
+		/* it can be reused once the TLBs are quiesced */
+		s->time_deact = get_time();
+		cos_mem_fence();
+		s->comp = NULL;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
 static unsigned long
 frame_boot(vaddr_t frame_addr, parsec_ns_t *ns)
 {
 	int ret;
-	unsigned long n_frames, i;
+	unsigned long n_frames, i, super_id;
+	vaddr_t frame_base = frame_addr;
 	frame_t *frame;
 	struct quie_mem_meta *meta;
 
@@ -622,8 +716,12 @@ frame_boot(vaddr_t frame_addr, parsec_ns_t *ns)
 	}
 
 	n_frames = i - 1;
+	super_id = n_frames + 1;
+	if (ns == &frame_ns) super_id = superpage_reserve(frame_base, n_frames);
 
 	for (i = 0; i < n_frames; i++) {
+		/* super-page frames are never in the freelists */
+		if (i >= super_id && i < super_id + n_super * MMAN_SUPERPAGE_NPAGES) continue;
 		/* They'll added to the glb freelist. */
 		frame = frame_lookup(i, ns);
 		ret = glb_freelist_add(frame, &(ns->allocator));
@@ -1039,15 +1137,19 @@ vaddr_t mman_get_page(spdid_t compid, vaddr_t addr, int npages_flags)
 	mapping_t *m;
 	int npages, flags, ret = 0;
 
-	npages = npages_flags >> 16;
+	npages = mman_npages(npages_flags);
 	flags  = npages_flags & 0xFFFF;
 	/* printc("MM get page: comp %ld (cap %d), addr %d, flags %d\n", compid, comp_pt_cap(compid), addr, flags); */
-	if (!npages) return 0;
+	if ((flags & MMAN_SUPERPAGE) && (addr || npages != MMAN_SUPERPAGE_NPAGES)) return 0;
 
 	/* Alloc pmem */
 	parsec_read_lock(&mm);
 
 	comp = comp_lookup(compid);
+	if (flags & MMAN_SUPERPAGE) {
+		if (comp) ret = superpage_get(comp);
+		goto done;
+	}
 	if (addr) {
 		/* Get a new page, and map it to caller specified
 		 * vaddr -- must be valloc-ed from us. */
@@ -1330,7 +1432,10 @@ int mman_release_page(spdid_t compid, vaddr_t addr, int flags)
 	c = comp_lookup(compid);
 	if (unlikely(!c)) goto done;
 	m = mapping_lookup(c, addr);
-	if ((!m)) goto done;
+	if ((!m)) {
+		superpage_release(c, addr);
+		goto done;
+	}
 
 	/* A hack for now. Should solve it better. */
 	if (parsec_item_size(m) > PAGE_SIZE)
@@ -10,8 +10,24 @@
 #include <sl_mod_policy.h>
 #include <cos_debug.h>
 #include <cos_kernel_api.h>
+#include <ck_spinlock.h>
 
-struct sl_global sl_global_data;
+struct sl_global sl_global_data[NUM_CPU_COS];
+
+/*
+ * The kernel API's resource allocators, and the thread backend, are
+ * shared by all cores.  Each core only contends for this lock from
+ * within its critical section, so the lock holder is never preempted
+ * by another thread spinning on it.
+ */
+ck_spinlock_ticket_t sl_alloc_lock = CK_SPINLOCK_TICKET_INITIALIZER;
+
+enum {
+	SL_INIT_NONE = 0,
+	SL_INIT_BUSY,
+	SL_INIT_DONE
+};
+static unsigned long sl_init_state = SL_INIT_NONE;
 
 /*
  * These functions are removed from the inlined fast-paths of the
@@ -48,16 +64,13 @@ sl_cs_exit_contention(union sl_cs_intern *csi, union sl_cs_intern *cached, sched
 	return 0;
 }
 
-void
-sl_thd_block(thdid_t tid)
+/*
+ * Block the current thread, with an optional absolute timeout (0 for
+ * none).  Must be called in the critical section, which is released.
+ */
+static void
+sl_thd_block_cs(struct sl_thd *t, cycles_t timeout)
 {
-	struct sl_thd *t;
-
-	/* TODO: dependencies not yet supported */
-	assert(!tid);
-
-	sl_cs_enter();
-	t = sl_thd_curr();
 	if (unlikely(t->state == SL_THD_WOKEN)) {
 		t->state = SL_THD_RUNNABLE;
 		sl_cs_exit();
@@ -66,38 +79,117 @@ sl_thd_block(thdid_t tid)
 
 	assert(t->state == SL_THD_RUNNABLE);
 	t->state = SL_THD_BLOCKED;
+	if (timeout) sl_timeout_mod_block(t, timeout);
 	sl_mod_block(sl_mod_thd_policy_get(t));
 	sl_cs_exit_schedule();
+}
 
-	return;
+void
+sl_thd_block(thdid_t tid)
+{
+	/* TODO: dependencies not yet supported */
+	assert(!tid);
+
+	sl_cs_enter();
+	sl_thd_block_cs(sl_thd_curr(), 0);
 }
 
 void
-sl_thd_wakeup(thdid_t tid)
+sl_thd_block_timeout(thdid_t tid, cycles_t abs_timeout)
+{
+	assert(!tid);
+
+	sl_cs_enter();
+	/* the timeout has already passed */
+	if (unlikely((s64_t)(abs_timeout - sl_now()) <= 0)) {
+		sl_cs_exit();
+		return;
+	}
+	sl_thd_block_cs(sl_thd_curr(), abs_timeout);
+}
+
+unsigned int
+sl_thd_block_periodic(thdid_t tid)
 {
 	struct sl_thd *t;
-	thdcap_t       thdcap;
-	tcap_t         tcap;
-	tcap_prio_t    prio;
+	cycles_t       now;
+	unsigned int   missed;
+
+	assert(!tid);
 
 	sl_cs_enter();
-	t = sl_thd_lkup(tid);
-	if (unlikely(!t)) goto done;
+	t   = sl_thd_curr();
+	now = sl_now();
+	assert(t->period);
+
+	if (unlikely(!t->periodic_cycs)) t->periodic_cycs = now;
+	t->periodic_cycs += t->period;
+	if (likely((s64_t)(t->periodic_cycs - now) > 0)) {
+		sl_thd_block_cs(t, t->periodic_cycs);
+		return 0;
+	}
+
+	/* we overran into later periods: skip to the most recent release, and don't block */
+	missed            = (now - t->periodic_cycs) / t->period;
+	t->periodic_cycs += missed * t->period;
+	sl_cs_exit();
 
+	return missed + 1;
+}
+
+int
+sl_thd_wakeup_no_cs(struct sl_thd *t)
+{
+	if (unlikely(*(volatile sl_thd_state *)&t->state >= SL_THD_MIGRATING)) return sl_xcore_migrating_wakeup(t);
+	/*
+	 * Only a thread's own core modifies its scheduling state.  The
+	 * core a thread migrates to sets its cpuid before its state
+	 * leaves SL_THD_MIGRATING, so read after the state, the cpuid
+	 * is that of the core that owns the thread.
+	 */
+	if (unlikely(*(volatile cpuid_t *)&t->cpuid != cos_cpuid())) {
+		if (unlikely(sl_xcore_wakeup(t))) return -EAGAIN;
+		return 1;
+	}
 	if (unlikely(t->state == SL_THD_RUNNABLE)) {
 		t->state = SL_THD_WOKEN;
-		goto done;
+		return 1;
 	}
 
-	assert(t->state = SL_THD_BLOCKED);
+	assert(t->state == SL_THD_BLOCKED);
 	t->state = SL_THD_RUNNABLE;
+	sl_timeout_mod_remove(t);
 	sl_mod_wakeup(sl_mod_thd_policy_get(t));
+
+	return 0;
+}
+
+void
+sl_thd_wakeup(thdid_t tid)
+{
+	struct sl_thd *t;
+	int            ret;
+
+retry:
+	sl_cs_enter();
+	/* the thread can be on another core, which can free it meanwhile (see sl_thd_free) */
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
+	t = sl_thd_lkup(tid);
+	if (likely(t)) ret = sl_thd_wakeup_no_cs(t);
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
+	if (unlikely(!t)) goto exit;
+	if (unlikely(ret == -EAGAIN)) {
+		/* the thread's core hasn't drained our ring: let it, outside of the critical section */
+		sl_cs_exit();
+		sl_thd_yield(0);
+		goto retry;
+	}
+	if (ret) goto exit;
 	sl_cs_exit_schedule();
 
 	return;
-done:
+exit:
 	sl_cs_exit();
-	return;
 }
 
 void
@@ -109,7 +201,7 @@ sl_thd_yield(thdid_t tid)
 	if (tid) {
 		struct sl_thd *to = sl_thd_lkup(tid);
 
-		assert(to);
+		assert(to && to->cpuid == cos_cpuid());
 		sl_cs_exit_switchto(to);
 	} else {
 		sl_mod_yield(sl_mod_thd_policy_get(t), NULL);
@@ -125,20 +217,33 @@ sl_thd_alloc_init(thdid_t tid, thdcap_t thdcap)
 	struct sl_thd_policy   *tp  = NULL;
 	struct sl_thd          *t   = NULL;
 
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
 	tp = sl_thd_alloc_backend(tid);
 	if (!tp) goto done;
 	t = sl_mod_thd_get(tp);
 
 	t->thdid  = tid;
 	t->thdcap = thdcap;
+	t->cpuid  = cos_cpuid();
+	t->tcap   = 0;
+	t->rcv    = 0;
 	t->state  = SL_THD_RUNNABLE;
+	t->timeout_cycs  = 0;
+	t->timeout_idx   = 0;
+	t->period        = 0;
+	t->periodic_cycs = 0;
 	sl_thd_index_add_backend(sl_mod_thd_policy_get(t));
+	sl__globals()->nthds++;
 
 done:
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
 	return t;
 }
 
-/* boot_thd = 1 if you want to create a boot-up thread in a separate component */
+/*
+ * boot_thd = 1 if you want to create a boot-up thread in a separate
+ * component.  Must be called in the critical section.
+ */
 static struct sl_thd *
 sl_thd_alloc_intern(cos_thd_fn_t fn, void *data, struct cos_defcompinfo *comp, int boot_thd)
 {
@@ -148,11 +253,15 @@ sl_thd_alloc_intern(cos_thd_fn_t fn, void *data, struct cos_defcompinfo *comp, i
 	thdcap_t thdcap;
 	thdid_t  tid;
 
+	assert(sl_cs_owner());
+
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
 	if (!boot_thd) thdcap = cos_thd_alloc(ci, ci->comp_cap, fn, data);
 	else           thdcap = cos_initthd_alloc(ci, comp->ci.comp_cap);
+	if (thdcap) tid = cos_introspect(ci, thdcap, THD_GET_TID);
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
 	if (!thdcap) goto done;
 
-	tid = cos_introspect(ci, thdcap, THD_GET_TID);
 	assert(tid);
 	t = sl_thd_alloc_init(tid, thdcap);
 	sl_mod_thd_create(sl_mod_thd_policy_get(t));
@@ -161,21 +270,55 @@ done:
 }
 
 struct sl_thd *
-sl_thd_alloc(cos_thd_fn_t fn, void *data)
+sl_thd_alloc_no_cs(cos_thd_fn_t fn, void *data)
 { return sl_thd_alloc_intern(fn, data, NULL, 0); }
 
+struct sl_thd *
+sl_thd_alloc(cos_thd_fn_t fn, void *data)
+{
+	struct sl_thd *t;
+
+	sl_cs_enter();
+	t = sl_thd_alloc_intern(fn, data, NULL, 0);
+	sl_cs_exit();
+
+	return t;
+}
+
 /* Allocate a thread that executes in the specified component */
 struct sl_thd *
 sl_thd_comp_alloc(struct cos_defcompinfo *comp)
-{ return sl_thd_alloc_intern(NULL, NULL, comp, 1); }
+{
+	struct sl_thd *t;
+
+	sl_cs_enter();
+	t = sl_thd_alloc_intern(NULL, NULL, comp, 1);
+	sl_cs_exit();
+
+	return t;
+}
 
 void
 sl_thd_free(struct sl_thd *t)
 {
-	sl_thd_index_rem_backend(sl_mod_thd_policy_get(t));
+	assert(t->cpuid == cos_cpuid());
+
+	sl_cs_enter();
+	sl_mod_thd_delete(sl_mod_thd_policy_get(t));
+	sl_timeout_mod_remove(t);
 	t->state = SL_THD_FREE;
+	sl__globals()->nthds--;
+	/*
+	 * The backend can reuse t as soon as it's freed, so the
+	 * lookups of threads on other cores hold the lock until
+	 * they're done with them.
+	 */
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
+	sl_thd_index_rem_backend(sl_mod_thd_policy_get(t));
 	/* TODO: add logic for the graveyard to delay this deallocation if t == current */
 	sl_thd_free_backend(sl_mod_thd_policy_get(t));
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
+	sl_cs_exit();
 }
 
 void
@@ -184,7 +327,10 @@ sl_thd_param_set(struct sl_thd *t, sched_param_t sp)
 	sched_param_type_t type;
 	unsigned int       value;
 
+	assert(t->cpuid == cos_cpuid());
 	sched_param_get(sp, &type, &value);
+	/* the period is also used by sl_thd_block_periodic */
+	if (type == SCHEDP_WINDOW) t->period = sl_usec2cyc(value);
 	sl_mod_thd_param_set(sl_mod_thd_policy_get(t), type, value);
 }
 
@@ -197,31 +343,65 @@ sl_timeout_period(microsec_t period)
 	sl_timeout_relative(p);
 }
 
-/* engage space heater mode */
+/* engage space heater mode, unless there are unpinned threads to start, or threads to pull from other cores */
 void
 sl_idle(void *d)
-{ while (1) ; }
+{
+	while (1) {
+		if (likely(!sl_xcore_unpinned_pending() && !sl_xcore_balance_pending())) continue;
+
+		sl_cs_enter();
+		if (!sl_xcore_unpinned_start()) sl_xcore_balance();
+		sl_cs_exit_schedule();
+	}
+}
 
 void
 sl_init(void)
 {
-	struct sl_global       *g  = sl__globals();
-	struct cos_defcompinfo *ci = cos_defcompinfo_curr_get();
+	struct sl_global       *g    = sl__globals();
+	struct cos_defcompinfo *dci  = cos_defcompinfo_curr_get();
+	struct cos_compinfo    *ci   = cos_compinfo_get(dci);
+	cpuid_t                 core = cos_cpuid();
+	int                     i;
 
 	/* must fit in a word */
 	assert(sizeof(struct sl_cs) <= sizeof(unsigned long));
+	assert(core < NUM_CPU_COS);
+
+	/* the first core initializes the state shared between cores, and the others wait for it */
+	if (ps_cas(&sl_init_state, SL_INIT_NONE, SL_INIT_BUSY)) {
+		sl_thd_init_backend();
+		sl_xcore_init();
+		if (!ps_cas(&sl_init_state, SL_INIT_BUSY, SL_INIT_DONE)) assert(0);
+	}
+	while (*(volatile unsigned long *)&sl_init_state != SL_INIT_DONE) ;
 
 	g->cyc_per_usec = cos_hw_cycles_per_usec(BOOT_CAPTBL_SELF_INITHW_BASE);
 	g->lock.u.v     = 0;
+	/* each core has its own boot-time scheduler thread, tcap, and rcv end-point */
+	g->sched_thdcap = BOOT_CAPTBL_SELF_INITTHD_BASE  + core * CAP16B_IDSZ;
+	g->sched_tcap   = BOOT_CAPTBL_SELF_INITTCAP_BASE + core * CAP16B_IDSZ;
+	g->sched_rcv    = BOOT_CAPTBL_SELF_INITRCV_BASE  + core * CAP64B_IDSZ;
 
-	sl_thd_init_backend();
 	sl_mod_init();
 	sl_timeout_mod_init();
 
 	/* Create the scheduler thread for us */
-	g->sched_thd    = sl_thd_alloc_init(cos_thdid(), BOOT_CAPTBL_SELF_INITTHD_BASE);
+	g->sched_thd    = sl_thd_alloc_init(cos_thdid(), g->sched_thdcap);
 	assert(g->sched_thd);
-	g->sched_thdcap = BOOT_CAPTBL_SELF_INITTHD_BASE;
+
+	/* the other cores' rcv end-points are created at boot, so we don't need to wait for their initialization */
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		if (i == core) continue;
+		g->xcore_asnd[i] = cos_asnd_alloc(ci, BOOT_CAPTBL_SELF_INITRCV_BASE + i * CAP64B_IDSZ, ci->captbl_cap);
+		assert(g->xcore_asnd[i]);
+	}
+	g->sched_ring = cos_page_bump_alloc(ci);
+	assert(g->sched_ring);
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
+	if (cos_sched_ring_set(g->sched_rcv, g->sched_ring)) assert(0);
 
 	g->idle_thd     = sl_thd_alloc(sl_idle, NULL);
 	assert(g->idle_thd);
@@ -229,36 +409,73 @@ sl_init(void)
 	return;
 }
 
+static inline void
+sl_sched_evt_process(struct cos_sched_evt *e)
+{
+	thdid_t        tid;
+	int            blocked;
+	cycles_t       cycles;
+	struct sl_thd *t;
+
+	cos_sched_evt_get(e, &tid, &blocked, &cycles);
+	if (!tid) return;
+
+	t = sl_thd_lkup(tid);
+	assert(t);
+	/* don't report the idle thread */
+	if (unlikely(t == sl__globals()->idle_thd)) return;
+	sl_mod_execution(sl_mod_thd_policy_get(t), cycles);
+	if (blocked) sl_mod_block(sl_mod_thd_policy_get(t));
+	else         sl_mod_wakeup(sl_mod_thd_policy_get(t));
+}
+
+/* Process the events the kernel has published into our ring; returns how many there were */
+static inline int
+sl_sched_ring_process(void)
+{
+	struct cos_sched_evt e;
+	int n = 0;
+
+	while (cos_sched_ring_dequeue(sl__globals()->sched_ring, &e)) {
+		sl_sched_evt_process(&e);
+		n++;
+	}
+
+	return n;
+}
+
 void
 sl_sched_loop(void)
 {
+	struct sl_global *g = sl__globals();
+
 	while (1) {
 		int pending;
 
 		sl_cs_enter();
 
-		do {
-			thdid_t        tid;
-			int            blocked;
-			cycles_t       cycles;
-			struct sl_thd *t;
-
-			/*
-			 * a child scheduler may receive both scheduling notifications (block/unblock
-			 * states of it's child threads) and normal notifications (mainly activations from
-			 * it's parent scheduler).
-			 */
-			pending = cos_sched_rcv(BOOT_CAPTBL_SELF_INITRCV_BASE, &tid, &blocked, &cycles);
-			if (!tid) continue;
-
-			t = sl_thd_lkup(tid);
-			assert(t);
-			/* don't report the idle thread */
-			if (unlikely(t == sl__globals()->idle_thd)) continue;
-			sl_mod_execution(sl_mod_thd_policy_get(t), cycles);
-			if (blocked) sl_mod_block(sl_mod_thd_policy_get(t));
-			else         sl_mod_wakeup(sl_mod_thd_policy_get(t));
-		} while (pending);
+		/*
+		 * a child scheduler may receive both scheduling notifications (block/unblock
+		 * states of it's child threads) and normal notifications (mainly activations from
+		 * it's parent scheduler).  The kernel writes the scheduling notifications into
+		 * our ring as they happen, so we only rcv, which blocks us, when the ring is
+		 * empty and we've nothing else to process.  The rcv returns the events that
+		 * didn't fit in the ring, in batches.
+		 */
+		if (!sl_sched_ring_process()) {
+			do {
+				int nevts, i;
+
+				nevts = cos_sched_rcv_batch(g->sched_rcv, g->sched_evts, SL_SCHED_EVT_BATCH, &pending);
+				assert(nevts >= 0);
+
+				for (i = 0 ; i < nevts ; i++) sl_sched_evt_process(&g->sched_evts[i]);
+				/* including those written into the ring while we were blocked */
+				sl_sched_ring_process();
+			} while (pending);
+		}
+		/* wakeups of our threads from other cores (also the cause of the asnd activations) */
+		sl_xcore_wakeups_process();
 
 		/* If switch returns an inconsistency, we retry anyway */
 		sl_cs_exit_schedule_nospin();
@@ -35,6 +35,8 @@
 #include <res_spec.h>
 #include <sl_mod_policy.h>
 #include <sl_plugins.h>
+#include <sl_consts.h>
+#include <sl_xcore.h>
 
 /* Critical section (cs) API to protect scheduler data-structures */
 struct sl_cs {
@@ -47,10 +49,13 @@ struct sl_cs {
 	} u;
 };
 
+/* Each core has its own scheduler, and its own instance of this state */
 struct sl_global {
 	struct sl_cs   lock;
 
 	thdcap_t       sched_thdcap;
+	tcap_t         sched_tcap;
+	arcvcap_t      sched_rcv;
 	struct sl_thd *sched_thd;
 	struct sl_thd *idle_thd;
 
@@ -58,13 +63,43 @@ struct sl_global {
 	cycles_t       period;
 	cycles_t       timer_next;
 	tcap_time_t    timeout_next;
-};
 
-extern struct sl_global sl_global_data;
+	/* scheduler events, aligned to their size so that they don't span a page */
+	struct cos_sched_evt sched_evts[SL_SCHED_EVT_BATCH] __attribute__((aligned(SL_SCHED_EVT_BATCH * sizeof(struct cos_sched_evt))));
+	/* the page the kernel writes most scheduler events into, so that we needn't rcv them */
+	struct cos_sched_ring *sched_ring;
+
+	/* asnd to the scheduler rcv end-point of each other core */
+	asndcap_t      xcore_asnd[NUM_CPU_COS];
+	/* wakeups from other cores, one ring per sending core, and if we've been notified of them */
+	unsigned long  xcore_notified;
+	struct ck_ring xcore_rings[NUM_CPU_COS];
+	struct sl_xcore_wakeup xcore_bufs[NUM_CPU_COS][SL_XCORE_RING_SZ];
+	/* the scheduler's messages that didn't fit in their rings, resent each time it runs */
+	int            xcore_ndeferred;
+	struct sl_xcore_deferred xcore_deferred[SL_XCORE_DEFERRED_SZ];
+	/* unpinned threads waiting to be started on the first idle core */
+	struct ck_ring unpinned;
+	struct sl_unpinned unpinned_buf[SL_UNPINNED_RING_SZ];
+
+	/* load balancing: the threads bound to this core (read by other cores) */
+	unsigned long  nthds;
+	/* a migration request is outstanding, and the thread migrated to us, not yet attached */
+	int            balance_req;
+	struct sl_thd *balance_thd;
+	cycles_t       balance_next;   /* no request until this time */
+	thdid_t        balance_cursor; /* where to resume the search for a thread to migrate */
+} CACHE_ALIGNED;
+
+extern struct sl_global sl_global_data[NUM_CPU_COS];
+
+static inline struct sl_global *
+sl__globals_cpu(cpuid_t core)
+{ return &sl_global_data[core]; }
 
 static inline struct sl_global *
 sl__globals(void)
-{ return &sl_global_data; }
+{ return sl__globals_cpu(cos_cpuid()); }
 
 /* FIXME: integrate with param_set */
 static inline void
@@ -171,6 +206,7 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 	struct sl_thd        *t;
 	struct sl_global     *globals = sl__globals();
 	thdcap_t       thdcap;
+	tcap_t         tcap;
 	tcap_prio_t    prio;
 	sched_tok_t    tok;
 	cycles_t       now;
@@ -201,12 +237,14 @@ sl_cs_exit_schedule_nospin_arg(struct sl_thd *to)
 		else               t = sl_mod_thd_get(pt);
 	}
 	thdcap = t->thdcap;
+	tcap   = t->tcap;
 	prio   = t->prio;
 
 	sl_cs_exit();
 
-	/* TODO: enable per-thread tcaps for interrupt threads */
-	return cos_defswitch(thdcap, prio, sl__globals()->timeout_next, tok);
+	if (likely(!tcap)) return cos_defswitch(thdcap, prio, sl__globals()->timeout_next, tok);
+	/* threads with their own tcap (e.g. budget servers) consume it, not the scheduler's */
+	return cos_switch(thdcap, tcap, prio, sl__globals()->timeout_next, sl__globals()->sched_rcv, tok);
 }
 
 static inline int
@@ -238,14 +276,48 @@ sl_cs_exit_switchto(struct sl_thd *to)
  * instead (note that "dependency" is transitive).
  */
 void sl_thd_block(thdid_t tid);
-/* wakeup a thread that has (or soon will) block */
+/* block until woken, or until the absolute timeout (on the sl_now timeline) */
+void sl_thd_block_timeout(thdid_t tid, cycles_t abs_timeout);
+/*
+ * block until the next periodic release of the current thread (its
+ * period is set with SCHEDP_WINDOW).  Returns the number of releases
+ * that were missed because the thread overran its period, in which
+ * case it doesn't block.
+ */
+unsigned int sl_thd_block_periodic(thdid_t tid);
+/*
+ * wakeup a thread that has (or soon will) block.  The thread can be
+ * on any core: wakeups of threads on other cores are sent to their
+ * core's scheduler.
+ */
 void sl_thd_wakeup(thdid_t tid);
+/*
+ * wakeup a thread within the critical section, without scheduling;
+ * returns 1 if the thread wasn't blocked here, or -EAGAIN if it is on
+ * another core, and the ring to it is full
+ */
+int sl_thd_wakeup_no_cs(struct sl_thd *t);
 void sl_thd_yield(thdid_t tid);
 
-/* The entire thread allocation and free API */
+/*
+ * The entire thread allocation and free API.  Threads are bound to
+ * the core that allocates them (or, with SL_BALANCE, that they
+ * migrate to), and must be freed (and have their parameters set) on
+ * that core.
+ */
 struct sl_thd *sl_thd_alloc(cos_thd_fn_t fn, void *data);
 struct sl_thd *sl_thd_comp_alloc(struct cos_defcompinfo *comp);
+/* allocation within the critical section */
+struct sl_thd *sl_thd_alloc_no_cs(cos_thd_fn_t fn, void *data);
 void sl_thd_free(struct sl_thd *t);
+/*
+ * Create a thread that isn't pinned to a core: it is started (with
+ * parameter param, if non-zero) on the first core that has nothing
+ * else to run, which is another core only if SL_WORKSTEAL is set.
+ * Returns 0 on success, -1 if too many unpinned threads are waiting
+ * to start.
+ */
+int sl_thd_alloc_unpinned(cos_thd_fn_t fn, void *data, sched_param_t param);
 
 /*
  * Time and timeout API.
@@ -272,6 +344,14 @@ sl_timeout_oneshot(cycles_t absolute_us)
 	sl__globals()->timeout_next = tcap_cyc2time(absolute_us);
 }
 
+/* no timer interrupts until a new timeout is set */
+static inline void
+sl_timeout_clear(void)
+{
+	sl__globals()->timer_next   = 0;
+	sl__globals()->timeout_next = TCAP_TIME_NIL;
+}
+
 static inline void
 sl_timeout_relative(cycles_t offset)
 { sl_timeout_oneshot(sl_now() + offset); }
@@ -289,7 +369,9 @@ void sl_thd_param_set(struct sl_thd *t, sched_param_t sp);
 /*
  * Initialization protocol in cos_init: initialization of
  * library-internal data-structures, and then the ability for the
- * scheduler thread to start its scheduling loop.
+ * scheduler thread to start its scheduling loop.  This is done on
+ * each core that schedules threads; the first core to call sl_init
+ * initializes the state shared by all cores.
  *
  * sl_init();
  * sl_*;            <- use the sl_api here
@@ -3,4 +3,27 @@
 
 #define SL_PERIOD_US 100
 
+/* Number of fixed priorities in the FPRR policy (at most 256) */
+#define SL_FPRR_NPRIOS     32
+/* Round-robin time-slice between threads of the same priority */
+#define SL_FPRR_QUANTUM_US (10 * SL_PERIOD_US)
+
+/* Scheduler events received per cos_sched_rcv_batch (a power of 2) */
+#define SL_SCHED_EVT_BATCH  64
+
+/* Entries in each ring of cross-core wakeups (a power of 2) */
+#define SL_XCORE_RING_SZ    64
+/* Messages the scheduler can hold back while the rings they're sent to are full */
+#define SL_XCORE_DEFERRED_SZ 64
+/* Entries in each core's queue of unpinned threads waiting to start (a power of 2) */
+#define SL_UNPINNED_RING_SZ 64
+/* Should idle cores steal unpinned threads queued on other cores? */
+#define SL_WORKSTEAL        1
+/* Should idle cores migrate blocked threads from cores with more threads to themselves? */
+#define SL_BALANCE           1
+/* ...from a core that has at least this many more threads */
+#define SL_BALANCE_IMBALANCE 2
+/* Minimum time between an idle core's migration requests */
+#define SL_BALANCE_PERIOD_US (10 * SL_PERIOD_US)
+
 #endif	/* SL_CONSTS */
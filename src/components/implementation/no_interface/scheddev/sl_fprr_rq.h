@@ -0,0 +1,96 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Fixed-priority run-queue shared by the fixed-priority policies.
+ *
+ * A two-level occupancy bitmap shadows the per-priority lists: bit p
+ * of bmp is set iff threads[p] is non-empty, and bit w of summary is
+ * set iff bmp[w] is non-zero.  Finding the highest priority runnable
+ * thread is then two find-first-set operations, regardless of how
+ * many priority levels are empty.
+ */
+
+#ifndef SL_FPRR_RQ_H
+#define SL_FPRR_RQ_H
+
+#include <sl_consts.h>
+#include <sl_mod_policy.h>
+#include <ps_list.h>
+
+#if SL_FPRR_NPRIOS > 256
+#error "The fixed priority run-queue supports at most 256 priorities."
+#endif
+
+#define SL_FPRR_HIGHEST 0
+#define SL_FPRR_LOWEST  (SL_FPRR_NPRIOS-1)
+#define SL_FPRR_NWORDS  ((SL_FPRR_NPRIOS + 31) / 32)
+
+struct sl_fprr_rq {
+	u32_t               summary;
+	u32_t               bmp[SL_FPRR_NWORDS];
+	struct ps_list_head threads[SL_FPRR_NPRIOS];
+};
+
+static inline void
+sl_fprr_rq_init(struct sl_fprr_rq *rq)
+{
+	int i;
+
+	for (i = 0 ; i < SL_FPRR_NPRIOS ; i++) ps_list_head_init(&rq->threads[i]);
+	for (i = 0 ; i < SL_FPRR_NWORDS ; i++) rq->bmp[i] = 0;
+	rq->summary = 0;
+}
+
+static inline void
+sl_fprr_rq_add(struct sl_fprr_rq *rq, struct sl_thd_policy *t)
+{
+	int p = t->priority;
+
+	assert(p <= SL_FPRR_LOWEST);
+	ps_list_head_append_d(&rq->threads[p], t);
+	rq->bmp[p / 32] |= 1U << (p % 32);
+	rq->summary     |= 1U << (p / 32);
+}
+
+/* Removal of a thread that is not on the run-queue is a nop */
+static inline void
+sl_fprr_rq_rem(struct sl_fprr_rq *rq, struct sl_thd_policy *t)
+{
+	int p = t->priority;
+
+	if (ps_list_singleton_d(t)) return;
+	ps_list_rem_d(t);
+	if (!ps_list_head_empty(&rq->threads[p])) return;
+
+	rq->bmp[p / 32] &= ~(1U << (p % 32));
+	if (!rq->bmp[p / 32]) rq->summary &= ~(1U << (p / 32));
+}
+
+/* Move a queued thread to the end of its priority; the bitmaps don't change */
+static inline void
+sl_fprr_rq_rotate(struct sl_fprr_rq *rq, struct sl_thd_policy *t)
+{
+	if (ps_list_singleton_d(t)) return;
+	ps_list_rem_d(t);
+	ps_list_head_append_d(&rq->threads[t->priority], t);
+}
+
+static inline struct sl_thd_policy *
+sl_fprr_rq_first(struct sl_fprr_rq *rq)
+{
+	int w, p;
+
+	if (unlikely(!rq->summary)) return NULL;
+	w = __builtin_ctz(rq->summary);
+	p = w * 32 + __builtin_ctz(rq->bmp[w]);
+	assert(p <= SL_FPRR_LOWEST && !ps_list_head_empty(&rq->threads[p]));
+
+	return ps_list_head_first_d(&rq->threads[p], struct sl_thd_policy);
+}
+
+#endif	/* SL_FPRR_RQ_H */
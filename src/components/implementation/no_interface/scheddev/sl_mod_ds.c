@@ -0,0 +1,288 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Fixed priority with deferrable server budgets.  A thread given
+ * both a budget (SCHEDP_BUDGET) and a period (SCHEDP_WINDOW) becomes
+ * a server: it runs at its priority only while it has budget left in
+ * the current period, and is otherwise throttled until its budget is
+ * replenished at the next period boundary.  Threads without a budget
+ * are scheduled as in FPRR.
+ *
+ * The budget is also enforced by the kernel: each server executes on
+ * its own tcap that is refilled from the scheduler's tcap at each
+ * replenishment, so a server cannot overrun its budget between
+ * scheduler events.  The tcap is refilled up to the budget currently
+ * configured, so changes to the budget take effect in the kernel at
+ * the next replenishment.  A tcap's cycles can't be taken back, so
+ * a smaller budget is only enforced by the scheduler until the
+ * server has consumed what its tcap holds beyond it.
+ *
+ * As in EDF, the server state of each thread is kept here, indexed
+ * by thread id, rather than in the shared struct sl_thd_policy.
+ */
+
+#include <sl.h>
+#include <sl_consts.h>
+#include <sl_policy.h>
+#include <sl_plugins.h>
+#include <sl_fprr_rq.h>
+
+/* each core schedules its own threads */
+struct sl_mod_ds_core {
+	struct sl_fprr_rq   runqueue;
+	struct ps_list_head throttled;
+	cycles_t            throttled_next; /* earliest replenishment of a throttled server */
+} CACHE_ALIGNED;
+
+struct sl_mod_ds_thd {
+	cycles_t budget;       /* execution allowed per period */
+	cycles_t budget_left;
+	cycles_t replenish_at; /* absolute time of the next replenishment */
+	cycles_t tcap_left;    /* cycles left in the server's tcap */
+};
+
+static struct sl_mod_ds_core ds_cores[NUM_CPU_COS];
+static struct sl_mod_ds_thd  ds_thds[MAX_NUM_THREADS];
+static cycles_t              quantum;
+
+static inline struct sl_mod_ds_core *
+sl_mod_ds_core(void)
+{ return &ds_cores[cos_cpuid()]; }
+
+static inline struct sl_fprr_rq *
+sl_mod_ds_rq(void)
+{ return &sl_mod_ds_core()->runqueue; }
+
+static inline struct sl_mod_ds_thd *
+sl_mod_ds_thd(struct sl_thd_policy *t)
+{
+	thdid_t tid = sl_mod_thd_get(t)->thdid;
+
+	assert(tid < MAX_NUM_THREADS);
+
+	return &ds_thds[tid];
+}
+
+static inline int
+sl_mod_ds_server(struct sl_thd_policy *t)
+{ return sl_mod_ds_thd(t)->budget && t->period; }
+
+/* Refill the server's tcap from the scheduler's, up to the budget */
+static void
+sl_mod_ds_refill(struct sl_thd_policy *t)
+{
+	struct sl_mod_ds_thd *d = sl_mod_ds_thd(t);
+
+	if (d->tcap_left >= d->budget) return;
+	if (cos_tcap_transfer(sl_mod_thd_get(t)->rcv, sl__globals()->sched_tcap, d->budget - d->tcap_left, TCAP_PRIO_MAX + t->priority)) assert(0);
+	d->tcap_left = d->budget;
+}
+
+/* A thread's budget or period is (re)configured: start a new period with the new budget */
+static void
+sl_mod_ds_server_init(struct sl_thd_policy *t)
+{
+	struct cos_compinfo  *ci  = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_global     *g   = sl__globals();
+	struct sl_thd        *thd = sl_mod_thd_get(t);
+	struct sl_mod_ds_thd *d   = sl_mod_ds_thd(t);
+
+	d->budget_left  = d->budget;
+	d->replenish_at = sl_now() + t->period;
+	if (!thd->tcap) {
+		thd->tcap = cos_tcap_alloc(ci);
+		assert(thd->tcap);
+		thd->rcv  = cos_arcv_alloc(ci, thd->thdcap, thd->tcap, ci->comp_cap, g->sched_rcv);
+		assert(thd->rcv);
+		d->tcap_left = 0;
+	}
+	sl_mod_ds_refill(t);
+}
+
+/* Replenish the budget consumed in previous periods, and refill the server's tcap */
+static void
+sl_mod_ds_replenish(struct sl_thd_policy *t, cycles_t now)
+{
+	struct sl_mod_ds_thd *d = sl_mod_ds_thd(t);
+
+	if ((s64_t)(now - d->replenish_at) < 0) return;
+
+	d->budget_left   = d->budget;
+	d->replenish_at += t->period * (((now - d->replenish_at) / t->period) + 1);
+	sl_mod_ds_refill(t);
+}
+
+/* Add a runnable thread to the run-queue, or to the throttled list if it is out of budget */
+static void
+sl_mod_ds_enqueue(struct sl_thd_policy *t)
+{
+	struct sl_mod_ds_core *c;
+	struct sl_mod_ds_thd  *d = sl_mod_ds_thd(t);
+
+	if (sl_mod_ds_server(t)) sl_mod_ds_replenish(t, sl_now());
+	if (likely(!sl_mod_ds_server(t) || d->budget_left)) {
+		sl_fprr_rq_add(sl_mod_ds_rq(), t);
+		return;
+	}
+
+	c = sl_mod_ds_core();
+	ps_list_head_append_d(&c->throttled, t);
+	if (!c->throttled_next || (s64_t)(d->replenish_at - c->throttled_next) < 0) c->throttled_next = d->replenish_at;
+}
+
+static void
+sl_mod_ds_dequeue(struct sl_thd_policy *t)
+{
+	if (sl_mod_ds_server(t) && !sl_mod_ds_thd(t)->budget_left) ps_list_rem_d(t);
+	else                                        sl_fprr_rq_rem(sl_mod_ds_rq(), t);
+}
+
+/* Move the servers whose replenishment has arrived back onto the run-queue */
+static void
+sl_mod_ds_unthrottle(cycles_t now)
+{
+	struct sl_mod_ds_core *c = sl_mod_ds_core();
+	struct sl_thd_policy  *t, *n;
+
+	c->throttled_next = 0;
+	for (t = ps_list_head_first_d(&c->throttled, struct sl_thd_policy) ;
+	     !ps_list_is_head_d(&c->throttled, t) ; t = n) {
+		cycles_t replenish_at = sl_mod_ds_thd(t)->replenish_at;
+
+		n = ps_list_next_d(t);
+		if ((s64_t)(now - replenish_at) < 0) {
+			if (!c->throttled_next || (s64_t)(replenish_at - c->throttled_next) < 0) c->throttled_next = replenish_at;
+			continue;
+		}
+		ps_list_rem_d(t);
+		sl_mod_ds_replenish(t, now);
+		sl_fprr_rq_add(sl_mod_ds_rq(), t);
+	}
+}
+
+void
+sl_mod_execution(struct sl_thd_policy *t, cycles_t cycles)
+{
+	struct sl_mod_ds_thd *d      = sl_mod_ds_thd(t);
+	int                   queued = !ps_list_singleton_d(t);
+
+	if (sl_mod_ds_server(t)) {
+		/* the server executes on its tcap */
+		d->tcap_left = cycles < d->tcap_left ? d->tcap_left - cycles : 0;
+		if (cycles < d->budget_left) {
+			d->budget_left -= cycles;
+		} else {
+			/* throttle until the next replenishment */
+			if (queued) sl_fprr_rq_rem(sl_mod_ds_rq(), t);
+			d->budget_left = 0;
+			if (queued) sl_mod_ds_enqueue(t);
+			return;
+		}
+	}
+
+	if (likely(cycles < t->quantum_left)) {
+		t->quantum_left -= cycles;
+		return;
+	}
+	t->quantum_left = quantum;
+	sl_fprr_rq_rotate(sl_mod_ds_rq(), t);
+}
+
+struct sl_thd_policy *
+sl_mod_schedule(void)
+{
+	cycles_t next = sl_mod_ds_core()->throttled_next;
+
+	if (unlikely(next)) {
+		cycles_t now = sl_now();
+
+		if ((s64_t)(now - next) >= 0) sl_mod_ds_unthrottle(now);
+	}
+
+	return sl_fprr_rq_first(sl_mod_ds_rq());
+}
+
+void
+sl_mod_block(struct sl_thd_policy *t)
+{
+	sl_mod_ds_dequeue(t);
+}
+
+void
+sl_mod_wakeup(struct sl_thd_policy *t)
+{
+	assert(t->priority <= SL_FPRR_LOWEST && ps_list_singleton_d(t));
+
+	sl_mod_ds_enqueue(t);
+}
+
+void
+sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *yield_to)
+{
+	assert(t->priority <= SL_FPRR_LOWEST);
+
+	sl_fprr_rq_rotate(sl_mod_ds_rq(), t);
+	t->quantum_left = quantum;
+}
+
+void
+sl_mod_thd_create(struct sl_thd_policy *t)
+{
+	struct sl_mod_ds_thd *d = sl_mod_ds_thd(t);
+
+	t->priority     = SL_FPRR_LOWEST;
+	t->period       = 0;
+	t->period_usec  = 0;
+	t->quantum_left = quantum;
+	d->budget       = 0;
+	d->budget_left  = 0;
+	d->replenish_at = 0;
+	d->tcap_left    = 0;
+	ps_list_init_d(t);
+}
+
+void
+sl_mod_thd_delete(struct sl_thd_policy *t)
+{ sl_mod_ds_dequeue(t); }
+
+void
+sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned int v)
+{
+	/* if we're already on a list, and we're updating parameters */
+	if (!ps_list_singleton_d(t)) sl_mod_ds_dequeue(t);
+
+	switch (type) {
+	case SCHEDP_PRIO:
+		assert(v < SL_FPRR_NPRIOS);
+		t->priority = v;
+		break;
+	case SCHEDP_BUDGET:
+		sl_mod_ds_thd(t)->budget = sl_usec2cyc(v);
+		break;
+	case SCHEDP_WINDOW:
+		t->period_usec = v;
+		t->period      = sl_usec2cyc(v);
+		break;
+	default:
+		assert(0);
+	}
+	if ((type == SCHEDP_BUDGET || type == SCHEDP_WINDOW) && sl_mod_ds_server(t)) sl_mod_ds_server_init(t);
+
+	sl_mod_ds_enqueue(t);
+}
+
+void
+sl_mod_init(void)
+{
+	struct sl_mod_ds_core *c = sl_mod_ds_core();
+
+	sl_fprr_rq_init(&c->runqueue);
+	ps_list_head_init(&c->throttled);
+	c->throttled_next = 0;
+	quantum           = sl_usec2cyc(SL_FPRR_QUANTUM_US);
+}
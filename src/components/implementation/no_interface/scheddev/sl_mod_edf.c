@@ -0,0 +1,253 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Earliest Deadline First policy.  Runnable threads are kept in a
+ * binary min-heap keyed on their absolute deadline, and each thread
+ * tracks its own index in the heap so that removal on block is
+ * O(log n).  A thread's deadline is released (now + relative
+ * deadline) when it wakes up.  Threads that are only given a
+ * priority (SCHEDP_PRIO) are best-effort: they have an infinite
+ * deadline and run FIFO when no deadline thread is runnable.
+ *
+ * The EDF state of each thread is kept here, indexed by thread id,
+ * rather than in struct sl_thd_policy, which the policies share: as
+ * with the static backend, thread ids are below MAX_NUM_THREADS.
+ */
+
+#include <sl.h>
+#include <sl_consts.h>
+#include <sl_policy.h>
+#include <sl_plugins.h>
+#include <consts.h>
+
+#define SL_EDF_DL_INF (~(cycles_t)0)
+
+struct sl_mod_edf_thd {
+	cycles_t     deadline;     /* absolute deadline */
+	cycles_t     deadline_rel; /* relative deadline, defaults to the period */
+	unsigned int seq;          /* FIFO order between equal deadlines */
+	int          heap_idx;     /* index in the ready heap, 0 if not queued */
+};
+
+static struct sl_mod_edf_thd edf_thds[MAX_NUM_THREADS];
+
+/* each core schedules its own threads */
+struct sl_mod_edf_rq {
+	int                   sz;
+	unsigned int          seq;
+	/* 1-indexed heap so that parent/child computations are shifts */
+	struct sl_thd_policy *ready[MAX_NUM_THREADS + 1];
+} CACHE_ALIGNED;
+
+static struct sl_mod_edf_rq runqueues[NUM_CPU_COS];
+
+static inline struct sl_mod_edf_rq *
+sl_mod_edf_rq(void)
+{ return &runqueues[cos_cpuid()]; }
+
+static inline struct sl_mod_edf_thd *
+sl_mod_edf_thd(struct sl_thd_policy *t)
+{
+	thdid_t tid = sl_mod_thd_get(t)->thdid;
+
+	assert(tid < MAX_NUM_THREADS);
+
+	return &edf_thds[tid];
+}
+
+/* does a run before b? */
+static inline int
+sl_mod_edf_before(struct sl_thd_policy *a, struct sl_thd_policy *b)
+{
+	struct sl_mod_edf_thd *ea = sl_mod_edf_thd(a), *eb = sl_mod_edf_thd(b);
+
+	if (ea->deadline != eb->deadline) return ea->deadline < eb->deadline;
+	return (int)(ea->seq - eb->seq) < 0;
+}
+
+static inline void
+sl_mod_edf_place(struct sl_mod_edf_rq *rq, struct sl_thd_policy *t, int i)
+{
+	rq->ready[i]                = t;
+	sl_mod_edf_thd(t)->heap_idx = i;
+}
+
+static inline void
+sl_mod_edf_up(struct sl_mod_edf_rq *rq, int i)
+{
+	struct sl_thd_policy *t = rq->ready[i];
+
+	while (i > 1 && sl_mod_edf_before(t, rq->ready[i / 2])) {
+		sl_mod_edf_place(rq, rq->ready[i / 2], i);
+		i /= 2;
+	}
+	sl_mod_edf_place(rq, t, i);
+}
+
+static inline void
+sl_mod_edf_down(struct sl_mod_edf_rq *rq, int i)
+{
+	struct sl_thd_policy *t = rq->ready[i];
+
+	while (i * 2 <= rq->sz) {
+		int c = i * 2;
+
+		if (c < rq->sz && sl_mod_edf_before(rq->ready[c + 1], rq->ready[c])) c++;
+		if (!sl_mod_edf_before(rq->ready[c], t)) break;
+		sl_mod_edf_place(rq, rq->ready[c], i);
+		i = c;
+	}
+	sl_mod_edf_place(rq, t, i);
+}
+
+static void
+sl_mod_edf_enqueue(struct sl_thd_policy *t)
+{
+	struct sl_mod_edf_rq *rq = sl_mod_edf_rq();
+
+	assert(!sl_mod_edf_thd(t)->heap_idx && rq->sz < MAX_NUM_THREADS);
+
+	sl_mod_edf_thd(t)->seq = rq->seq++;
+	rq->sz++;
+	sl_mod_edf_place(rq, t, rq->sz);
+	sl_mod_edf_up(rq, rq->sz);
+}
+
+static void
+sl_mod_edf_dequeue(struct sl_thd_policy *t)
+{
+	struct sl_mod_edf_rq  *rq = sl_mod_edf_rq();
+	struct sl_mod_edf_thd *e  = sl_mod_edf_thd(t);
+	int i = e->heap_idx;
+	struct sl_thd_policy *last;
+
+	if (!i) return;
+	assert(rq->ready[i] == t);
+
+	e->heap_idx = 0;
+	last        = rq->ready[rq->sz];
+	rq->ready[rq->sz--] = NULL;
+	if (last == t) return;
+
+	sl_mod_edf_place(rq, last, i);
+	sl_mod_edf_up(rq, i);
+	sl_mod_edf_down(rq, sl_mod_edf_thd(last)->heap_idx);
+}
+
+/* A new job is released: its deadline is relative to now */
+static inline void
+sl_mod_edf_release(struct sl_thd_policy *t)
+{
+	struct sl_mod_edf_thd *e = sl_mod_edf_thd(t);
+
+	if (!e->deadline_rel) e->deadline = SL_EDF_DL_INF;
+	else                  e->deadline = sl_now() + e->deadline_rel;
+}
+
+void
+sl_mod_execution(struct sl_thd_policy *t, cycles_t cycles)
+{ }
+
+struct sl_thd_policy *
+sl_mod_schedule(void)
+{
+	struct sl_mod_edf_rq *rq = sl_mod_edf_rq();
+
+	if (unlikely(!rq->sz)) return NULL;
+
+	return rq->ready[1];
+}
+
+void
+sl_mod_block(struct sl_thd_policy *t)
+{
+	sl_mod_edf_dequeue(t);
+}
+
+void
+sl_mod_wakeup(struct sl_thd_policy *t)
+{
+	assert(!sl_mod_edf_thd(t)->heap_idx);
+
+	sl_mod_edf_release(t);
+	sl_mod_edf_enqueue(t);
+}
+
+/*
+ * Yielding ends the current job of a periodic thread (its next
+ * deadline is a period later), and moves a thread behind others with
+ * the same deadline.
+ */
+void
+sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *yield_to)
+{
+	struct sl_mod_edf_thd *e = sl_mod_edf_thd(t);
+
+	if (!e->heap_idx) return;
+
+	sl_mod_edf_dequeue(t);
+	if (t->period && e->deadline != SL_EDF_DL_INF) e->deadline += t->period;
+	sl_mod_edf_enqueue(t);
+}
+
+void
+sl_mod_thd_create(struct sl_thd_policy *t)
+{
+	struct sl_mod_edf_thd *e = sl_mod_edf_thd(t);
+
+	t->priority     = 0;
+	t->period       = 0;
+	t->period_usec  = 0;
+	e->deadline_rel = 0;
+	e->deadline     = SL_EDF_DL_INF;
+	e->heap_idx     = 0;
+	ps_list_init_d(t);
+}
+
+void
+sl_mod_thd_delete(struct sl_thd_policy *t)
+{ sl_mod_edf_dequeue(t); }
+
+void
+sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned int v)
+{
+	struct sl_mod_edf_thd *e = sl_mod_edf_thd(t);
+
+	switch (type) {
+	case SCHEDP_PRIO:
+		t->priority = v;
+		break;
+	case SCHEDP_WINDOW:
+		t->period_usec = v;
+		t->period      = sl_usec2cyc(v);
+		/* implicit deadlines unless one is explicitly set */
+		if (!e->deadline_rel) e->deadline_rel = t->period;
+		break;
+	case SCHEDP_DEADLINE:
+		e->deadline_rel = sl_usec2cyc(v);
+		break;
+	default:
+		assert(0);
+	}
+
+	/* as with the other policies, setting parameters makes the thread runnable */
+	sl_mod_edf_dequeue(t);
+	sl_mod_edf_release(t);
+	sl_mod_edf_enqueue(t);
+}
+
+void
+sl_mod_init(void)
+{
+	struct sl_mod_edf_rq *rq = sl_mod_edf_rq();
+	int i;
+
+	for (i = 0 ; i <= MAX_NUM_THREADS ; i++) rq->ready[i] = NULL;
+	rq->sz  = 0;
+	rq->seq = 0;
+}
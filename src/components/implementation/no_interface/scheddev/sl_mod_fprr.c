@@ -2,39 +2,37 @@
 #include <sl_consts.h>
 #include <sl_policy.h>
 #include <sl_plugins.h>
+#include <sl_fprr_rq.h>
 
-#define SL_FPRR_NPRIOS  32
-#define SL_FPRR_HIGHEST 0
-#define SL_FPRR_LOWEST  (SL_FPRR_NPRIOS-1)
+/* each core schedules its own threads */
+static struct sl_fprr_rq runqueues[NUM_CPU_COS];
+static cycles_t          quantum;
 
-struct ps_list_head threads[SL_FPRR_NPRIOS];
+static inline struct sl_fprr_rq *
+sl_mod_fprr_rq(void)
+{ return &runqueues[cos_cpuid()]; }
 
-/* No RR yet */
+/* Round-robin: rotate a thread that has consumed its time-slice to the end of its priority */
 void
 sl_mod_execution(struct sl_thd_policy *t, cycles_t cycles)
-{ }
-
-struct sl_thd_policy *
-sl_mod_schedule(void)
 {
-	int i;
-	struct sl_thd_policy *t;
-
-	for (i = 0 ; i < SL_FPRR_NPRIOS ; i++) {
-		if (ps_list_head_empty(&threads[i])) continue;
-		t = ps_list_head_first_d(&threads[i], struct sl_thd_policy);
-
-		return t;
+	if (likely(cycles < t->quantum_left)) {
+		t->quantum_left -= cycles;
+		return;
 	}
-	assert(0);
-
-	return NULL;
+	t->quantum_left = quantum;
+	/* only rotates threads on the run-queue, blocked threads will be re-added on wakeup */
+	sl_fprr_rq_rotate(sl_mod_fprr_rq(), t);
 }
 
+struct sl_thd_policy *
+sl_mod_schedule(void)
+{ return sl_fprr_rq_first(sl_mod_fprr_rq()); }
+
 void
 sl_mod_block(struct sl_thd_policy *t)
 {
-	ps_list_rem_d(t);
+	sl_fprr_rq_rem(sl_mod_fprr_rq(), t);
 }
 
 void
@@ -42,7 +40,7 @@ sl_mod_wakeup(struct sl_thd_policy *t)
 {
 	assert(t->priority <= SL_FPRR_LOWEST && ps_list_singleton_d(t));
 
-	ps_list_head_append_d(&threads[t->priority], t);
+	sl_fprr_rq_add(sl_mod_fprr_rq(), t);
 }
 
 void
@@ -50,39 +48,43 @@ sl_mod_yield(struct sl_thd_policy *t, struct sl_thd_policy *yield_to)
 {
 	assert(t->priority <= SL_FPRR_LOWEST);
 
-	ps_list_rem_d(t);
-	ps_list_head_append_d(&threads[t->priority], t);
+	sl_fprr_rq_rotate(sl_mod_fprr_rq(), t);
+	t->quantum_left = quantum;
 }
 
 void
 sl_mod_thd_create(struct sl_thd_policy *t)
 {
-	t->priority    = SL_FPRR_LOWEST;
-	t->period      = 0;
-	t->period_usec = 0;
+	t->priority     = SL_FPRR_LOWEST;
+	t->period       = 0;
+	t->period_usec  = 0;
+	t->quantum_left = quantum;
 	ps_list_init_d(t);
 }
 
 void
 sl_mod_thd_delete(struct sl_thd_policy *t)
-{ ps_list_rem_d(t); }
+{ sl_fprr_rq_rem(sl_mod_fprr_rq(), t); }
 
 void
 sl_mod_thd_param_set(struct sl_thd_policy *t, sched_param_type_t type, unsigned int v)
 {
+	/* the period is only used for periodic blocking, not for scheduling decisions */
+	if (type == SCHEDP_WINDOW) {
+		t->period_usec = v;
+		t->period      = sl_usec2cyc(v);
+		return;
+	}
+
 	assert(type == SCHEDP_PRIO && v < SL_FPRR_NPRIOS);
-	ps_list_rem_d(t); 	/* if we're already on a list, and we're updating priority */
+	sl_fprr_rq_rem(sl_mod_fprr_rq(), t); 	/* if we're already on a list, and we're updating priority */
 	t->priority = v;
-	ps_list_head_append_d(&threads[t->priority], t);
+	sl_fprr_rq_add(sl_mod_fprr_rq(), t);
 }
 
 void
 sl_mod_init(void)
 {
-	int i;
-	struct sl_thd *t;
-
-	for (i = 0 ; i < SL_FPRR_NPRIOS ; i++) {
-		ps_list_head_init(&threads[i]);
-	}
+	sl_fprr_rq_init(sl_mod_fprr_rq());
+	quantum = sl_usec2cyc(SL_FPRR_QUANTUM_US);
 }
@@ -20,6 +20,8 @@ void sl_thd_free_backend(struct sl_thd_policy *t);
 void sl_thd_index_add_backend(struct sl_thd_policy *);
 void sl_thd_index_rem_backend(struct sl_thd_policy *);
 struct sl_thd_policy *sl_thd_lookup_backend(thdid_t);
+/* thread ids that have been indexed are all below this */
+thdid_t sl_thd_maxid_backend(void);
 void sl_thd_init_backend(void);
 
 /*
@@ -47,5 +49,12 @@ void sl_mod_init(void);
 /* API for handling timer management */
 void sl_timeout_mod_expended(cycles_t now, cycles_t oldtimeout);
 void sl_timeout_mod_init(void);
+/*
+ * Queue of timeouts for blocked threads: the timer module must wake
+ * up (sl_thd_wakeup_no_cs) a thread when its timeout expires, and
+ * removal of a thread without a timeout must be a nop.
+ */
+void sl_timeout_mod_block(struct sl_thd *t, cycles_t timeout);
+void sl_timeout_mod_remove(struct sl_thd *t);
 
 #endif	/* SL_PLUGINS_H */
@@ -9,6 +9,7 @@ struct sl_thd_policy {
 	tcap_prio_t    priority;
 	microsec_t     period_usec;
 	cycles_t       period;
+	cycles_t       quantum_left; /* execution left in the current time-slice */
 	struct ps_list list;
 };
 
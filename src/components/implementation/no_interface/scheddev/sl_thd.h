@@ -14,14 +14,25 @@ typedef enum {
 	SL_THD_WOKEN, 		/* if a race causes a wakeup before the inevitable block */
 	SL_THD_RUNNABLE,
 	SL_THD_DYING,
+	SL_THD_MIGRATING,       /* blocked, and between cores (see sl_xcore.h) */
+	SL_THD_MIGRATING_WOKEN, /* ...and woken before its new core attached it */
 } sl_thd_state;
 
 struct sl_thd {
 	sl_thd_state   state;
 	thdid_t        thdid;
 	thdcap_t       thdcap;
+	cpuid_t        cpuid;         /* the core the thread is bound to */
 	tcap_prio_t    prio;
 	struct sl_thd *dependency;
+	/* tcap and rcv end-point to run with, the scheduler's if 0 */
+	tcap_t         tcap;
+	arcvcap_t      rcv;
+
+	cycles_t       timeout_cycs;  /* absolute wakeup time when blocked with a timeout */
+	int            timeout_idx;   /* index in the timer module's queue, 0 if no timeout */
+	cycles_t       period;        /* period for sl_thd_block_periodic (SCHEDP_WINDOW) */
+	cycles_t       periodic_cycs; /* the last periodic release */
 };
 
 #ifndef assert
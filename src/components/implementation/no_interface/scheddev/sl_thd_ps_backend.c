@@ -0,0 +1,146 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Dynamic thread allocation backend: thread structures are allocated
+ * from per-core ps slabs and returned to them when freed, and are
+ * indexed by thread id in a radix trie.  Memory is thus proportional
+ * to the number of live threads rather than to MAX_NUM_THREADS.
+ * sl serializes allocation, freeing, and the lookups of threads on
+ * other cores with sl_alloc_lock: a freed thread is reused by the
+ * next allocation.  A core's lookups of its own threads can't race
+ * with their freeing, and aren't serialized.
+ */
+
+#include <sl.h>
+#include <consts.h>
+#include <ps.h>
+#include <ps_slab.h>
+#include <kvtrie.h>
+#include <cos_kernel_api.h>
+
+/* Objects are a multiple of the cache-line size so that threads don't share cache-lines */
+#define SL_THD_OBJ_SZ (((sizeof(struct sl_thd_policy) + PS_CACHE_LINE - 1) / PS_CACHE_LINE) * PS_CACHE_LINE)
+
+/*
+ * Pages backing both the slabs and the trie.  Pages from the bump
+ * allocator cannot be returned, so pages released by the slabs are
+ * cached here for reuse.
+ */
+struct sl_thd_page {
+	struct sl_thd_page *next;
+};
+static struct sl_thd_page *sl_thd_pages;
+
+static void *
+sl_thd_page_alloc(void)
+{
+	struct sl_thd_page *p = sl_thd_pages;
+
+	if (p) {
+		sl_thd_pages = p->next;
+		return p;
+	}
+
+	return cos_page_bump_alloc(cos_compinfo_get(cos_defcompinfo_curr_get()));
+}
+
+static void
+sl_thd_page_free(void *page)
+{
+	struct sl_thd_page *p = page;
+
+	p->next      = sl_thd_pages;
+	sl_thd_pages = p;
+}
+
+static void *
+sl_thd_slab_alloc(struct ps_mem *m, size_t sz, coreid_t coreid)
+{
+	assert(sz == PAGE_SIZE);
+
+	return sl_thd_page_alloc();
+}
+
+static void
+sl_thd_slab_free(struct ps_mem *m, struct ps_slab *s, size_t sz, coreid_t coreid)
+{
+	assert(sz == PAGE_SIZE);
+
+	sl_thd_page_free(s);
+}
+
+PS_SLAB_CREATE_AFNS(sl_thd, SL_THD_OBJ_SZ, PAGE_SIZE, 0, sl_thd_slab_alloc, sl_thd_slab_free)
+
+static void *
+sl_thd_index_allocfn(void *d, int sz, int last_lvl)
+{
+	assert(sz <= PAGE_SIZE);
+
+	return sl_thd_page_alloc();
+}
+
+static void
+sl_thd_index_freefn(void *d, void *m, int sz, int last_lvl)
+{ sl_thd_page_free(m); }
+
+/* 16 bit thread ids: a 64 entry root, and 1024 entry (page-sized) leaves */
+KVT_CREATE(sl_thd_index, 2, 6, 10, sl_thd_index_allocfn, sl_thd_index_freefn);
+
+static struct sl_thd_index_ert *sl_thd_idx;
+/* one past the largest thread id ever indexed */
+static thdid_t sl_thd_idx_max;
+
+struct sl_thd_policy *
+sl_thd_alloc_backend(thdid_t tid)
+{
+	struct sl_thd_policy *t;
+
+	assert(tid < sl_thd_index_maxid());
+	t = ps_slab_alloc_sl_thd();
+	if (!t) return NULL;
+	memset(t, 0, sizeof(struct sl_thd_policy));
+
+	return t;
+}
+
+void
+sl_thd_free_backend(struct sl_thd_policy *t)
+{ ps_slab_free_sl_thd(t); }
+
+void
+sl_thd_index_add_backend(struct sl_thd_policy *t)
+{
+	thdid_t tid = sl_mod_thd_get(t)->thdid;
+
+	if (sl_thd_index_add(sl_thd_idx, tid, t)) assert(0);
+	if (tid >= sl_thd_idx_max) sl_thd_idx_max = tid + 1;
+}
+
+void
+sl_thd_index_rem_backend(struct sl_thd_policy *t)
+{ sl_thd_index_del(sl_thd_idx, sl_mod_thd_get(t)->thdid); }
+
+struct sl_thd_policy *
+sl_thd_lookup_backend(thdid_t tid)
+{
+	assert(tid < sl_thd_index_maxid());
+	return sl_thd_index_lkupp(sl_thd_idx, tid);
+}
+
+thdid_t
+sl_thd_maxid_backend(void)
+{ return *(volatile thdid_t *)&sl_thd_idx_max; }
+
+void
+sl_thd_init_backend(void)
+{
+	sl_thd_pages   = NULL;
+	sl_thd_idx_max = 0;
+	sl_thd_idx     = sl_thd_index_alloc(NULL);
+	assert(sl_thd_idx);
+}
@@ -39,6 +39,10 @@ sl_thd_lookup_backend(thdid_t tid)
 	return &sl_threads[tid];
 }
 
+thdid_t
+sl_thd_maxid_backend(void)
+{ return MAX_NUM_THREADS; }
+
 void
 sl_thd_init_backend(void)
 { }
@@ -0,0 +1,109 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Queue of timeouts for the timer modules: a binary min-heap of
+ * blocked threads keyed on their absolute wakeup time.  Each thread
+ * tracks its index in the heap (0 when it has no timeout), so that
+ * an explicit wakeup can cancel the timeout in O(log n).
+ */
+
+#ifndef SL_TIMEOUT_HEAP_H
+#define SL_TIMEOUT_HEAP_H
+
+#include <sl_thd.h>
+#include <consts.h>
+
+struct sl_timeout_heap {
+	int            sz;
+	/* 1-indexed so that parent/child computations are shifts */
+	struct sl_thd *thds[MAX_NUM_THREADS + 1];
+};
+
+static inline int
+sl_timeout_heap_before(struct sl_thd *a, struct sl_thd *b)
+{ return (s64_t)(a->timeout_cycs - b->timeout_cycs) < 0; }
+
+static inline void
+sl_timeout_heap_place(struct sl_timeout_heap *h, struct sl_thd *t, int i)
+{
+	h->thds[i]     = t;
+	t->timeout_idx = i;
+}
+
+static inline void
+sl_timeout_heap_up(struct sl_timeout_heap *h, int i)
+{
+	struct sl_thd *t = h->thds[i];
+
+	while (i > 1 && sl_timeout_heap_before(t, h->thds[i / 2])) {
+		sl_timeout_heap_place(h, h->thds[i / 2], i);
+		i /= 2;
+	}
+	sl_timeout_heap_place(h, t, i);
+}
+
+static inline void
+sl_timeout_heap_down(struct sl_timeout_heap *h, int i)
+{
+	struct sl_thd *t = h->thds[i];
+
+	while (i * 2 <= h->sz) {
+		int c = i * 2;
+
+		if (c < h->sz && sl_timeout_heap_before(h->thds[c + 1], h->thds[c])) c++;
+		if (!sl_timeout_heap_before(h->thds[c], t)) break;
+		sl_timeout_heap_place(h, h->thds[c], i);
+		i = c;
+	}
+	sl_timeout_heap_place(h, t, i);
+}
+
+static inline void
+sl_timeout_heap_init(struct sl_timeout_heap *h)
+{ h->sz = 0; }
+
+static inline int
+sl_timeout_heap_empty(struct sl_timeout_heap *h)
+{ return h->sz == 0; }
+
+static inline struct sl_thd *
+sl_timeout_heap_peek(struct sl_timeout_heap *h)
+{ return h->sz ? h->thds[1] : NULL; }
+
+static inline void
+sl_timeout_heap_add(struct sl_timeout_heap *h, struct sl_thd *t, cycles_t timeout)
+{
+	assert(!t->timeout_idx && h->sz < MAX_NUM_THREADS);
+
+	t->timeout_cycs = timeout;
+	h->sz++;
+	sl_timeout_heap_place(h, t, h->sz);
+	sl_timeout_heap_up(h, h->sz);
+}
+
+/* Removing a thread without a timeout is a nop */
+static inline void
+sl_timeout_heap_rem(struct sl_timeout_heap *h, struct sl_thd *t)
+{
+	int i = t->timeout_idx;
+	struct sl_thd *last;
+
+	if (!i) return;
+	assert(h->thds[i] == t);
+
+	t->timeout_idx = 0;
+	last           = h->thds[h->sz];
+	h->thds[h->sz--] = NULL;
+	if (last == t) return;
+
+	sl_timeout_heap_place(h, last, i);
+	sl_timeout_heap_up(h, i);
+	sl_timeout_heap_down(h, last->timeout_idx);
+}
+
+#endif	/* SL_TIMEOUT_HEAP_H */
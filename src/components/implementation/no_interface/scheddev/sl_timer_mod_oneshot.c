@@ -0,0 +1,73 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Oneshot timer module: the timer is programmed for the earliest
+ * thread timeout, and not at all when there are none.  Idle cores
+ * thus take no timer interrupts, and threads are woken at their
+ * timeout rather than at the next periodic tick.
+ */
+
+#include <sl.h>
+#include <sl_consts.h>
+#include <sl_plugins.h>
+#include <sl_timeout_heap.h>
+
+/* each core has its own timer, and its own threads' timeouts */
+static struct sl_timeout_heap timeout_heaps[NUM_CPU_COS];
+
+static inline struct sl_timeout_heap *
+sl_timeout_mod_heap(void)
+{ return &timeout_heaps[cos_cpuid()]; }
+
+static void
+sl_timeout_mod_program(void)
+{
+	struct sl_thd *t = sl_timeout_heap_peek(sl_timeout_mod_heap());
+
+	if (t) sl_timeout_oneshot(t->timeout_cycs);
+	else   sl_timeout_clear();
+}
+
+void
+sl_timeout_mod_expended(cycles_t now, cycles_t oldtimeout)
+{
+	struct sl_timeout_heap *h = sl_timeout_mod_heap();
+	struct sl_thd          *t;
+
+	while ((t = sl_timeout_heap_peek(h)) && (s64_t)(t->timeout_cycs - now) <= 0) {
+		sl_timeout_heap_rem(h, t);
+		sl_thd_wakeup_no_cs(t);
+	}
+	sl_timeout_mod_program();
+}
+
+void
+sl_timeout_mod_block(struct sl_thd *t, cycles_t timeout)
+{
+	struct sl_timeout_heap *h = sl_timeout_mod_heap();
+
+	sl_timeout_heap_add(h, t, timeout);
+	if (sl_timeout_heap_peek(h) == t) sl_timeout_oneshot(timeout);
+}
+
+void
+sl_timeout_mod_remove(struct sl_thd *t)
+{
+	struct sl_timeout_heap *h     = sl_timeout_mod_heap();
+	int                     first = (sl_timeout_heap_peek(h) == t);
+
+	sl_timeout_heap_rem(h, t);
+	if (first) sl_timeout_mod_program();
+}
+
+void
+sl_timeout_mod_init(void)
+{
+	sl_timeout_heap_init(sl_timeout_mod_heap());
+	sl_timeout_clear();
+}
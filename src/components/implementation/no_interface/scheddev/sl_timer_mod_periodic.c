@@ -1,21 +1,46 @@
 #include <sl.h>
 #include <sl_consts.h>
 #include <sl_plugins.h>
+#include <sl_timeout_heap.h>
 
+/* each core has its own timer, and its own threads' timeouts */
+static struct sl_timeout_heap timeout_heaps[NUM_CPU_COS];
+
+static inline struct sl_timeout_heap *
+sl_timeout_mod_heap(void)
+{ return &timeout_heaps[cos_cpuid()]; }
+
+/* Thread timeouts are processed at the granularity of the period */
 void
-sl_timeout_mod_expended(microsec_t now, microsec_t oldtimeout)
+sl_timeout_mod_expended(cycles_t now, cycles_t oldtimeout)
 {
-	cycles_t offset;
+	struct sl_timeout_heap *h = sl_timeout_mod_heap();
+	struct sl_thd          *t;
+	cycles_t                offset;
 
 	assert(now >= oldtimeout);
 
+	while ((t = sl_timeout_heap_peek(h)) && (s64_t)(t->timeout_cycs - now) <= 0) {
+		sl_timeout_heap_rem(h, t);
+		sl_thd_wakeup_no_cs(t);
+	}
+
 	/* in virtual environments, or with very small periods, we might miss more than one period */
 	offset = (now - oldtimeout) % sl_timeout_period_get();
 	sl_timeout_oneshot(now + sl_timeout_period_get() - offset);
 }
 
+void
+sl_timeout_mod_block(struct sl_thd *t, cycles_t timeout)
+{ sl_timeout_heap_add(sl_timeout_mod_heap(), t, timeout); }
+
+void
+sl_timeout_mod_remove(struct sl_thd *t)
+{ sl_timeout_heap_rem(sl_timeout_mod_heap(), t); }
+
 void
 sl_timeout_mod_init(void)
 {
+	sl_timeout_heap_init(sl_timeout_mod_heap());
 	sl_timeout_period(SL_PERIOD_US);
 }
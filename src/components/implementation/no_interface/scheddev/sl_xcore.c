@@ -0,0 +1,417 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+#include <sl.h>
+#include <sl_consts.h>
+#include <sl_xcore.h>
+#include <cos_kernel_api.h>
+
+/* Called by the first core to initialize sl, before any core can send to another */
+void
+sl_xcore_init(void)
+{
+	int i, j;
+
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		struct sl_global *g = sl__globals_cpu(i);
+
+		g->xcore_notified  = 0;
+		g->xcore_ndeferred = 0;
+		for (j = 0 ; j < NUM_CPU_COS ; j++) ck_ring_init(&g->xcore_rings[j], SL_XCORE_RING_SZ);
+		ck_ring_init(&g->unpinned, SL_UNPINNED_RING_SZ);
+	}
+}
+
+/*
+ * Send a message to another core's scheduler; called in the critical
+ * section.  Returns -EAGAIN if the ring to it is full.  We can't wait
+ * for it to drain in the critical section: the remote scheduler might
+ * itself be waiting on a full ring to us.
+ */
+static int
+sl_xcore_send(cpuid_t dst, sl_xcore_msg_t type, thdid_t tid)
+{
+	struct sl_global      *g    = sl__globals_cpu(dst);
+	asndcap_t              snd  = sl__globals()->xcore_asnd[dst];
+	cpuid_t                core = cos_cpuid();
+	struct sl_xcore_wakeup w;
+	int                    ret  = 0;
+
+	assert(sl_cs_owner() && dst != core);
+
+	w.tid  = tid;
+	w.type = type;
+	if (unlikely(!ck_ring_enqueue_spsc_sl_xcore(&g->xcore_rings[core], g->xcore_bufs[core], &w))) ret = -EAGAIN;
+	/*
+	 * Only the first message since the remote scheduler last
+	 * processed its rings notifies it.  A full ring is still
+	 * pending its notification, unless it was drained since.
+	 */
+	if (ps_cas(&g->xcore_notified, 0, 1) && cos_asnd(snd, 0)) assert(0);
+
+	return ret;
+}
+
+/* Send a wakeup to a thread's core; called in the critical section.  Returns -EAGAIN if the ring is full. */
+int
+sl_xcore_wakeup(struct sl_thd *t)
+{ return sl_xcore_send(t->cpuid, SL_XCORE_WAKEUP, t->thdid); }
+
+/*
+ * The scheduler can't yield to let the other cores drain their rings,
+ * so it holds back the messages that don't fit, and resends them each
+ * time it processes its own (sl_xcore_wakeups_process).  Called by
+ * the scheduler in the critical section.
+ */
+static void
+sl_xcore_defer(cpuid_t dst, sl_xcore_msg_t type, thdid_t tid)
+{
+	struct sl_global         *g = sl__globals();
+	struct sl_xcore_deferred *d;
+
+	/* a message is only processed if there's room to defer what it sends */
+	assert(g->xcore_ndeferred < SL_XCORE_DEFERRED_SZ);
+	d         = &g->xcore_deferred[g->xcore_ndeferred++];
+	d->dst    = dst;
+	d->w.tid  = tid;
+	d->w.type = type;
+}
+
+/*
+ * Deliver a wakeup sent to us, or deferred, to thread tid.  Returns
+ * -EAGAIN if it has since migrated to another core, and the ring to
+ * it is full.
+ */
+static int
+sl_xcore_wakeup_deliver(thdid_t tid)
+{
+	struct sl_thd *t;
+	int            ret = 0;
+
+	/* if the thread has migrated, its new core can free it meanwhile (see sl_thd_free) */
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
+	t = sl_thd_lkup(tid);
+	/* the thread might have been freed since the wakeup was sent */
+	if (unlikely(!t || t->state == SL_THD_FREE)) goto done;
+	/* it is forwarded if the thread has since migrated to another core */
+	if (unlikely(sl_thd_wakeup_no_cs(t) == -EAGAIN)) ret = -EAGAIN;
+done:
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
+
+	return ret;
+}
+
+/* Resend the deferred messages, in order, keeping those that still don't fit */
+static void
+sl_xcore_deferred_send(void)
+{
+	struct sl_global *g = sl__globals();
+	int               i, n = 0;
+
+	for (i = 0 ; i < g->xcore_ndeferred ; i++) {
+		struct sl_xcore_deferred *d = &g->xcore_deferred[i];
+		int                       ret;
+
+		/* a wakeup is looked up again, as the thread might have migrated (even to us) */
+		if (d->w.type == SL_XCORE_WAKEUP) ret = sl_xcore_wakeup_deliver(d->w.tid);
+		else                              ret = sl_xcore_send(d->dst, d->w.type, d->w.tid);
+		if (ret) g->xcore_deferred[n++] = *d;
+	}
+	g->xcore_ndeferred = n;
+}
+
+/*
+ * A wakeup of a thread migrating from this core is recorded in its
+ * state for its new core to deliver when it attaches the thread, or,
+ * if it already has, is forwarded to it.  Returns 1, as for a thread
+ * that wasn't blocked: the thread isn't runnable here, or -EAGAIN if
+ * the ring to its new core is full.
+ */
+int
+sl_xcore_migrating_wakeup(struct sl_thd *t)
+{
+	if (ps_cas((unsigned long *)&t->state, SL_THD_MIGRATING, SL_THD_MIGRATING_WOKEN)) return 1;
+	if (t->state != SL_THD_MIGRATING_WOKEN && unlikely(sl_xcore_wakeup(t))) return -EAGAIN;
+
+	return 1;
+}
+
+/*
+ * Can t migrate from this core?  Only threads that are blocked without
+ * a timeout, and dispatched with the scheduler's tcap, have no state in
+ * this core's policy and timer modules, and in the kernel.
+ */
+static int
+sl_xcore_migratable(struct sl_thd *t)
+{
+	struct sl_global *g = sl__globals();
+
+	return t && t->cpuid == cos_cpuid() && t->state == SL_THD_BLOCKED && !t->timeout_idx &&
+	       !t->tcap && !t->rcv && t != g->sched_thd && t != g->idle_thd;
+}
+
+/*
+ * Core dst asked for a thread: migrate one of our blocked threads to
+ * it if we still have enough more threads than it, and reply with its
+ * id (0 if none migrated).  Called in the critical section.
+ */
+static void
+sl_xcore_migrate_out(cpuid_t dst)
+{
+	struct sl_global    *g   = sl__globals();
+	struct cos_compinfo *ci  = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_thd       *t   = NULL;
+	thdid_t              tid = 0;
+	/* the dynamic backend's thread ids aren't bounded by MAX_NUM_THREADS */
+	int                  max = sl_thd_maxid_backend();
+	int                  i, ret;
+
+	if (g->nthds < sl__globals_cpu(dst)->nthds + SL_BALANCE_IMBALANCE) goto reply;
+	for (i = 0 ; i < max ; i++) {
+		g->balance_cursor = (g->balance_cursor + 1) % max;
+		if (!g->balance_cursor) continue;
+		t = sl_thd_lkup(g->balance_cursor);
+		if (sl_xcore_migratable(t)) break;
+	}
+	if (i == max) goto reply;
+
+	/* the liveness id for the kernel's quiescence is allocated on first use */
+	ck_spinlock_ticket_lock(&sl_alloc_lock);
+	ret = cos_thd_migrate_out(ci, t->thdcap, dst);
+	ck_spinlock_ticket_unlock(&sl_alloc_lock);
+	if (ret) goto reply;
+
+	t->state = SL_THD_MIGRATING;
+	g->nthds--;
+	tid      = t->thdid;
+reply:
+	if (unlikely(sl_xcore_send(dst, SL_XCORE_MIGRATED, tid))) sl_xcore_defer(dst, SL_XCORE_MIGRATED, tid);
+}
+
+/*
+ * Attach the thread migrated to us, once the kernel's quiescence
+ * period since it was detached has passed.  Returns 1 once it is
+ * attached, 0 if we must try again later, or the kernel's error if
+ * it can't be attached, in which case we give up on it.  Called in
+ * the critical section.
+ */
+static int
+sl_xcore_migrate_in(void)
+{
+	struct sl_global    *g  = sl__globals();
+	struct cos_compinfo *ci = cos_compinfo_get(cos_defcompinfo_curr_get());
+	struct sl_thd       *t  = g->balance_thd;
+	int                  ret;
+
+	assert(t);
+	ret = cos_thd_migrate_in(ci, t->thdcap, 0);
+	if (ret == -EQUIESCENCE) return 0;
+	if (unlikely(ret)) {
+		g->balance_thd = NULL;
+		return ret;
+	}
+
+	g->balance_thd = NULL;
+	g->nthds++;
+	/* wakeups from here on are sent to us: the previous core forwards them once it sees the state change */
+	t->cpuid = cos_cpuid();
+	if (ps_cas((unsigned long *)&t->state, SL_THD_MIGRATING, SL_THD_BLOCKED)) return 1;
+
+	assert(t->state == SL_THD_MIGRATING_WOKEN);
+	t->state = SL_THD_BLOCKED;
+	sl_thd_wakeup_no_cs(t);
+
+	return 1;
+}
+
+/* The reply to our migration request; returns sl_xcore_migrate_in's error */
+static int
+sl_xcore_migrated(thdid_t tid)
+{
+	struct sl_global *g = sl__globals();
+	int               ret;
+
+	g->balance_req  = 0;
+	g->balance_next = sl_now() + sl_usec2cyc(SL_BALANCE_PERIOD_US);
+	if (!tid) return 0;
+
+	g->balance_thd = sl_thd_lkup(tid);
+	assert(g->balance_thd && g->balance_thd->state >= SL_THD_MIGRATING);
+	ret = sl_xcore_migrate_in();
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Process the messages sent from other cores; called by the scheduler in the critical section */
+void
+sl_xcore_wakeups_process(void)
+{
+	struct sl_global      *g = sl__globals();
+	struct sl_xcore_wakeup w;
+	int                    i;
+
+	assert(sl_cs_owner());
+	if (unlikely(g->xcore_ndeferred)) sl_xcore_deferred_send();
+	/*
+	 * Senders enqueue before setting the flag, so if it isn't
+	 * set, there is nothing to process yet.  Clear it before
+	 * draining the rings so that a message enqueued after we've
+	 * drained its ring notifies us again.
+	 */
+	if (likely(!ps_cas(&g->xcore_notified, 1, 0))) return;
+
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		/* each message sends at most one (a forwarded wakeup, or a reply), so leave room to defer it */
+		while (g->xcore_ndeferred < SL_XCORE_DEFERRED_SZ &&
+		       ck_ring_dequeue_spsc_sl_xcore(&g->xcore_rings[i], g->xcore_bufs[i], &w)) {
+			switch (w.type) {
+			case SL_XCORE_WAKEUP:
+				if (unlikely(sl_xcore_wakeup_deliver(w.tid))) sl_xcore_defer(-1, SL_XCORE_WAKEUP, w.tid);
+				break;
+			case SL_XCORE_MIGRATE_REQ:
+				sl_xcore_migrate_out(i);
+				break;
+			case SL_XCORE_MIGRATED:
+				/* on error, we've only not gained a thread */
+				(void)sl_xcore_migrated(w.tid);
+				break;
+			default:
+				assert(0);
+			}
+		}
+	}
+	/* out of room to defer: process the rest the next time we run */
+	if (unlikely(g->xcore_ndeferred == SL_XCORE_DEFERRED_SZ)) g->xcore_notified = 1;
+}
+
+int
+sl_thd_alloc_unpinned(cos_thd_fn_t fn, void *data, sched_param_t param)
+{
+	struct sl_global  *g = sl__globals();
+	struct sl_unpinned u;
+	int                ret = 0;
+
+	assert(fn);
+	u.fn    = fn;
+	u.data  = data;
+	u.param = param;
+
+	/* the critical section serializes the threads on this core that produce into the queue */
+	sl_cs_enter();
+	if (!ck_ring_enqueue_spmc_sl_unpinned(&g->unpinned, g->unpinned_buf, &u)) ret = -1;
+	sl_cs_exit();
+
+	return ret;
+}
+
+/* Is there an unpinned thread waiting that this core could start? */
+int
+sl_xcore_unpinned_pending(void)
+{
+	int i;
+
+	if (ck_ring_size(&sl__globals()->unpinned)) return 1;
+	if (!SL_WORKSTEAL) return 0;
+
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		if (ck_ring_size(&sl__globals_cpu(i)->unpinned)) return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Start an unpinned thread on this core, preferring the threads
+ * queued here, and otherwise stealing one from the other cores in
+ * order, starting with our neighbor.  Called in the critical
+ * section.  Returns 1 if a thread was started, 0 otherwise.
+ */
+int
+sl_xcore_unpinned_start(void)
+{
+	cpuid_t            core = cos_cpuid();
+	struct sl_unpinned u;
+	struct sl_thd     *t;
+	int                i;
+
+	assert(sl_cs_owner());
+
+	for (i = 0 ; i < (SL_WORKSTEAL ? NUM_CPU_COS : 1) ; i++) {
+		struct sl_global *g = sl__globals_cpu((core + i) % NUM_CPU_COS);
+
+		if (ck_ring_dequeue_spmc_sl_unpinned(&g->unpinned, g->unpinned_buf, &u)) break;
+	}
+	if (i == (SL_WORKSTEAL ? NUM_CPU_COS : 1)) return 0;
+
+	t = sl_thd_alloc_no_cs(u.fn, u.data);
+	assert(t);
+	if (u.param) sl_thd_param_set(t, u.param);
+
+	return 1;
+}
+
+/* The core with SL_BALANCE_IMBALANCE more threads than us with the most threads, -1 if none */
+static cpuid_t
+sl_xcore_busiest(void)
+{
+	unsigned long max     = sl__globals()->nthds + SL_BALANCE_IMBALANCE - 1;
+	cpuid_t       busiest = -1;
+	int           i;
+
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		unsigned long n = sl__globals_cpu(i)->nthds;
+
+		if (i == cos_cpuid() || n <= max) continue;
+		max     = n;
+		busiest = i;
+	}
+
+	return busiest;
+}
+
+/* Should this (idle) core ask for a thread, or attach the one migrated to it? */
+int
+sl_xcore_balance_pending(void)
+{
+	struct sl_global *g = sl__globals();
+
+	if (!SL_BALANCE)    return 0;
+	if (g->balance_thd) return 1;
+	if (g->balance_req || (s64_t)(sl_now() - g->balance_next) < 0) return 0;
+
+	return sl_xcore_busiest() >= 0;
+}
+
+/*
+ * Pull a thread to this core, which has nothing to run: attach the
+ * thread migrated to it, or ask the busiest core for one.  Called by
+ * the idle thread in the critical section.  Returns the kernel's
+ * error if the migrated thread can't be attached, 0 otherwise.
+ */
+int
+sl_xcore_balance(void)
+{
+	struct sl_global *g = sl__globals();
+	cpuid_t           busiest;
+	int               ret;
+
+	assert(sl_cs_owner());
+	if (!SL_BALANCE) return 0;
+	if (g->balance_thd) {
+		ret = sl_xcore_migrate_in();
+		return ret < 0 ? ret : 0;
+	}
+	if (!sl_xcore_balance_pending()) return 0;
+
+	busiest = sl_xcore_busiest();
+	if (busiest < 0) return 0;
+	/* if its ring is full, ask again the next time we're idle */
+	if (sl_xcore_send(busiest, SL_XCORE_MIGRATE_REQ, 0)) return 0;
+	g->balance_req = 1;
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * Redistribution of this file is permitted under the BSD two clause license.
+ *
+ * Copyright 2017, The George Washington University
+ * Author: Gabriel Parmer, gparmer@gwu.edu
+ */
+
+/*
+ * Cross-core communication between the per-core sl instances.
+ *
+ * Each thread is bound to the core that created it, and only that
+ * core's scheduler touches its state.  A wakeup of a thread on
+ * another core is thus queued in a ring on the target core, and the
+ * target's scheduler is notified with an asnd to its rcv end-point.
+ * Each core has one ring per sending core so that the rings are
+ * single-producer (the sender's critical section serializes the
+ * producers on a core), single-consumer (the target's scheduler).
+ *
+ * Unpinned threads are queued as (fn, data) on the core that creates
+ * them, and are only created once a core has nothing else to run:
+ * the local core, or (with SL_WORKSTEAL) an idle core that steals
+ * them.  From then on, they are bound to that core.
+ *
+ * With SL_BALANCE, an idle core with SL_BALANCE_IMBALANCE fewer
+ * threads than another asks it (through the same rings) for a
+ * thread.  The busier core migrates one of its blocked threads (see
+ * cos_thd_migrate_out), and replies with its id.  Once the kernel
+ * allows, the idle core attaches the thread, and the thread is bound
+ * to it from then on.  Wakeups of a thread while it is between cores
+ * are recorded by its previous core, and delivered once it's attached.
+ */
+
+#ifndef SL_XCORE_H
+#define SL_XCORE_H
+
+#include <ck_ring.h>
+#include <ck_spinlock.h>
+#include <res_spec.h>
+
+typedef enum {
+	SL_XCORE_WAKEUP,      /* wakeup of thread tid */
+	SL_XCORE_MIGRATE_REQ, /* migrate a thread to the sender */
+	SL_XCORE_MIGRATED,    /* reply: thread tid migrated to us (0 if none did) */
+} sl_xcore_msg_t;
+
+struct sl_xcore_wakeup {
+	thdid_t tid;
+	u16_t   type; 		/* sl_xcore_msg_t */
+};
+
+/* a message the scheduler couldn't send yet, as the ring to dst was full */
+struct sl_xcore_deferred {
+	cpuid_t                dst;
+	struct sl_xcore_wakeup w;
+};
+
+struct sl_unpinned {
+	cos_thd_fn_t  fn;
+	void         *data;
+	sched_param_t param;
+};
+
+CK_RING_PROTOTYPE(sl_xcore, sl_xcore_wakeup);
+CK_RING_PROTOTYPE(sl_unpinned, sl_unpinned);
+
+struct sl_thd;
+
+/* ...not part of the public API */
+extern ck_spinlock_ticket_t sl_alloc_lock;
+void sl_xcore_init(void);
+int  sl_xcore_wakeup(struct sl_thd *t);
+void sl_xcore_wakeups_process(void);
+int  sl_xcore_unpinned_pending(void);
+int  sl_xcore_unpinned_start(void);
+int  sl_xcore_migrating_wakeup(struct sl_thd *t);
+int  sl_xcore_balance_pending(void);
+int  sl_xcore_balance(void);
+
+#endif	/* SL_XCORE_H */
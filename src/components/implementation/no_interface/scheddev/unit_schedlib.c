@@ -11,6 +11,7 @@
 #include <cos_defkernel_api.h>
 
 #include <sl.h>
+#include <sl_consts.h>
 
 #undef assert
 #define assert(node) do { if (unlikely(!(node))) { debug_print("assert error in @ "); *((int *)0) = 0; } } while (0)
@@ -111,6 +112,86 @@ test_blocking_directed_yield(void)
 	sl_thd_param_set(high, sph.v);
 }
 
+#define TEST_PERIOD_US 10000
+#define TEST_NPERIODS  100
+
+/*
+ * The periodic thread has the highest priority, so it should never
+ * miss a release, and should never be released early.
+ */
+void
+test_periodic_fn(void *data)
+{
+	unsigned int missed = 0, early = 0;
+	int          i;
+
+	for (i = 0 ; i < TEST_NPERIODS ; i++) {
+		missed += sl_thd_block_periodic(0);
+		/* woken before the release it blocked for */
+		if ((s64_t)(sl_now() - sl_thd_curr()->periodic_cycs) < 0) early++;
+	}
+	printc("periodic: %d periods, %u missed, %u early\n", TEST_NPERIODS, missed, early);
+	assert(!missed && !early);
+
+	while (1) sl_thd_block_periodic(0);
+}
+
+void
+test_periodic(void)
+{
+	struct sl_thd *t;
+
+	t = sl_thd_alloc(test_periodic_fn, NULL);
+	assert(t);
+	sl_thd_param_set(t, sched_param_pack(SCHEDP_WINDOW, TEST_PERIOD_US));
+	sl_thd_param_set(t, sched_param_pack(SCHEDP_PRIO, 4));
+}
+
+/* microbenchmark the FPRR policy's scheduling decision */
+//#define SCHED_PERF 1
+#ifdef SCHED_PERF
+#define SCHED_PERF_MAXTHDS 64
+#define SCHED_PERF_ITERS   10000
+
+/*
+ * Microbenchmark the policy's scheduling decision as the number of
+ * runnable threads grows.  The threads are only policy-level
+ * structures (never dispatched, and without thread ids, so not for
+ * the policies that index their state by id), and are spread across
+ * the lowest priorities so that a linear scan would traverse the
+ * empty levels.
+ */
+void
+test_schedule_perf(void)
+{
+	static struct sl_thd_policy thds[SCHED_PERF_MAXTHDS];
+	int      n, i, j;
+	cycles_t start, end;
+
+	sl_cs_enter();
+	for (n = 1 ; n <= SCHED_PERF_MAXTHDS ; n *= 2) {
+		for (i = 0 ; i < n ; i++) {
+			sl_mod_thd_create(&thds[i]);
+			sl_mod_thd_param_set(&thds[i], SCHEDP_PRIO, SL_FPRR_NPRIOS - 1 - (i % (SL_FPRR_NPRIOS / 2)));
+		}
+
+		start = sl_now();
+		for (j = 0 ; j < SCHED_PERF_ITERS ; j++) {
+			struct sl_thd_policy *t = sl_mod_schedule();
+
+			assert(t);
+			sl_mod_yield(t, NULL);
+		}
+		end = sl_now();
+
+		for (i = 0 ; i < n ; i++) sl_mod_thd_delete(&thds[i]);
+		printc("sl_mod_schedule + yield, %d threads: %llu cycles\n", n,
+		       (end - start) / SCHED_PERF_ITERS);
+	}
+	sl_cs_exit();
+}
+#endif
+
 void
 cos_init(void)
 {
@@ -122,7 +203,11 @@ cos_init(void)
 	cos_defcompinfo_init();
 	sl_init();
 
+#ifdef SCHED_PERF
+	test_schedule_perf();
+#endif
 //	test_yields();
+	test_periodic();
 	test_blocking_directed_yield();
 
 	sl_sched_loop();
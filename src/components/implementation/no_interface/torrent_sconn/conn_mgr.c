@@ -25,6 +25,7 @@ extern td_t from_tsplit(spdid_t spdid, td_t tid, char *param, int len, tor_flags
 extern void from_trelease(spdid_t spdid, td_t tid);
 extern int from_tread(spdid_t spdid, td_t td, int cbid, int sz);
 extern int from_twrite(spdid_t spdid, td_t td, int cbid, int sz);
+extern int from_twritev(spdid_t spdid, td_t td, int cbid, int sz);
 #include <sched.h>
 
 static cos_lock_t sc_lock;
@@ -221,6 +222,51 @@ close:
 	goto done;
 }
 
+/* Does the component we connect to implement treadv? */
+static int to_vec = 1;
+
+/* 
+ * Forward the vector read from the component we connect to, to the
+ * network, so that neither the data nor its headers are copied here.
+ * Returns 1 if it isn't supported, -1 if the connection should be
+ * closed, and 0 otherwise.
+ */
+static int
+to_data_newv(struct tor_conn *tc)
+{
+	struct cbuf_vec *v;
+	cbuf_t cb;
+	int amnt, ret, sz = cbuf_vec_sz(CBUF_VEC_MAX);
+
+	if (!(v = cbuf_alloc(sz, &cb))) BUG();
+	while (1) {
+		amnt = treadv(cos_spd_id(), tc->to, cb, sz);
+		if (0 == amnt) break;
+		else if (-ENOTSUP == amnt) {
+			to_vec = 0;
+			ret    = 1;
+			goto done;
+		} else if (-EPIPE == amnt) {
+			ret = -1;
+			goto done;
+		} else if (amnt < 0) {
+			printc("read from fd %d produced %d.\n", tc->to, amnt);
+			BUG();
+		}
+		/* the network consumes the vector's elements */
+		if (amnt != (ret = from_twritev(cos_spd_id(), tc->from, cb, sz))) {
+			printc("conn_mgr: write failed w/ %d of %d on fd %d\n", 
+			       ret, amnt, tc->to);
+			ret = -1;
+			goto done;
+		}
+	}
+	ret = 0;
+done:
+	cbuf_free(v);
+	return ret;
+}
+
 static void 
 to_data_new(struct tor_conn *tc)
 {
@@ -229,6 +275,15 @@ to_data_new(struct tor_conn *tc)
 
 	from = tc->from;
 	to   = tc->to;
+	if (to_vec) {
+		switch (to_data_newv(tc)) {
+		case 0:  return;
+		case -1: 
+			buf = NULL;
+			goto close;
+		default: break;
+		}
+	}
 	while (1) {
 		int ret;
 		cbuf_t cb;
@@ -251,7 +306,7 @@ to_data_new(struct tor_conn *tc)
 		cbuf_free(buf);
 	}
 done:
-	cbuf_free(buf);
+	if (buf) cbuf_free(buf);
 	return;
 close:
 	mapping_remove(from, to, tc->feid, tc->teid);
@@ -0,0 +1 @@
+../../tests/micro_booter/mb_async_bench.c
\ No newline at end of file
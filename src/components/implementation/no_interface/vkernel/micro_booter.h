@@ -13,6 +13,7 @@
 #define debug_print(str) (PRINT_FN(str __FILE__ ":" STR(__LINE__) ".\n"))
 #define BUG_DIVZERO() do { debug_print("Testing divide by zero fault @ "); int i = num / den; } while (0)
 #define EXIT() do { while (1) cos_thd_switch(termthd); } while (0);
+#define SPIN() do { while (1) ; } while (0)
 
 #include <cos_component.h>
 #include <cobj_format.h>
@@ -44,8 +45,43 @@ static void
 tls_set(size_t off, unsigned long val)
 { __asm__ __volatile__("movl %0, %%gs:(%1)" : : "r" (val), "r" (off) : "memory"); }
 
+extern void *__inv_test_serverfn(int a, int b, int c);
+
+static inline
+int call_cap_mb(u32_t cap_no, int arg1, int arg2, int arg3)
+{
+	int ret;
+
+	/*
+	 * Which stack should we use for this invocation?  Simple, use
+	 * this stack, at the current sp.  This is essentially a
+	 * function call into another component, with odd calling
+	 * conventions.
+	 */
+	cap_no = (cap_no + 1) << COS_CAPABILITY_OFFSET;
+
+	__asm__ __volatile__( \
+		"pushl %%ebp\n\t" \
+		"movl %%esp, %%ebp\n\t" \
+		"movl %%esp, %%edx\n\t" \
+		"movl $1f, %%ecx\n\t" \
+		"sysenter\n\t" \
+		"1:\n\t" \
+		"popl %%ebp" \
+		: "=a" (ret)
+		: "a" (cap_no), "b" (arg1), "S" (arg2), "D" (arg3) \
+		: "memory", "cc", "ecx", "edx");
+
+	return ret;
+}
+
 extern int prints(char *s);
 extern int printc(char *fmt, ...);
 extern void test_run_vk(void);
+extern void test_async_bench(void);
+extern void test_async_bench_core(void);
+extern void test_inv_bench(void);
+extern void test_tcap_bench(void);
+extern void mb_report(const char *name, cycles_t *s, int n);
 
 #endif /* MICRO_BOOTER_H */
@@ -46,6 +46,14 @@
 
 #include <sched_timing.h>
 
+/*
+ * Place threads created without a SCHEDP_CORE_ID on the core with the
+ * fewest threads, rather than on the creating core.  This kernel
+ * interface can't migrate threads once they're created, so balancing
+ * is only done at creation.
+ */
+//#define SCHED_BALANCE
+
 struct sched_base_per_core {
 	volatile u64_t ticks;
 
@@ -66,6 +74,8 @@ struct sched_base_per_core {
 	struct sched_thd upcall_deactive;
 	struct sched_thd graveyard;
 	int IPI_acap;
+	/* threads on this core (read by other cores to balance thread creation) */
+	volatile int nthds;
 	long long report_evts[REVT_LAST];
 } CACHE_ALIGNED;
 
@@ -1149,6 +1159,7 @@ static int fp_kill_thd(struct sched_thd *t)
 	assert(!sched_thd_grp(t));
 	t->flags = THD_DYING;
 	sched_set_thd_core(t->id, -1);
+	PERCPU_GET(sched_base_state)->nthds--;
 
 	thread_remove(t);
 
@@ -1223,6 +1234,7 @@ static struct sched_thd *sched_setup_thread_arg(int dest_spd_id, void *metric_st
 
 	new->cpuid = cos_cpuid(); /* no thread migration between cores */
 	sched_set_thd_core(new->id, cos_cpuid());
+	PERCPU_GET(sched_base_state)->nthds++;
 
 	if (param) thread_param_set(new,  (struct sched_param_s *)metric_str);
 	else       thread_params_set(new, (char *)metric_str);
@@ -1242,6 +1254,24 @@ sched_create_thread(spdid_t spdid, struct cos_array *data)
 
 #define MAX_NUM_SCHED_PARAM 3
 
+/* The core with the fewest threads, preferring the current one */
+static cpuid_t sched_least_loaded_core(void)
+{
+	cpuid_t core = cos_cpuid();
+	int i, min = PERCPU_GET(sched_base_state)->nthds;
+
+	for (i = 0; i < NUM_CPU_COS; i++) {
+		int n = PERCPU_GET_TARGET(sched_base_state, i)->nthds;
+
+		if (n < min) {
+			min  = n;
+			core = i;
+		}
+	}
+
+	return core;
+}
+
 cpuid_t sched_read_param_core_id(u32_t sched_params[MAX_NUM_SCHED_PARAM]) {
 	struct sched_param_s param;
 	int i;
@@ -1255,8 +1285,12 @@ cpuid_t sched_read_param_core_id(u32_t sched_params[MAX_NUM_SCHED_PARAM]) {
 		}
 	}
 
-	 /* -1 means not specified. Will create on the current core. */
+	 /* -1 means not specified. Will create on the current (or, with SCHED_BALANCE, least loaded) core. */
+#ifdef SCHED_BALANCE
+	if (core_id == -1) core_id = sched_least_loaded_core();
+#else
 	if (core_id == -1) core_id = cos_cpuid();
+#endif
 
 	assert(core_id >= 0 && core_id < NUM_CPU_COS);
 
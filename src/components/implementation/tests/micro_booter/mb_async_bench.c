@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include "micro_booter.h"
+
+/*
+ * Latency and throughput of asynchronous notifications (asnd to
+ * arcv): on the same core, with and without yield, and from this
+ * core to 1..N other cores, with and without a background load on
+ * them.  Latencies are reported as percentiles in cycles, as the
+ * average hides the tail.  Cross-core latencies are computed from
+ * the TSCs of different cores, so they assume an invariant TSC.
+ */
+
+#define AB_ITER       ITER
+#define AB_LOAD_PAGES 64 	/* background load: write a 256KB buffer */
+
+enum {
+	AB_CORE_WAIT = 0,	/* waiting for this core to tell us to allocate our receiver */
+	AB_CORE_SETUP,
+	AB_CORE_READY
+};
+
+/* Each other core has a receiver thread, that this core sends to */
+struct ab_core {
+	volatile int       state;
+	volatile int       load;
+	volatile arcvcap_t rcv;
+	asndcap_t          snd;
+	char              *load_buf;
+	/* when the last notification was sent, and when it was received */
+	volatile cycles_t  sent, rcvd;
+	volatile unsigned long nrcvd;
+	cycles_t           samples[AB_ITER];
+} CACHE_ALIGNED;
+
+static struct ab_core ab_cores[NUM_CPU_COS];
+
+/* the same-core test's end-points and samples */
+static volatile arcvcap_t ab_rcv;
+static volatile asndcap_t ab_snd;
+static volatile cycles_t  ab_sent;
+static volatile int       ab_nrcvd, ab_done;
+static cycles_t           ab_samples[AB_ITER], ab_rtt[AB_ITER];
+
+static int
+mb_cmp(const void *a, const void *b)
+{
+	cycles_t x = *(const cycles_t *)a, y = *(const cycles_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Print the distribution of n samples, sorting them */
+void
+mb_report(const char *name, cycles_t *s, int n)
+{
+	cycles_t tot = 0;
+	int i;
+
+	assert(n > 0);
+	qsort(s, n, sizeof(cycles_t), mb_cmp);
+	for (i = 0 ; i < n ; i++) tot += s[i];
+
+	PRINTC("%s (%d): avg %llu, min %llu, p50 %llu, p99 %llu, p99.9 %llu, max %llu\n", name, n,
+	       tot / n, s[0], s[n / 2], s[(n * 99) / 100], s[(n * 999) / 1000], s[n - 1]);
+}
+
+static void
+ab_local_rcv_fn(void *d)
+{
+	arcvcap_t rc = ab_rcv;
+	cycles_t  now;
+
+	while (1) {
+		cos_rcv(rc);
+		rdtscll(now);
+		if (ab_nrcvd < AB_ITER) ab_samples[ab_nrcvd] = now - ab_sent;
+		ab_nrcvd++;
+	}
+}
+
+static void
+ab_local_snd_fn(void *d)
+{
+	int       yield = (int)d;
+	asndcap_t sc    = ab_snd;
+	cycles_t  now;
+	int       i;
+
+	/* the first notification starts the receiver */
+	cos_asnd(sc, yield);
+	ab_nrcvd = 0;
+
+	for (i = 0 ; i < AB_ITER ; i++) {
+		rdtscll(ab_sent);
+		cos_asnd(sc, yield);
+		rdtscll(now);
+		ab_rtt[i] = now - ab_sent;
+	}
+
+	ab_done = 1;
+	while (1) cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_BASE);
+}
+
+/*
+ * The receiver has a higher priority than the sender, so without
+ * yield, it is switched to due to its priority.
+ */
+static void
+ab_local(int yield)
+{
+	thdcap_t  tcp,  tcc;
+	tcap_t    tccp, tccc;
+	arcvcap_t rcp,  rcc;
+
+	tcp = cos_thd_alloc(&booter_info, booter_info.comp_cap, ab_local_snd_fn, (void *)yield);
+	assert(tcp);
+	tccp = cos_tcap_alloc(&booter_info);
+	assert(tccp);
+	rcp = cos_arcv_alloc(&booter_info, tcp, tccp, booter_info.comp_cap, BOOT_CAPTBL_SELF_INITRCV_BASE);
+	assert(rcp);
+	if (cos_tcap_transfer(rcp, BOOT_CAPTBL_SELF_INITTCAP_BASE, TCAP_RES_INF, TCAP_PRIO_MAX + 1)) assert(0);
+
+	tcc = cos_thd_alloc(&booter_info, booter_info.comp_cap, ab_local_rcv_fn, NULL);
+	assert(tcc);
+	tccc = cos_tcap_alloc(&booter_info);
+	assert(tccc);
+	rcc = cos_arcv_alloc(&booter_info, tcc, tccc, booter_info.comp_cap, rcp);
+	assert(rcc);
+	if (cos_tcap_transfer(rcc, BOOT_CAPTBL_SELF_INITTCAP_BASE, TCAP_RES_INF, TCAP_PRIO_MAX)) assert(0);
+
+	ab_snd = cos_asnd_alloc(&booter_info, rcc, booter_info.captbl_cap);
+	assert(ab_snd);
+	ab_rcv = rcc;
+
+	ab_done = 0;
+	while (!ab_done) cos_thd_switch(tcp);
+
+	mb_report(yield ? "ASND->ARCV latency, same core, yield" : "ASND->ARCV latency, same core, no yield",
+		  ab_samples, ab_nrcvd < AB_ITER ? ab_nrcvd : AB_ITER);
+	mb_report(yield ? "ASND/ARCV round-trip, same core, yield" : "ASND/ARCV round-trip, same core, no yield",
+		  ab_rtt, AB_ITER);
+}
+
+static void
+ab_xcore_rcv_fn(void *d)
+{
+	struct ab_core *c  = d;
+	arcvcap_t       rc = c->rcv;
+	cycles_t        now;
+
+	while (1) {
+		cos_rcv(rc);
+		rdtscll(now);
+		c->rcvd = now;
+		c->nrcvd++;
+	}
+}
+
+/* Send to each of the first n other cores, in turn */
+static void
+ab_xcore_send(int n)
+{
+	int i;
+
+	for (i = 1 ; i <= n ; i++) {
+		struct ab_core *c = &ab_cores[i];
+
+		rdtscll(c->sent);
+		/* retry if the IPI ring is full */
+		while (cos_asnd(c->snd, 0)) ;
+	}
+}
+
+static void
+ab_xcore_wait(int n, unsigned long *nrcvd)
+{
+	int i;
+
+	for (i = 1 ; i <= n ; i++) {
+		while (ab_cores[i].nrcvd < nrcvd[i]) ;
+	}
+}
+
+static void
+ab_xcore(int n, int load)
+{
+	unsigned long nrcvd[NUM_CPU_COS];
+	cycles_t      start, end;
+	char          name[64];
+	int           i, j;
+
+	for (i = 1 ; i <= n ; i++) {
+		ab_cores[i].load = load;
+		nrcvd[i]         = ab_cores[i].nrcvd + 1;
+	}
+
+	/* latency: one notification to each core at a time */
+	for (j = 0 ; j < AB_ITER ; j++) {
+		ab_xcore_send(n);
+		ab_xcore_wait(n, nrcvd);
+		for (i = 1 ; i <= n ; i++) {
+			ab_cores[i].samples[j] = ab_cores[i].rcvd - ab_cores[i].sent;
+			nrcvd[i]++;
+		}
+	}
+	for (i = 1 ; i <= n ; i++) {
+		snprintf(name, sizeof(name), "ASND->ARCV latency, core 0 to %d of %d cores%s", i, n, load ? ", loaded" : "");
+		mb_report(name, ab_cores[i].samples, AB_ITER);
+	}
+
+	/* throughput: as many notifications as the IPI rings take */
+	for (i = 1 ; i <= n ; i++) nrcvd[i] = ab_cores[i].nrcvd + AB_ITER;
+	rdtscll(start);
+	for (j = 0 ; j < AB_ITER ; j++) ab_xcore_send(n);
+	ab_xcore_wait(n, nrcvd);
+	rdtscll(end);
+	PRINTC("ASND->ARCV throughput, core 0 to %d cores%s: %llu cycles per notification\n", n,
+	       load ? ", loaded" : "", (end - start) / (AB_ITER * n));
+
+	for (i = 1 ; i <= n ; i++) ab_cores[i].load = 0;
+}
+
+/* Executed by the other cores: allocate a receiver when told to, then run the background load */
+void
+test_async_bench_core(void)
+{
+	cpuid_t         core = cos_cpuid();
+	struct ab_core *c    = &ab_cores[core];
+	thdcap_t        t;
+	tcap_t          tc;
+	arcvcap_t       rc;
+	int             i;
+
+	assert(core > 0 && core < NUM_CPU_COS);
+	/* booter_info isn't multicore-safe, so we wait our turn to use it */
+	while (c->state != AB_CORE_SETUP) ;
+
+	t = cos_thd_alloc(&booter_info, booter_info.comp_cap, ab_xcore_rcv_fn, c);
+	assert(t);
+	tc = cos_tcap_alloc(&booter_info);
+	assert(tc);
+	rc = cos_arcv_alloc(&booter_info, t, tc, booter_info.comp_cap, BOOT_CAPTBL_SELF_INITRCV_BASE + core * CAP64B_IDSZ);
+	assert(rc);
+	if (cos_tcap_transfer(rc, BOOT_CAPTBL_SELF_INITTCAP_BASE + core * CAP16B_IDSZ, TCAP_RES_INF, TCAP_PRIO_MAX)) assert(0);
+	c->load_buf = cos_page_bump_alloc(&booter_info);
+	assert(c->load_buf);
+	for (i = 1 ; i < AB_LOAD_PAGES ; i++) {
+		if (cos_page_bump_alloc(&booter_info) != c->load_buf + i * PAGE_SIZE) assert(0);
+	}
+	c->rcv   = rc;
+	c->state = AB_CORE_READY;
+
+	/* we only execute when the receiver is blocked */
+	while (1) {
+		if (!c->load) continue;
+		for (i = 0 ; i < AB_LOAD_PAGES * PAGE_SIZE ; i += CACHE_LINE) c->load_buf[i]++;
+	}
+}
+
+void
+test_async_bench(void)
+{
+	unsigned long nrcvd[NUM_CPU_COS];
+	int i;
+
+	ab_local(1);
+	ab_local(0);
+
+	if (NUM_CPU_COS == 1) return;
+
+	/* allocate the receivers on the other cores, one at a time */
+	for (i = 1 ; i < NUM_CPU_COS ; i++) {
+		struct ab_core *c = &ab_cores[i];
+
+		c->state = AB_CORE_SETUP;
+		while (c->state != AB_CORE_READY) ;
+		c->snd = cos_asnd_alloc(&booter_info, c->rcv, booter_info.captbl_cap);
+		assert(c->snd);
+	}
+	/* the first notification starts the receivers */
+	for (i = 1 ; i < NUM_CPU_COS ; i++) nrcvd[i] = 1;
+	ab_xcore_send(NUM_CPU_COS - 1);
+	ab_xcore_wait(NUM_CPU_COS - 1, nrcvd);
+
+	for (i = 1 ; i < NUM_CPU_COS ; i++) {
+		ab_xcore(i, 0);
+		ab_xcore(i, 1);
+	}
+}
@@ -0,0 +1,89 @@
+#include "micro_booter.h"
+
+/*
+ * Synchronous invocation (sinv/sret) round-trip latency: back-to-back
+ * with the kernel's data-structures in the cache, after the caches
+ * have been polluted (as when a request arrives after other
+ * processing), and after a switch from another thread.  These depend
+ * on how many cache-lines of the thread structure the kernel touches
+ * on each invocation, so they are the numbers to compare across
+ * changes to its layout.  Latencies are reported as percentiles in
+ * cycles.
+ */
+
+#define IB_ITER        ITER
+#define IB_COLD_ITER   (ITER / 10)
+#define IB_EVICT_PAGES 128 	/* 512KB written between cold invocations */
+
+static cycles_t  ib_samples[IB_ITER];
+static char     *ib_evict_buf;
+static sinvcap_t ib_sinv;
+static volatile int ib_done;
+
+static inline cycles_t
+ib_roundtrip(sinvcap_t ic)
+{
+	cycles_t start, end;
+
+	rdtscll(start);
+	call_cap_mb(ic, 1, 2, 3);
+	rdtscll(end);
+
+	return end - start;
+}
+
+static void
+ib_evict(void)
+{
+	int i;
+
+	for (i = 0 ; i < IB_EVICT_PAGES * PAGE_SIZE ; i += CACHE_LINE) ib_evict_buf[i]++;
+}
+
+/* Alternates with the booter thread, invoking after each switch to it */
+static void
+ib_switch_fn(void *d)
+{
+	int i;
+
+	for (i = 0 ; i < IB_ITER ; i++) {
+		ib_samples[i] = ib_roundtrip(ib_sinv);
+		cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_BASE);
+	}
+	ib_done = 1;
+	while (1) cos_thd_switch(BOOT_CAPTBL_SELF_INITTHD_BASE);
+}
+
+void
+test_inv_bench(void)
+{
+	compcap_t cc;
+	thdcap_t  t;
+	int       i;
+
+	cc = cos_comp_alloc(&booter_info, booter_info.captbl_cap, booter_info.pgtbl_cap, (vaddr_t)NULL);
+	assert(cc > 0);
+	ib_sinv = cos_sinv_alloc(&booter_info, cc, (vaddr_t)__inv_test_serverfn);
+	assert(ib_sinv > 0);
+	if (call_cap_mb(ib_sinv, 1, 2, 3) != (int)0xDEADBEEF) assert(0);
+
+	for (i = 0 ; i < IB_ITER ; i++) ib_samples[i] = ib_roundtrip(ib_sinv);
+	mb_report("SINV/SRET round-trip, warm", ib_samples, IB_ITER);
+
+	ib_evict_buf = cos_page_bump_alloc(&booter_info);
+	assert(ib_evict_buf);
+	for (i = 1 ; i < IB_EVICT_PAGES ; i++) {
+		if (cos_page_bump_alloc(&booter_info) != ib_evict_buf + i * PAGE_SIZE) assert(0);
+	}
+	for (i = 0 ; i < IB_COLD_ITER ; i++) {
+		ib_evict();
+		ib_samples[i] = ib_roundtrip(ib_sinv);
+	}
+	mb_report("SINV/SRET round-trip, cold caches", ib_samples, IB_COLD_ITER);
+
+	t = cos_thd_alloc(&booter_info, booter_info.comp_cap, ib_switch_fn, NULL);
+	assert(t);
+	ib_done = 0;
+	while (!ib_done) cos_thd_switch(t);
+	mb_report("SINV/SRET round-trip, after a thread switch", ib_samples, IB_ITER);
+}
@@ -0,0 +1,121 @@
+#include "micro_booter.h"
+
+/*
+ * Latency of an asnd to a lower-priority receiver, that isn't
+ * switched to, as a function of the length of the delegation chains
+ * of the receiver's and the sender's tcaps, which the kernel compares
+ * to make that decision.  The two chains share all but their own
+ * tcaps, and the receiver's priority is only lower for the last of
+ * the shared schedulers, so the comparison has to walk the whole
+ * chain.  It is measured with the comparison's result cached by the
+ * previous asnd, and right after a transfer to the receiver that
+ * doesn't change its chain, but invalidates the cached result.
+ * Latencies are reported as percentiles in cycles.
+ *
+ * The depth is the number of tcaps in the chains, from 2 (delegated
+ * to by the booter's tcap) to the kernel's maximum.  Each added
+ * level of the chain needs another thread.
+ */
+
+#define TB_ITER      ITER
+#define TB_MAX_DEPTH 16 	/* TCAP_MAX_DELEGATIONS */
+#define TB_PRIO      (TCAP_PRIO_MAX + 2)
+#define TB_PRIO_RCV  (TB_PRIO + 1)
+
+struct tb_ep {
+	thdcap_t  tc;
+	tcap_t    tcc;
+	arcvcap_t rc;
+};
+
+static struct tb_ep  tb_rcv, tb_snd;
+static asndcap_t     tb_asnd;
+static tcap_t        tb_sched; 	/* the last of the schedulers shared by the chains */
+static volatile int  tb_done;
+static cycles_t      tb_cached[TB_ITER], tb_uncached[TB_ITER];
+
+static void
+tb_rcv_fn(void *d)
+{ while (1) cos_rcv(tb_rcv.rc); }
+
+/* The tcaps of the shared schedulers only need a thread to be delegated to, it never runs */
+static void
+tb_sched_fn(void *d)
+{ SPIN(); }
+
+static void
+tb_ep_alloc(struct tb_ep *e, cos_thd_fn_t fn)
+{
+	e->tcc = cos_tcap_alloc(&booter_info);
+	assert(e->tcc);
+	e->tc = cos_thd_alloc(&booter_info, booter_info.comp_cap, fn, NULL);
+	assert(e->tc);
+	e->rc = cos_arcv_alloc(&booter_info, e->tc, e->tcc, booter_info.comp_cap, BOOT_CAPTBL_SELF_INITRCV_BASE);
+	assert(e->rc);
+}
+
+static void
+tb_snd_fn(void *d)
+{
+	cycles_t s, e;
+	int      i;
+
+	while (1) {
+		/* warm the cache for the first sample */
+		if (cos_asnd(tb_asnd, 0)) assert(0);
+		for (i = 0 ; i < TB_ITER ; i++) {
+			rdtscll(s);
+			if (cos_asnd(tb_asnd, 0)) assert(0);
+			rdtscll(e);
+			tb_cached[i] = e - s;
+		}
+		for (i = 0 ; i < TB_ITER ; i++) {
+			if (cos_tcap_transfer(tb_rcv.rc, tb_sched, TCAP_RES_INF, TB_PRIO_RCV)) assert(0);
+			rdtscll(s);
+			if (cos_asnd(tb_asnd, 0)) assert(0);
+			rdtscll(e);
+			tb_uncached[i] = e - s;
+		}
+
+		tb_done = 1;
+		cos_switch(BOOT_CAPTBL_SELF_INITTHD_BASE, BOOT_CAPTBL_SELF_INITTCAP_BASE, 0, 0, 0, 0);
+	}
+}
+
+void
+test_tcap_bench(void)
+{
+	struct tb_ep sched;
+	char         name[64];
+	int          d;
+
+	tb_ep_alloc(&tb_rcv, tb_rcv_fn);
+	tb_ep_alloc(&tb_snd, tb_snd_fn);
+	tb_asnd = cos_asnd_alloc(&booter_info, tb_rcv.rc, booter_info.captbl_cap);
+	assert(tb_asnd);
+	tb_sched = BOOT_CAPTBL_SELF_INITTCAP_BASE;
+
+	for (d = 2 ; d <= TB_MAX_DEPTH ; d++) {
+		if (d > 2) {
+			/*
+			 * The sender now has the receiver's priority for
+			 * the previous last scheduler, so only the new
+			 * one orders them.
+			 */
+			if (cos_tcap_transfer(tb_snd.rc, tb_sched, TCAP_RES_INF, TB_PRIO_RCV)) assert(0);
+			tb_ep_alloc(&sched, tb_sched_fn);
+			if (cos_tcap_transfer(sched.rc, tb_sched, TCAP_RES_INF, TB_PRIO)) assert(0);
+			tb_sched = sched.tcc;
+		}
+		if (cos_tcap_transfer(tb_rcv.rc, tb_sched, TCAP_RES_INF, TB_PRIO_RCV)) assert(0);
+		if (cos_tcap_transfer(tb_snd.rc, tb_sched, TCAP_RES_INF, TB_PRIO)) assert(0);
+
+		tb_done = 0;
+		while (!tb_done) cos_switch(tb_snd.tc, tb_snd.tcc, TB_PRIO, TCAP_TIME_NIL, 0, 0);
+
+		snprintf(name, sizeof(name), "ASND to lower prio, delegation depth %d, cached", d);
+		mb_report(name, tb_cached, TB_ITER);
+		snprintf(name, sizeof(name), "ASND to lower prio, delegation depth %d, uncached", d);
+		mb_report(name, tb_uncached, TB_ITER);
+	}
+}
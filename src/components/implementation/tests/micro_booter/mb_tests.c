@@ -1,4 +1,5 @@
 #include "micro_booter.h"
+#include <cos_trace_decode.h>
 
 static void
 thd_fn_perf(void *d)
@@ -753,36 +754,6 @@ test_serverfn(int a, int b, int c)
 	return 0xDEADBEEF;
 }
 
-extern void *__inv_test_serverfn(int a, int b, int c);
-
-static inline
-int call_cap_mb(u32_t cap_no, int arg1, int arg2, int arg3)
-{
-	int ret;
-
-	/*
-	 * Which stack should we use for this invocation?  Simple, use
-	 * this stack, at the current sp.  This is essentially a
-	 * function call into another component, with odd calling
-	 * conventions.
-	 */
-	cap_no = (cap_no + 1) << COS_CAPABILITY_OFFSET;
-
-	__asm__ __volatile__( \
-		"pushl %%ebp\n\t" \
-		"movl %%esp, %%ebp\n\t" \
-		"movl %%esp, %%edx\n\t" \
-		"movl $1f, %%ecx\n\t" \
-		"sysenter\n\t" \
-		"1:\n\t" \
-		"popl %%ebp" \
-		: "=a" (ret)
-		: "a" (cap_no), "b" (arg1), "S" (arg2), "D" (arg3) \
-		: "memory", "cc", "ecx", "edx");
-
-	return ret;
-}
-
 static void
 test_inv(void)
 {
@@ -834,6 +805,51 @@ test_inv_perf(void)
 		total_ret_cycles, (long long) (ITER), (total_ret_cycles / (long long)(ITER)));
 }
 
+#ifdef COS_KERNEL_TRACE
+#define TEST_TRACE_NINV 64
+
+static struct cos_trace_decoder trace_decoder;
+#endif
+
+/* Map this core's kernel trace ring, and decode the records of a number of invocations */
+static void
+test_trace(void)
+{
+#ifdef COS_KERNEL_TRACE
+	struct cos_trace_ring *r;
+	compcap_t cc;
+	sinvcap_t ic;
+	int i, n, found = 0;
+
+	r = cos_trace_map(&booter_info, BOOT_CAPTBL_SELF_TRACE, cos_cpuid());
+	assert(r);
+	cos_trace_decoder_init(&trace_decoder, r);
+	/* the records from before the test */
+	cos_trace_decode(&trace_decoder);
+
+	cc = cos_comp_alloc(&booter_info, booter_info.captbl_cap, booter_info.pgtbl_cap, (vaddr_t)NULL);
+	assert(cc > 0);
+	ic = cos_sinv_alloc(&booter_info, cc, (vaddr_t)__inv_test_serverfn);
+	assert(ic > 0);
+	for (i = 0 ; i < TEST_TRACE_NINV ; i++) call_cap_mb(ic, 1, 2, 3);
+
+	/* a sinv and a sret for each, and the outermost invocations' caller is recorded as 0 */
+	n = cos_trace_decode(&trace_decoder);
+	assert(n >= 2 * TEST_TRACE_NINV);
+	for (i = 0 ; i < trace_decoder.nedges ; i++) {
+		struct cos_trace_edge *e = &trace_decoder.edges[i];
+
+		if (e->caller == 0 && e->lat.cnt >= TEST_TRACE_NINV) found = 1;
+	}
+	assert(found);
+
+	cos_trace_report(&trace_decoder);
+	PRINTC("Trace: %d records decoded, %lu lost. SUCCESS.\n", n, trace_decoder.lost);
+#else
+	PRINTC("Trace: COS_KERNEL_TRACE isn't enabled, skipped.\n");
+#endif
+}
+
 void
 test_captbl_expand(void)
 {
@@ -865,9 +881,13 @@ test_run_mb(void)
 
 	test_async_endpoints();
 	test_async_endpoints_perf();
+	test_async_bench();
+	test_tcap_bench();
 
 	test_inv();
 	test_inv_perf();
+	test_inv_bench();
+	test_trace();
 
 	test_captbl_expand();
 
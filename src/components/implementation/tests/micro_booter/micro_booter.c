@@ -45,6 +45,12 @@ cos_init(void)
 {
 	int cycs;
 
+	/* the other cores only take part in the cross-core benchmarks */
+	if (cos_cpuid() != 0) {
+		test_async_bench_core();
+		SPIN();
+	}
+
 	cos_meminfo_init(&booter_info.mi, BOOT_MEM_KM_BASE, COS_MEM_KERN_PA_SZ, BOOT_CAPTBL_SELF_UNTYPED_PT);
 	cos_compinfo_init(&booter_info, BOOT_CAPTBL_SELF_PT, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_COMP,
 			  (vaddr_t)cos_get_heap_ptr(), BOOT_CAPTBL_FREE, &booter_info);
@@ -0,0 +1,89 @@
+#include <cos_component.h>
+#include <print.h>
+#include <sched.h>
+#include <cos_thd_creation.h>
+#include <ck_pr.h>
+#include <cbuf.h>
+
+/*
+ * cbuf allocation and free throughput with a thread on each core
+ * allocating from the same component: alloc/free pairs, and batches
+ * of NBATCH allocations followed by their frees (which refill the
+ * per-core freelists).  Reported as the average cycles per
+ * alloc+free on each core.
+ */
+
+#define ITER   10000
+#define NBATCH 64
+#define SZ     1024
+
+static volatile int ncores_ready, ncores_done, start;
+static u64_t pair_avg[NUM_CPU_COS], batch_avg[NUM_CPU_COS];
+
+static void
+cbuf_mt_bench(void)
+{
+	void  *bufs[NBATCH];
+	cbuf_t cbs[NBATCH];
+	u64_t  s, e;
+	int    cpu = cos_cpuid(), i, j;
+
+	/* warm up this core's freelist */
+	for (j = 0 ; j < NBATCH ; j++) bufs[j] = cbuf_alloc(SZ, &cbs[j]);
+	for (j = 0 ; j < NBATCH ; j++) cbuf_free(bufs[j]);
+
+	ck_pr_inc_int((int *)&ncores_ready);
+	while (!ck_pr_load_int((int *)&start)) ;
+
+	rdtscll(s);
+	for (i = 0 ; i < ITER ; i++) {
+		bufs[0] = cbuf_alloc(SZ, &cbs[0]);
+		assert(bufs[0]);
+		cbuf_free(bufs[0]);
+	}
+	rdtscll(e);
+	pair_avg[cpu] = (e - s) / ITER;
+
+	rdtscll(s);
+	for (i = 0 ; i < ITER / NBATCH ; i++) {
+		for (j = 0 ; j < NBATCH ; j++) {
+			bufs[j] = cbuf_alloc(SZ, &cbs[j]);
+			assert(bufs[j]);
+		}
+		for (j = 0 ; j < NBATCH ; j++) cbuf_free(bufs[j]);
+	}
+	rdtscll(e);
+	batch_avg[cpu] = (e - s) / ((ITER / NBATCH) * NBATCH);
+
+	ck_pr_inc_int((int *)&ncores_done);
+}
+
+static void
+cbuf_mt_corex(void *d)
+{ cbuf_mt_bench(); }
+
+void
+cos_init(void)
+{
+	union sched_param sp, sp1;
+	int i;
+
+	printc("<<< MULTI-CORE CBUF ALLOC/FREE MICRO BENCHMARK >>>\n");
+	for (i = 1 ; i < NUM_CPU_COS ; i++) {
+		sp.c.type   = SCHEDP_PRIO;
+		sp.c.value  = 10;
+		sp1.c.type  = SCHEDP_CORE_ID;
+		sp1.c.value = i;
+		if (cos_thd_create(cbuf_mt_corex, NULL, sp.v, sp1.v, 0) <= 0) BUG();
+	}
+	while (ck_pr_load_int((int *)&ncores_ready) < NUM_CPU_COS - 1) ;
+	start = 1;
+	cbuf_mt_bench();
+	while (ck_pr_load_int((int *)&ncores_done) < NUM_CPU_COS) ;
+
+	for (i = 0 ; i < NUM_CPU_COS ; i++) {
+		printc("core %d: cbuf alloc+free %llu cycles, in batches of %d %llu cycles\n",
+		       i, pair_avg[i], NBATCH, batch_avg[i]);
+	}
+	printc("<<< MULTI-CORE CBUF ALLOC/FREE MICRO BENCHMARK DONE >>>\n");
+}
@@ -0,0 +1,59 @@
+#include <cos_component.h>
+#include <print.h>
+#include <cos_alloc.h>
+
+/*
+ * malloc/free latency across allocation sizes: the small sizes come
+ * from the allocator's freelists, and the others are mapped in by
+ * the memory manager (do_mmap) on each malloc, and released on each
+ * free.  Reported as the average cycles for the first NBATCH mallocs
+ * (with empty freelists), and for malloc/free pairs.  Each malloc's
+ * memory is touched, so the mapping is complete.
+ */
+
+#define ITER     1000
+#define NBATCH   16
+#define MIN_SZ   16
+#define MAX_SZ   (1024*1024)
+
+static void *bufs[NBATCH];
+
+static void
+malloc_bench(int sz)
+{
+	u64_t s, e, first, pair;
+	int   i, off;
+
+	rdtscll(s);
+	for (i = 0 ; i < NBATCH ; i++) {
+		bufs[i] = malloc(sz);
+		assert(bufs[i]);
+	}
+	rdtscll(e);
+	first = (e - s) / NBATCH;
+	for (i = 0 ; i < NBATCH ; i++) {
+		for (off = 0 ; off < sz ; off += PAGE_SIZE) ((char *)bufs[i])[off] = 1;
+		free(bufs[i]);
+	}
+
+	rdtscll(s);
+	for (i = 0 ; i < ITER ; i++) {
+		bufs[0] = malloc(sz);
+		assert(bufs[0]);
+		free(bufs[0]);
+	}
+	rdtscll(e);
+	pair = (e - s) / ITER;
+
+	printc("malloc %d bytes: first %llu cycles, malloc+free %llu cycles\n", sz, first, pair);
+}
+
+void
+cos_init(void)
+{
+	int sz;
+
+	printc("<<< MALLOC MICRO BENCHMARK >>>\n");
+	for (sz = MIN_SZ ; sz <= MAX_SZ ; sz *= 4) malloc_bench(sz);
+	printc("<<< MALLOC MICRO BENCHMARK DONE >>>\n");
+}
@@ -123,11 +123,9 @@ static void
 cbufp_tests(void)
 {
 	unsigned long long start, end;
-	struct cbuf_alloc_desc *d;
 	int i;
 
-	d = &cbufp_alloc_freelists[0];
-	assert(EMPTY_LIST(d, next, prev));
+	assert(!__cbufp_freelist_get(PAGE_SIZE, cos_cpuid())->c.head);
 	for (i = 0 ; i < CBUFP_NUM ; i++) {
 		buf[i] = cbufp_alloc(4096, &p[i]);
 		cbufp_send(p[i]);
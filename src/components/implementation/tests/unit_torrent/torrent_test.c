@@ -21,6 +21,64 @@
 
 char buffer[1024];
 
+/* Write two elements with twritev, and read them back with treadv */
+static void
+test_vec(long evt)
+{
+	td_t t;
+	char *params = "foo/vec";
+	char *data1 = "1234567890", *data2 = "asdf;lkj", *data3 = "1234567890asdf;lkj";
+	struct cbuf_vec_rcv rv;
+	struct cbuf_vec *v;
+	char *d;
+	cbuf_t vcb;
+	cbufp_t cb;
+	int ret, i, off = 0;
+
+	v = cbuf_alloc(cbuf_vec_sz(2), &vcb);
+	assert(v);
+	v->ncbufs = 0;
+	d = cbufp_alloc(strlen(data1), &cb);
+	assert(d);
+	memcpy(d, data1, strlen(data1));
+	cbuf_vec_add(v, 2, cb, 0, strlen(data1));
+	cbufp_deref(cb);
+	/* the second element is at an offset into its cbufp */
+	d = cbufp_alloc(strlen(data2) + 4, &cb);
+	assert(d);
+	memcpy(d + 4, data2, strlen(data2));
+	cbuf_vec_add(v, 2, cb, 4, strlen(data2));
+	cbufp_deref(cb);
+
+	t = tsplit(cos_spd_id(), td_root, params, strlen(params), TOR_ALL, evt);
+	assert(t > 0);
+	ret = twritev(cos_spd_id(), t, vcb, cbuf_vec_sz(2));
+	printv("writev %d, ret %d\n", strlen(data3), ret);
+	assert(ret == strlen(data3));
+	trelease(cos_spd_id(), t);
+
+	t = tsplit(cos_spd_id(), td_root, params, strlen(params), TOR_ALL, evt);
+	assert(t > 0);
+	ret = treadv(cos_spd_id(), t, vcb, cbuf_vec_sz(2));
+	assert(ret == strlen(data3));
+	off = cbuf_vec_map(v, cbuf_vec_sz(2), &rv);
+	assert(off == ret);
+	off = 0;
+	for (i = 0 ; i < rv.ncbufs ; i++) {
+		memcpy(buffer + off, rv.bufs[i], rv.elem[i].len);
+		off += rv.elem[i].len;
+	}
+	cbuf_vec_unmap(&rv);
+	buffer[off] = '\0';
+	printv("readv %d: %s (%s)\n", ret, buffer, data3);
+	assert(!strcmp(buffer, data3));
+	buffer[0] = '\0';
+	trelease(cos_spd_id(), t);
+	cbuf_free(v);
+
+	printc("UNIT TEST PASSED: split -> writev -> release -> split -> readv\n");
+}
+
 void cos_init(void)
 {
 	td_t t1, t2;
@@ -115,6 +173,8 @@ void cos_init(void)
 	buffer[0] = '\0';
 	printc("UNIT TEST PASSED: writing to an existing file\n");
 
+	test_vec(evt1);
+
 	printc("UNIT TEST ALL PASSED\n");
 
 	return;
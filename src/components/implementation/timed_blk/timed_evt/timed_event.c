@@ -16,6 +16,7 @@
 #include <cos_list.h>
 #include <cos_vect.h>
 #include <cos_alloc.h>
+#include <heap.h>
 
 #include <timed_blk.h>
 #include <periodic_wake.h>
@@ -38,10 +39,13 @@ unsigned long cyc_per_tick;
 #define TE_BLOCKED   0x2
 #define TE_PERIODIC  0x4
 
+/* both the timed and the periodic event of each thread can be pending */
+#define TE_MAX_EVTS  (2*MAX_NUM_THREADS)
+
 struct thread_event {
 	event_time_t event_expiration;
 	unsigned short int thread_id, flags;
-	struct thread_event *next, *prev;
+	int heap_idx; 		/* index in the timers heap, 0 if not pending */
 
 	/* if flags & TE_PERIODIC */
 	unsigned int period, missed;
@@ -51,7 +55,11 @@ struct thread_event {
 	long long completion;
 };
 
-static struct thread_event events, periodic;
+/* 
+ * All pending timed and periodic events, ordered by expiration.  The
+ * heap_idx of each event is its handle for O(log n) removal.
+ */
+static struct heap *timers;
 
 COS_VECT_CREATE_STATIC(thd_evts);
 COS_VECT_CREATE_STATIC(thd_periodic);
@@ -72,7 +80,6 @@ static struct thread_event *__te_get(unsigned short int tid, cos_vect_t *v)
 		if (NULL == te) return NULL;
 		memset(te, 0, sizeof(struct thread_event));
 		te->thread_id = tid;
-		INIT_LIST(te, next, prev);
 		if (tid != cos_vect_add_id(v, te, tid)) return NULL;
 	}
 	return te;
@@ -91,93 +98,70 @@ static struct thread_event *te_get(unsigned short int tid)
 //#define USEC_PER_SEC 1000000
 //static unsigned int usec_per_tick = 0;
 
-/* 
- * Return 1 if the inserted event is closer in the future than any
- * others, 0 otherwise.
- */
-static int __insert_event(struct thread_event *te, struct thread_event *events)
+/* is a's expiration before (or at) b's? */
+static int te_cmp(void *a, void *b)
 {
-	struct thread_event *tmp;
-
-	assert(NULL != te);
-	assert(te->event_expiration);
-	assert(EMPTY_LIST(te, next, prev));
-	assert(events->next && events->prev);
-	if (EMPTY_LIST(events, next, prev)) {
-		ADD_LIST(events, te, next, prev);
-	} else for (tmp = FIRST_LIST(events, next, prev) ;
-		    ; /* condition built into body (see break;) */
-		    tmp = FIRST_LIST(tmp, next, prev)) {
-		assert(tmp);
-		struct thread_event *prev_te = LAST_LIST(tmp, next, prev);
-		assert(prev_te);
-		assert(tmp->prev && tmp->next);
-		/* We found our place in the list OR end of list.
-		 * Either way, insert before this position */
-		if (tmp->event_expiration > te->event_expiration ||
-		    events == tmp) {
-			ADD_LIST(prev_te, te, next, prev);
-			assert(prev_te->next == te && te->prev == prev_te);
-			assert(te->next == tmp && tmp->prev == te);
-			break;
-		}
-		assert(tmp->next && tmp->prev);
-	}
-	
-	assert(!EMPTY_LIST(events, next, prev));
-	assert(!EMPTY_LIST(te, next, prev));
+	return ((struct thread_event *)a)->event_expiration <= 
+	       ((struct thread_event *)b)->event_expiration;
+}
 
-	return 0;
+static void te_update(void *e, int pos)
+{
+	((struct thread_event *)e)->heap_idx = pos;
 }
 
 static int insert_event(struct thread_event *te)
 {
-	return __insert_event(te, &events);
+	assert(NULL != te);
+	assert(te->event_expiration);
+	assert(!te->heap_idx);
+	if (heap_add(timers, te)) BUG();
+	assert(te->heap_idx);
+
+	return 0;
 }
 
-static int insert_pevent(struct thread_event *te)
+static void remove_event(struct thread_event *te)
 {
-	return __insert_event(te, &periodic);
+	assert(te->heap_idx);
+	heap_remove(timers, te->heap_idx);
+	assert(!te->heap_idx);
 }
 
 static struct thread_event *find_remove_event(unsigned short int thdid)
 {
-	struct thread_event *tmp;
+	struct thread_event *te;
 
-	for (tmp = FIRST_LIST(&events, next, prev);
-	     tmp != &events;
-	     tmp = FIRST_LIST(tmp, next, prev)) {
-		if (tmp->thread_id == thdid) {
-			REM_LIST(tmp, next, prev);
-			assert(events.next && events.prev);
-			return tmp;
-		}
-	}
-	return NULL;
+	te = cos_vect_lookup(&thd_evts, thdid);
+	if (NULL == te || !te->heap_idx) return NULL;
+	remove_event(te);
+
+	return te;
 }
 
-static void __event_expiration(event_time_t time, struct thread_event *events)
+/* 
+ * This should only be called from the event thread (which has the
+ * highest priority), so we don't need to be preempted before waking
+ * all threads.  All expired events are processed first, and the
+ * blocked threads are woken in a batch afterwards.
+ */
+static void event_expiration(event_time_t time)
 {
 	spdid_t spdid = cos_spd_id();
-
-	struct thread_event *tmp, *next_te;
+	unsigned short int wakeups[TE_MAX_EVTS];
+	int nwakeups = 0, i;
+	struct thread_event *tmp;
 
 	assert(TIMER_NO_EVENTS != time);
 
-	for (tmp = FIRST_LIST(events, next, prev) ;
-	     tmp != events && tmp->event_expiration <= time ; 
-	     tmp = next_te) {
+	while (NULL != (tmp = heap_peek(timers)) && tmp->event_expiration <= time) {
 		u8_t b;
-		unsigned short int tid;
 
-		assert(tmp);
-		next_te = FIRST_LIST(tmp, next, prev);
-		assert(next_te && next_te->prev == tmp && tmp->next == next_te);
+		heap_highest(timers);
+		assert(!tmp->heap_idx);
 		tmp->flags |= TE_TIMED_OUT;
-		REM_LIST(tmp, next, prev);
 		b = tmp->flags & TE_BLOCKED;
 		tmp->flags &= ~TE_BLOCKED;
-		tid = tmp->thread_id;
 
 		if (tmp->flags & TE_PERIODIC) {
 			/* thread hasn't blocked? deadline miss! */
@@ -214,41 +198,26 @@ static void __event_expiration(event_time_t time, struct thread_event *events)
 			tmp->dl++;
 			/* Next periodic deadline! */
 			tmp->event_expiration += tmp->period;
-			insert_pevent(tmp);
+			insert_event(tmp);
 		}
 
-		if (b) sched_wakeup(spdid, tmp->thread_id);
+		if (b) {
+			assert(nwakeups < TE_MAX_EVTS);
+			wakeups[nwakeups++] = tmp->thread_id;
+		}
 		/* We don't have to deallocate the thread_events as
 		 * they are stack allocated on the sleeping
 		 * threads. */
 	}
-}
 
-/* 
- * This should only be called from the event thread (which has the
- * highest priority), so we don't need to be preempted before waking
- * all threads.
- */
-static void event_expiration(event_time_t time)
-{
-	__event_expiration(time, &periodic);
-	__event_expiration(time, &events);
-
-	return;
+	for (i = 0 ; i < nwakeups ; i++) sched_wakeup(spdid, wakeups[i]);
 }
 
 static inline event_time_t next_event_time(void)
 {
-	event_time_t e = TIMER_NO_EVENTS, p = TIMER_NO_EVENTS;
-
-	e = EMPTY_LIST(&events, next, prev) ? 
-		TIMER_NO_EVENTS :
-		FIRST_LIST(&events, next, prev)->event_expiration;
-	p = EMPTY_LIST(&periodic, next, prev) ? 
-		TIMER_NO_EVENTS : 
-		FIRST_LIST(&periodic, next, prev)->event_expiration;
-	/* assume here that TIMER_NO_EVENTS > all other values */
-	return MIN(e, p);
+	struct thread_event *te = heap_peek(timers);
+
+	return te ? te->event_expiration : TIMER_NO_EVENTS;
 }
 
 /**
@@ -281,7 +250,7 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
 	TAKE(spdid);
 	te = te_get(cos_get_thd_id());
 	if (NULL == te) BUG();
-	assert(EMPTY_LIST(te, next, prev));
+	assert(!te->heap_idx);
 
 	te->thread_id = cos_get_thd_id();
 	te->flags &= ~TE_TIMED_OUT;
@@ -293,7 +262,6 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
    	assert(te->event_expiration > ticks);
 	t = next_event_time();
 	insert_event(te);
-	assert(te->next && te->prev && !EMPTY_LIST(te, next, prev));
 	RELEASE(spdid);
 
 	if (t != next_event_time()) sched_timeout(spdid, amnt);
@@ -301,8 +269,8 @@ int timed_event_block(spdid_t spdinv, unsigned int amnt)
 		prints("fprr: sched block failed in timed_event_block.");
 	}
 
-	/* we better have been taking off the list! */
-	assert(EMPTY_LIST(te, next, prev));
+	/* we better have been taking off the heap! */
+	assert(!te->heap_idx);
 	if (te->flags & TE_TIMED_OUT) return TIMER_EXPIRED;
 
 	/* 
@@ -495,11 +463,8 @@ int periodic_wake_create(spdid_t spdinv, unsigned int period)
 	TAKE(spdid);
 	te = te_pget(tid);
 	if (NULL == te) BUG();
-	if (te->flags & TE_PERIODIC) {
-		assert(!EMPTY_LIST(te, next, prev));
-		REM_LIST(te, next, prev);
-	}
-	assert(EMPTY_LIST(te, next, prev));
+	if (te->flags & TE_PERIODIC) remove_event(te);
+	assert(!te->heap_idx);
 	te->flags |= TE_PERIODIC;
 	te->period = period;
 	ticks = sched_timestamp();
@@ -508,7 +473,7 @@ int periodic_wake_create(spdid_t spdinv, unsigned int period)
 
 	t = next_event_time();
 	assert(t > ticks);
-	insert_pevent(te);
+	insert_event(te);
 	if (t > n) sched_timeout(spdid, n-ticks);
 	te->need_restart = 0;
 
@@ -527,8 +492,7 @@ int periodic_wake_remove(spdid_t spdinv, unsigned short int tid)
 	if (NULL == te) BUG();
 	if (!(te->flags & TE_PERIODIC)) goto err;
 		
-	assert(!EMPTY_LIST(te, next, prev));
-	REM_LIST(te, next, prev);
+	remove_event(te);
 	te->flags = 0;
 	
 	RELEASE(spdid);
@@ -551,7 +515,7 @@ int periodic_wake_wait(spdid_t spdinv)
 	if (NULL == te) BUG();
 	if (!(te->flags & TE_PERIODIC)) goto err;
 		
-	assert(!EMPTY_LIST(te, next, prev));
+	assert(te->heap_idx);
 
 	rdtscll(t);
 
@@ -608,7 +572,7 @@ static void start_timer_thread(void)
 	//	printc("cyc_per_tick = %lld\n", cyc_per_tick);
 
 	/* When the system boots, we have no pending waits */
-	assert(EMPTY_LIST(&events, next, prev));
+	assert(heap_empty(timers));
 	sched_block(spdid, 0);
 	/* Wait for events, then act on expired events.  Loop. */
 	while (1) {
@@ -653,10 +617,8 @@ void cos_init()
 
 	if (first) {
 		first = 0;
-		INIT_LIST(&events, next, prev);
-		events.thread_id = 0;
-		INIT_LIST(&periodic, next, prev);
-		periodic.thread_id = 0;
+		timers = heap_alloc(TE_MAX_EVTS, te_cmp, te_update);
+		if (NULL == timers) BUG();
 
 		cos_vect_init_static(&thd_evts);
 		cos_vect_init_static(&thd_periodic);
@@ -42,6 +42,7 @@ static cos_lock_t h_lock;
 extern td_t server_tsplit(spdid_t spdid, td_t tid, char *param, int len, tor_flags_t tflags, long evtid);
 extern void server_trelease(spdid_t spdid, td_t tid);
 extern int server_tread(spdid_t spdid, td_t td, int cbid, int sz);
+extern int server_treadv(spdid_t spdid, td_t td, int cbid, int sz);
 
 #endif	/* COS_LINUX_ENV */
 
@@ -222,6 +223,8 @@ unlock_connection(struct connection *c) { if (lock_release(&c->lock)) BUG(); }
 				   * data */
 #define HTTP_REQ_MALLOC       0x2 /* the buffer has been malloced */
 #define HTTP_REQ_PROCESSED    0x4 /* request not yet made */
+#define HTTP_REQ_NOVEC        0x8 /* the content torrent doesn't
+				   * implement treadv */
 
 enum {HTTP_TYPE_TOP, 
       HTTP_TYPE_GET};
@@ -551,7 +554,12 @@ static const char success_head[] =
 #define MAX_SUPPORTED_DIGITS 20
 
 /* Must prefix data by "content_length\r\n\r\n" */
-static int http_get_header(char *dest, int max_len, int content_len, int *resp_len)
+/* 
+ * Write the header for a response with content_len bytes of content
+ * into dest, checking that it fits in max_len bytes along with
+ * body_len bytes of the content.
+ */
+static int __http_get_header(char *dest, int max_len, int content_len, int body_len, int *resp_len)
 {
 	int resp_sz = content_len;
 	int head_sz = sizeof(success_head)-1;
@@ -565,7 +573,7 @@ static int http_get_header(char *dest, int max_len, int content_len, int *resp_l
 		return -1;
 	}
 
-	tot_sz = head_sz + len_sz + resp_sz;
+	tot_sz = head_sz + len_sz + body_len;
 	/* +1 for \0 so we can print the string */
 	if (tot_sz + 1 > max_len) {
 		*resp_len = 0;
@@ -581,6 +589,10 @@ static int http_get_header(char *dest, int max_len, int content_len, int *resp_l
 	return 0;
 }
 
+/* The header, followed by all of the content, has to fit into dest */
+static int http_get_header(char *dest, int max_len, int content_len, int *resp_len)
+{ return __http_get_header(dest, max_len, content_len, content_len, resp_len); }
+
 static int connection_get_reply(struct connection *c, char *resp, int resp_sz)
 {
 	struct http_request *r;
@@ -675,6 +687,158 @@ static int connection_get_reply(struct connection *c, char *resp, int resp_sz)
 	return used;
 }
 
+/* 
+ * Get the next part of the content for a request as the elements
+ * of cv (with room for max): references to the content component's
+ * cbufps if its torrent implements treadv, otherwise a copy.  Returns
+ * the length of the content, 0 if there is no more.
+ */
+static int http_get_content(struct http_request *r, struct cbuf_vec *cv, cbuf_t cvcb, int max)
+{
+	char *local_resp, *d;
+	cbufp_t cb;
+	cbuf_t lcb;
+	int ret;
+
+	cv->ncbufs = 0;
+	/* Previously saved response? */
+	if (NULL != r->resp.resp) {
+		d = cbufp_alloc(r->resp.resp_len, &cb);
+		if (!d) return -ENOMEM;
+		memcpy(d, r->resp.resp, r->resp.resp_len);
+		cbuf_vec_add(cv, max, cb, 0, r->resp.resp_len);
+		cbufp_deref(cb);
+
+		return r->resp.resp_len;
+	}
+	if (!(r->flags & HTTP_REQ_NOVEC)) {
+		ret = server_treadv(cos_spd_id(), r->content_id, cvcb, cbuf_vec_sz(max));
+		if (ret != -ENOTSUP) return ret;
+		r->flags |= HTTP_REQ_NOVEC;
+	}
+
+	local_resp = cbuf_alloc(PAGE_SIZE, &lcb);
+	if (!local_resp) BUG();
+	ret = server_tread(cos_spd_id(), r->content_id, lcb, PAGE_SIZE);
+	if (ret > 0) {
+		d = cbufp_alloc(ret, &cb);
+		if (!d) ERR_THROW(-ENOMEM, done);
+		memcpy(d, local_resp, ret);
+		cbuf_vec_add(cv, max, cb, 0, ret);
+		cbufp_deref(cb);
+	}
+done:
+	cbuf_free(local_resp);
+	return ret;
+}
+
+/* 
+ * Save the content in cv, of length len, in the request, to send it
+ * out later, as connection_get_reply does.  This receives the
+ * elements.  Returns 0 on success.
+ */
+static int http_save_content(struct http_request *r, struct cbuf_vec *cv, int len)
+{
+	struct cbuf_vec_rcv rv;
+	char *save;
+	int i, off = 0, ret = -1;
+
+	if (cbuf_vec_map(cv, cbuf_vec_sz(CBUF_VEC_MAX), &rv) != len || NULL != r->resp.resp) goto done;
+	save = malloc(len);
+	if (!save) goto done;
+	for (i = 0 ; i < rv.ncbufs ; i++) {
+		memcpy(save + off, rv.bufs[i], rv.elem[i].len);
+		off += rv.elem[i].len;
+	}
+	r->resp.resp     = save;
+	r->resp.resp_len = len;
+	ret              = 0;
+done:
+	cbuf_vec_unmap(&rv);
+	return ret;
+}
+
+/* 
+ * As connection_get_reply, but the reply is a vector (that can
+ * hold max elements) of a header, and the content, for each
+ * response, that aren't copied into one buffer.
+ */
+static int connection_get_replyv(struct connection *c, struct cbuf_vec *v, int max)
+{
+	struct http_request *r;
+	struct cbuf_vec *cv;
+	cbuf_t cvcb;
+	int used = 0;
+
+	v->ncbufs = 0;
+	r = c->pending_reqs;
+	if (NULL == r) return 0;
+	cv = cbuf_alloc(cbuf_vec_sz(CBUF_VEC_MAX), &cvcb);
+	if (!cv) BUG();
+	while (r) {
+		struct http_request *next;
+		char *head;
+		cbufp_t hcb;
+		int consumed, ret, i, n;
+
+		assert(r->c == c);
+		if (r->flags & HTTP_REQ_PENDING) break;
+		assert(r->flags & HTTP_REQ_PROCESSED);
+		assert(r->content_id >= 0);
+		/* room for the header, and at least some content? */
+		if (max - v->ncbufs < 2) break;
+
+		ret = http_get_content(r, cv, cvcb, max - v->ncbufs - 1);
+		if (ret < 0) {
+			printc("https get reply returning %d.\n", ret);
+			/* the previous responses' elements have been sent */
+			if (!used) used = ret;
+			break;
+		}
+		/* no more data */
+		if (ret == 0) break;
+		/* 
+		 * The content component wrote the vector: if it has
+		 * more elements than fit, copy them into one, that is
+		 * sent when we try again.
+		 */
+		n = *(volatile int *)&cv->ncbufs;
+		if (unlikely(n < 0 || n > max - v->ncbufs - 1)) {
+			if (!http_save_content(r, cv, ret)) continue;
+			printc("https get reply: content vector of %d elements.\n", n);
+			if (!used) used = -EINVAL;
+			break;
+		}
+
+		head = cbufp_alloc(PAGE_SIZE, &hcb);
+		if (!head) BUG();
+		/* only the header is written, so only it has to fit */
+		if (__http_get_header(head, PAGE_SIZE, ret, 0, &consumed)) {
+			cbufp_deref(hcb);
+			/* ...save the content to send it out later */
+			http_save_content(r, cv, ret);
+			if (!used) used = -ENOMEM;
+			break;
+		}
+		cbuf_vec_add(v, max, hcb, 0, consumed);
+		cbufp_deref(hcb);
+		/* the content component sent these: forward them */
+		for (i = 0 ; i < n ; i++) v->elem[v->ncbufs++] = cv->elem[i];
+
+		used += consumed + ret;
+		next = r->next;
+		/* bookkeeping */
+		http_req_cnt++;
+
+		http_free_request(r);
+		r = c->pending_reqs;
+		assert(r == next || NULL == r);
+	}
+	cbuf_free(cv);
+
+	return used;
+}
+
 
 // ~/research/others_software/httperf-0.9.0/src/httperf --port=200 --wsess=10000,20,0 
 // --burst-len=20 --rate=2000 --server=10.0.2.8 --max-piped-calls=32 --uri=/cgi/hw
@@ -827,6 +991,77 @@ unlock:
 	goto done;
 }
 
+int 
+twritev(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	struct connection *c = NULL;
+	struct torrent *t;
+	struct cbuf_vec *v;
+	struct cbuf_vec_rcv rv;
+	int ret, i;
+
+	if (tor_isnull(td)) return -EINVAL;
+	v = cbuf2buf(cbid, sz);
+	if (!v) return -EINVAL;
+	ret = cbuf_vec_map(v, sz, &rv);
+	if (ret < 0) goto done;
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, unlock);
+	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, unlock);
+
+	c = t->data;
+	assert(c);
+
+	lock_connection(c);
+	UNLOCK();
+	/* a request split across elements is saved as pending, and reassembled */
+	for (i = 0 ; i < rv.ncbufs ; i++) {
+		if (connection_parse_requests(c, rv.bufs[i], rv.elem[i].len)) ERR_THROW(-EINVAL, release);
+	}
+	unlock_connection(c);
+done:
+	cbuf_vec_unmap(&rv);
+	return ret;
+unlock:
+	UNLOCK();
+	goto done;
+release:
+	unlock_connection(c);
+	goto done;
+}
+
+int 
+treadv(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	struct connection *c;
+	struct torrent *t;
+	struct cbuf_vec *v;
+	int ret;
+	
+	if (tor_isnull(td)) return -EINVAL;
+	v = cbuf2buf(cbid, sz);
+	if (!v) ERR_THROW(-EINVAL, done);
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, unlock);
+	assert(!tor_is_usrdef(td) || t->data);
+	if (!(t->flags & TOR_READ)) ERR_THROW(-EACCES, unlock);
+	c = t->data;
+
+	lock_connection(c);
+	UNLOCK();
+	ret = connection_get_replyv(c, v, cbuf_vec_max(sz));
+	unlock_connection(c);
+done:	
+	return ret;
+unlock:
+	UNLOCK();
+	goto done;
+}
+
 /* long  */
 /* content_split(spdid_t spdid, long conn_id, long evt_id) */
 /* { */
@@ -15,6 +15,8 @@
 #include <evt.h>
 #include <cos_alloc.h>
 #include <cos_map.h>
+/* file data is kept in cbufps, so that treadv can pass it without copies */
+#define FS_DATA_FREE cbufp_free
 #include <fs.h>
 
 static cos_lock_t fs_lock;
@@ -22,7 +24,7 @@ struct fsobj root;
 #define LOCK() if (lock_take(&fs_lock)) BUG();
 #define UNLOCK() if (lock_release(&fs_lock)) BUG();
 
-#define MIN_DATA_SZ 256
+#define MIN_DATA_SZ PAGE_SIZE
 
 td_t 
 tsplit(spdid_t spdid, td_t td, char *param, 
@@ -134,29 +136,21 @@ done:
 	return ret;
 }
 
-int 
-twrite(spdid_t spdid, td_t td, int cbid, int sz)
+/* 
+ * Precondition: lock is taken.
+ *
+ * Write sz bytes of buf at the torrent's offset, growing the file's
+ * data if need be.  Returns the number of bytes written.
+ */
+static int
+ramfs_write(struct torrent *t, char *buf, int sz)
 {
-	int ret = -1, left;
-	struct torrent *t;
-	struct fsobj *fso;
-	char *buf;
-
-	if (tor_isnull(td)) return -EINVAL;
-
-	LOCK();
-	t = tor_lookup(td);
-	if (!t) ERR_THROW(-EINVAL, done);
-	assert(t->data);
-	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, done);
+	struct fsobj *fso = t->data;
+	int ret, left;
 
-	fso = t->data;
 	assert(fso->size <= fso->allocated);
 	assert(t->offset <= fso->size);
 
-	buf = cbuf2buf(cbid, sz);
-	if (!buf) ERR_THROW(-EINVAL, done);
-
 	left = fso->allocated - t->offset;
 	if (left >= sz) {
 		ret = sz;
@@ -164,13 +158,15 @@ twrite(spdid_t spdid, td_t td, int cbid, int sz)
 	} else {
 		char *new;
 		int new_sz;
+		cbufp_t cb;
 
 		new_sz = fso->allocated == 0 ? MIN_DATA_SZ : fso->allocated * 2;
-		new    = malloc(new_sz);
-		if (!new) ERR_THROW(-ENOMEM, done);
+		new    = cbufp_alloc(new_sz, &cb);
+		if (!new) return -ENOMEM;
+		/* readers that were sent the old data still reference it */
 		if (fso->data) {
 			memcpy(new, fso->data, fso->size);
-			free(fso->data);
+			cbufp_free(fso->data);
 		}
 
 		fso->data      = new;
@@ -181,6 +177,105 @@ twrite(spdid_t spdid, td_t td, int cbid, int sz)
 	}
 	memcpy(fso->data + t->offset, buf, ret);
 	t->offset += ret;
+
+	return ret;
+}
+
+int 
+twrite(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	int ret = -1;
+	struct torrent *t;
+	char *buf;
+
+	if (tor_isnull(td)) return -EINVAL;
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, done);
+	assert(t->data);
+	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, done);
+
+	buf = cbuf2buf(cbid, sz);
+	if (!buf) ERR_THROW(-EINVAL, done);
+
+	ret = ramfs_write(t, buf, sz);
+done:	
+	UNLOCK();
+	return ret;
+}
+
+int 
+twritev(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	int ret = -1, tot = 0, i;
+	struct torrent *t;
+	struct cbuf_vec *v;
+	struct cbuf_vec_rcv rv;
+
+	if (tor_isnull(td)) return -EINVAL;
+	v = cbuf2buf(cbid, sz);
+	if (!v) return -EINVAL;
+	if ((ret = cbuf_vec_map(v, sz, &rv)) < 0) goto unmap;
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, done);
+	assert(t->data);
+	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, done);
+
+	for (i = 0 ; i < rv.ncbufs ; i++) {
+		ret = ramfs_write(t, rv.bufs[i], rv.elem[i].len);
+		if (ret < 0) break;
+		tot += ret;
+		if (ret < (int)rv.elem[i].len) break;
+	}
+	if (tot) ret = tot;
+done:	
+	UNLOCK();
+unmap:
+	cbuf_vec_unmap(&rv);
+	return ret;
+}
+
+/* 
+ * The rest of the file is passed as a reference to the cbufp that
+ * holds its data, rather than copied.  Writes that don't grow the
+ * file are visible through it, as with a shared mapping.
+ */
+int 
+treadv(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	int ret = -1, left;
+	struct torrent *t;
+	struct fsobj *fso;
+	struct cbuf_vec *v;
+	cbufp_t cb;
+
+	if (tor_isnull(td)) return -EINVAL;
+
+	LOCK();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, done);
+	assert(!tor_is_usrdef(td) || t->data);
+	if (!(t->flags & TOR_READ)) ERR_THROW(-EACCES, done);
+
+	fso = t->data;
+	assert(fso->size <= fso->allocated);
+	assert(t->offset <= fso->size);
+
+	v = cbuf2buf(cbid, sz);
+	if (!v) ERR_THROW(-EINVAL, done);
+	v->ncbufs = 0;
+	left      = fso->size - t->offset;
+	if (!left) ERR_THROW(0, done);
+
+	assert(fso->data);
+	cb = cbuf_id(fso->data);
+	assert(cb);
+	if (cbuf_vec_add(v, cbuf_vec_max(sz), cb, t->offset, left)) ERR_THROW(-EINVAL, done);
+	ret        = left;
+	t->offset += ret;
 done:	
 	UNLOCK();
 	return ret;
@@ -1076,15 +1076,23 @@ int net_recv(spdid_t spdid, net_connection_t nc, void *data, int sz)
 	return xfer_amnt;
 }
 
-int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
+/* A part of the data to send: it is gathered from several buffers */
+struct net_iov {
+	void *data;
+	int sz;
+};
+
+static int __net_sendv(spdid_t spdid, net_connection_t nc, struct net_iov *iov, int niov)
 {
 	struct intern_connection *ic;
 	u16_t tid = cos_get_thd_id();
-	int ret = sz;
+	int ret, sz = 0, i;
 
 //	if (!cos_argreg_buff_intern(data, sz)) return -EFAULT;
 	if (!net_conn_valid(nc)) return -EINVAL;
+	for (i = 0 ; i < niov ; i++) sz += iov[i].sz;
 	if (sz > MAX_SEND) return -EMSGSIZE;
+	ret = sz;
 
 //	NET_LOCK_TAKE();
 	ic = net_conn_get_internal(nc);
@@ -1101,16 +1109,23 @@ int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
 	case UDP:
 	{
 		struct udp_pcb *up;
-		struct pbuf *p;
+		struct pbuf *p = NULL, *q;
 
 		/* There's no blocking in the UDP case, so this is simple */
 		up = ic->conn.up;
-		p = pbuf_alloc(PBUF_TRANSPORT, sz, PBUF_ROM);
-		if (NULL == p) {
-			ret = -ENOMEM;
-			goto err;
+		/* ...a chain of pbufs referencing each buffer */
+		for (i = 0 ; i < niov ; i++) {
+			q = pbuf_alloc(i ? PBUF_RAW : PBUF_TRANSPORT, iov[i].sz, PBUF_ROM);
+			if (NULL == q) {
+				if (p) pbuf_free(p);
+				ret = -ENOMEM;
+				goto err;
+			}
+			q->payload = iov[i].data;
+			if (p) pbuf_cat(p, q);
+			else   p = q;
 		}
-		p->payload = data;
+		if (NULL == p) break;
 
 		if (ERR_OK != udp_send(up, p)) {
 			pbuf_free(p);
@@ -1126,7 +1141,7 @@ int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
 		struct tcp_pcb *tp;
 #define TCP_SEND_COPY
 #ifdef TCP_SEND_COPY
-		void *d;
+		char *d;
 		struct packet_queue *pq;
 #endif
 		tp = ic->conn.tp;
@@ -1144,11 +1159,19 @@ int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
 		pq->ts_start = timing_record(APP_PROC, ic->ts_start);
 #endif
 		pq->headers = NULL;
+		/* the only copy: lwip holds on to the data until it is acked */
+		d = net_packet_data(pq);
+		for (i = 0 ; i < niov ; i++) {
+			memcpy(d, iov[i].data, iov[i].sz);
+			d += iov[i].sz;
+		}
 		d = net_packet_data(pq);
-		memcpy(d, data, sz);
 		if (ERR_OK != (ret = tcp_write(tp, d, sz, 0))) {
 #else
-		if (ERR_OK != (ret = tcp_write(tp, data, sz, TCP_WRITE_FLAG_COPY))) {
+		for (i = 0 ; i < niov ; i++) {
+			if (ERR_OK != (ret = tcp_write(tp, iov[i].data, iov[i].sz, TCP_WRITE_FLAG_COPY))) break;
+		}
+		if (ERR_OK != ret) {
 #endif
 			free(pq);
 			printc("tcp_write returned %d (sz %d, tcp_sndbuf %d, ERR_MEM: %d)", 
@@ -1176,6 +1199,13 @@ err:
 	return ret;
 }
 
+int net_send(spdid_t spdid, net_connection_t nc, void *data, int sz)
+{
+	struct net_iov iov = { .data = data, .sz = sz };
+
+	return __net_sendv(spdid, nc, &iov, 1);
+}
+
 /************************ LWIP integration: **************************/
 
 struct ip_addr ip, mask, gw;
@@ -1546,6 +1576,94 @@ done:
 	return ret;
 }
 
+int
+twritev(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	net_connection_t nc;
+	struct torrent *t;
+	struct cbuf_vec *v;
+	struct net_iov iov[CBUF_VEC_MAX];
+	struct cbuf_vec_rcv rv;
+	int ret, i, n, off, len, amnt, tot = 0;
+
+	v = cbuf2buf(cbid, sz);
+	if (!v)             return -EINVAL;
+	/* the elements are consumed even if the write fails */
+	ret = cbuf_vec_map(v, sz, &rv);
+	if (ret < 0)        goto unmap;
+	if (tor_isnull(td)) ERR_THROW(-EINVAL, unmap);
+
+	NET_LOCK_TAKE();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, done);
+	if (!(t->flags & TOR_WRITE)) ERR_THROW(-EACCES, done);
+
+	assert(t->data);
+	nc = (net_connection_t)t->data;
+	/* send the elements in packets of at most MAX_SEND */
+	for (i = 0, off = 0 ; i < rv.ncbufs ; ) {
+		for (n = 0, len = 0 ; i < rv.ncbufs && len < MAX_SEND ; n++) {
+			amnt = rv.elem[i].len - off;
+			if (amnt > MAX_SEND - len) amnt = MAX_SEND - len;
+			iov[n].data = rv.bufs[i] + off;
+			iov[n].sz   = amnt;
+			len        += amnt;
+			off        += amnt;
+			if (off == (int)rv.elem[i].len) {
+				i++;
+				off = 0;
+			}
+		}
+		ret = __net_sendv(spdid, nc, iov, n);
+		if (ret < 0) break;
+		tot += ret;
+		if (ret < len) break;
+	}
+	if (tot) ret = tot;
+done:
+	NET_LOCK_RELEASE();
+	assert(lock_contested(&net_lock) != cos_get_thd_id());
+unmap:
+	cbuf_vec_unmap(&rv);
+	return ret;
+}
+
+/* Received data is read into a cbufp that is passed in the vector */
+int
+treadv(spdid_t spdid, td_t td, int cbid, int sz)
+{
+	net_connection_t nc;
+	struct torrent *t;
+	struct cbuf_vec *v;
+	cbufp_t cb;
+	char *buf;
+	int ret;
+	
+	v = cbuf2buf(cbid, sz);
+	if (!v)             return -EINVAL;
+	if (tor_isnull(td)) return -EINVAL;
+	v->ncbufs = 0;
+	if (cbuf_vec_max(sz) < 1) return -EINVAL;
+	buf = cbufp_alloc(MTU, &cb);
+	if (!buf)           return -ENOMEM;
+
+	NET_LOCK_TAKE();
+	t = tor_lookup(td);
+	if (!t) ERR_THROW(-EINVAL, done);
+	if (!(t->flags & TOR_READ)) ERR_THROW(-EACCES, done);
+
+	assert(t->data);
+	nc = (net_connection_t)t->data;
+	
+	ret = net_recv(spdid, nc, buf, MTU);
+	if (ret > 0) cbuf_vec_add(v, 1, cb, 0, ret);
+done:
+	NET_LOCK_RELEASE();
+	assert(lock_contested(&net_lock) != cos_get_thd_id());
+	cbufp_free(buf);
+	return ret;
+}
+
 /*** Initialization routines: ***/
 
 static err_t cos_if_init(struct netif *ni)
@@ -27,6 +27,56 @@ twritep(spdid_t spdid, td_t td, int cbid, int sz)
 {
         return -ENOTSUP;
 }
+/* the caller can fall back to tread, as nothing has been consumed */
+__attribute__((weak)) int
+treadv(spdid_t spdid, td_t td, int cbid, int sz)
+{
+        return -ENOTSUP;
+}
+/* 
+ * The vector's elements must be consumed, so gather them into pages
+ * of tmem cbufs for our twrite.
+ */
+__attribute__((weak)) int
+twritev(spdid_t spdid, td_t td, int cbid, int sz)
+{
+        struct cbuf_vec *v;
+        struct cbuf_vec_rcv rv;
+        char *d;
+        cbuf_t cb;
+        int i, off, amnt, len, tot = 0, ret;
+
+        v = cbuf2buf(cbid, sz);
+        if (!v) return -EINVAL;
+        ret = cbuf_vec_map(v, sz, &rv);
+        if (ret < 0) goto done;
+        d = cbuf_alloc(PAGE_SIZE, &cb);
+        if (!d) ERR_THROW(-ENOMEM, done);
+
+        for (i = 0, off = 0, len = 0 ; i < rv.ncbufs ; ) {
+                amnt = rv.elem[i].len - off;
+                if (amnt > PAGE_SIZE - len) amnt = PAGE_SIZE - len;
+                memcpy(d + len, rv.bufs[i] + off, amnt);
+                len += amnt;
+                off += amnt;
+                if (off == (int)rv.elem[i].len) {
+                        i++;
+                        off = 0;
+                }
+                if (len < PAGE_SIZE && i < rv.ncbufs) continue;
+
+                ret = twrite(spdid, td, cb, len);
+                if (ret < 0) break;
+                tot += ret;
+                if (ret < len) break;
+                len = 0;
+        }
+        if (tot) ret = tot;
+        cbuf_free(d);
+done:
+        cbuf_vec_unmap(&rv);
+        return ret;
+}
 
 COS_MAP_CREATE_STATIC(torrents);
 struct torrent null_torrent, root_torrent;
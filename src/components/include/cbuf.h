@@ -209,16 +209,45 @@ typedef union {
 	} __attribute__((packed)) c;
 } cbuf_unpacked_t;
 
-/* TODO: use these! */
-struct cbuf_agg_elem {
-	cbuf_t id;
+/* 
+ * A scatter-gather vector: a message made of (parts of) several
+ * persistent cbufs, in order, so that, for example, a header and a
+ * body can be passed without copying them into one buffer.  The
+ * vector itself is in a tmem cbuf.  Each element has been
+ * cbufp_send'd by the component that put it in the vector, so the
+ * component that consumes the vector must receive (cbuf_vec_map)
+ * and dereference (cbuf_vec_unmap) each of them, even if it fails.
+ * The sender can still write the vector, so the receiver only uses
+ * the copy of it that cbuf_vec_map makes (struct cbuf_vec_rcv).
+ */
+#define CBUF_VEC_MAX 16
+struct cbuf_vec_elem {
+	cbufp_t id;
 	u32_t offset, len;
 };
-/* An aggregate of multiple cbufs. */
-struct cbuf_agg {
+struct cbuf_vec {
 	int ncbufs;
-	struct cbuf_agg_elem elem[0];
+	struct cbuf_vec_elem elem[0];
 };
+/* A received vector: our copy of its elements, and their data */
+struct cbuf_vec_rcv {
+	int ncbufs;
+	struct cbuf_vec_elem elem[CBUF_VEC_MAX];
+	char *bufs[CBUF_VEC_MAX];
+};
+
+static inline int
+cbuf_vec_sz(int ncbufs) 
+{ return sizeof(struct cbuf_vec) + ncbufs * sizeof(struct cbuf_vec_elem); }
+
+/* How many elements fit in a vector of sz bytes? */
+static inline int
+cbuf_vec_max(int sz)
+{
+	int n = (sz - (int)sizeof(struct cbuf_vec)) / (int)sizeof(struct cbuf_vec_elem);
+
+	return n > CBUF_VEC_MAX ? CBUF_VEC_MAX : n;
+}
 
 static inline void 
 cbuf_unpack(cbuf_t cb, u32_t *cbid) 
@@ -285,7 +314,7 @@ again:
 
 	if (!tmem) {
 		if (unlikely(cm->nfo.c.flags & CBUFM_TMEM)) goto done;
-		if (unlikely((len >> PAGE_ORDER) > cm->sz)) goto done;
+		if (unlikely((u32_t)len > cbufm_size(cm))) goto done;
 		assert(cm->nfo.c.refcnt != CBUFP_REFCNT_MAX);
 		cm->nfo.c.refcnt++;
 		assert(cm->owner_nfo.c.nrecvd < TMEM_SENDRECV_MAX);
@@ -300,7 +329,7 @@ again:
 	/* if (unlikely(!cos_cas((unsigned long *)&cm->nfo.v,  */
 	/* 		      (unsigned long)   ci.v,  */
 	/* 		      (unsigned long)   ci_new.v))) goto again; */
-	ret = ((void*)(cm->nfo.c.ptr << PAGE_ORDER));
+	ret = cbufm_addr(cm);
 done:	
 	CBUF_RELEASE();
 	assert(lock_contested(&cbuf_lock) != cos_get_thd_id());
@@ -356,17 +385,158 @@ cbufp_send(cbufp_t cb)
 { __cbufp_send(cb, 0); }
 
 extern cvect_t alloc_descs; 
+
+/*
+ * Who owns an allocation descriptor.  Only the thread that moves it
+ * out of FREE or BUSY (with a cas) owns it.  The allocation slow
+ * path (holding the cbuf lock) replaces descriptors for addresses
+ * that the manager reuses: it frees USED descriptors itself, and
+ * marks the others DEAD, so that their owner frees them (see
+ * __cbuf_desc_retire).
+ */
+typedef enum {
+	CBUF_DESC_USED = 0, 	/* allocated, not on a freelist */
+	CBUF_DESC_FREE, 	/* on a per-core freelist */
+	CBUF_DESC_BUSY, 	/* being allocated or freed without the lock */
+	CBUF_DESC_DEAD, 	/* replaced: freed by the thread that owns it */
+} cbuf_desc_state_t;
+
 struct cbuf_alloc_desc {
 	int cbid, length, tmem;
 	void *addr;
 	struct cbuf_meta *meta;
-	struct cbuf_alloc_desc *next, *prev, *flhead; /* freelist */
+	struct cbuf_alloc_desc *next; /* freelist */
+	unsigned long state;          /* cbuf_desc_state_t */
+};
+
+/*
+ * Per-core freelists of allocation descriptors, one for tmem cbufs,
+ * and one for each size of cbufp.  They are lock-free stacks, so
+ * allocations and frees on different cores don't serialize on the
+ * cbuf lock, which is only taken to get more cbufs from the manager
+ * (__cbuf_alloc_slow) and to free descriptors.  Threads on the same
+ * core can preempt each other in a pop, so the head is paired with a
+ * generation that each pop increments, and both are updated with a
+ * double-word cas: a preempted pop can't mistake a head that was
+ * popped and pushed again for the one it read (ABA).  Popped
+ * descriptors can be stale (see below) and are validated as before.
+ */
+union cbuf_freelist {
+	struct {
+		struct cbuf_alloc_desc *head;
+		u32_t gen;
+	} __attribute__((packed)) c;
+	u64_t v;
+} __attribute__((aligned(8)));
+
+struct cbuf_freelists {
+	union cbuf_freelist tmem;
+	union cbuf_freelist cbufp[CBUFP_NCLASSES];
+} CACHE_ALIGNED;
+extern struct cbuf_freelists cbuf_freelists[NUM_CPU];
+
+extern void __cbuf_desc_retire(struct cbuf_alloc_desc *d);
+extern int  __cbufp_refill(int size);
+
+/* 
+ * cbufps are created and collected in batches of (up to) this many,
+ * and no more than CBUFP_BATCH_SZ bytes of them.
+ */
+#define CBUFP_BATCH    64
+#define CBUFP_BATCH_SZ (CBUFP_BATCH * PAGE_SIZE)
+
+static inline int
+__cbufp_batch(int size)
+{
+	int n = CBUFP_BATCH_SZ / size;
+
+	if (n > CBUFP_BATCH) return CBUFP_BATCH;
+	return n ? n : 1;
+}
+
+static inline int
+__cbuf_fl_cas(union cbuf_freelist *fl, union cbuf_freelist old, union cbuf_freelist new)
+{
+	char z;
+
+	__asm__ __volatile__("lock cmpxchg8b %1; setz %0"
+			     : "=q" (z), "+m" (fl->v), "+A" (old.v)
+			     : "b" ((u32_t)new.v), "c" ((u32_t)(new.v >> 32))
+			     : "memory", "cc");
+	return z;
+}
+
+static inline void
+__cbuf_fl_push(union cbuf_freelist *fl, struct cbuf_alloc_desc *d)
+{
+	union cbuf_freelist old, new;
+
+	do {
+		old.c.gen  = fl->c.gen;
+		old.c.head = fl->c.head;
+		d->next    = old.c.head;
+		new.c.head = d;
+		new.c.gen  = old.c.gen;
+	} while (unlikely(!__cbuf_fl_cas(fl, old, new)));
+}
+
+/*
+ * The head might be popped, and even freed, after we read it, but
+ * descriptors are slab-allocated, and their memory remains mapped,
+ * so the read of its next is safe, and the cas then fails.
+ */
+static inline struct cbuf_alloc_desc *
+__cbuf_fl_pop(union cbuf_freelist *fl)
+{
+	union cbuf_freelist old, new;
+
+	do {
+		old.c.gen  = fl->c.gen;
+		old.c.head = fl->c.head;
+		if (!old.c.head) return NULL;
+		new.c.head = old.c.head->next;
+		new.c.gen  = old.c.gen + 1;
+	} while (unlikely(!__cbuf_fl_cas(fl, old, new)));
+
+	return old.c.head;
+}
+
+/* 
+ * The descriptors are indexed by page.  Cbufps smaller than a page
+ * share theirs, so its entry is instead (tagged with
+ * CBUF_DESC_SUBPAGE) a table of the descriptors for the page indexed
+ * by their offset.  It is freed when its last descriptor is.
+ */
+#define CBUF_DESC_SUBPAGE 1UL
+#define CBUF_DESC_NSLOTS  (PAGE_SIZE >> CBUFP_MIN_ORDER)
+
+struct cbuf_alloc_subpage {
+	struct cbuf_alloc_desc *descs[CBUF_DESC_NSLOTS];
 };
-extern struct cbuf_alloc_desc cbuf_alloc_freelists;
-extern struct cbuf_alloc_desc cbufp_alloc_freelists[];
 
+static inline int
+__cbuf_desc_slot(void *addr) { return ((u32_t)addr & (PAGE_SIZE-1)) >> CBUFP_MIN_ORDER; }
+
+/* The descriptor of the cbuf that includes addr (in its first page) */
 static inline struct cbuf_alloc_desc *
-__cbuf_alloc_lookup(int page_index) { return cvect_lookup(&alloc_descs, page_index); }
+__cbuf_alloc_lookup(void *addr)
+{
+	unsigned long e = (unsigned long)cvect_lookup(&alloc_descs, (u32_t)addr >> PAGE_ORDER);
+	struct cbuf_alloc_subpage *sp;
+	struct cbuf_alloc_desc *d;
+	int i;
+
+	if (likely(!(e & CBUF_DESC_SUBPAGE))) return (struct cbuf_alloc_desc *)e;
+	sp = (struct cbuf_alloc_subpage *)(e & ~CBUF_DESC_SUBPAGE);
+	for (i = __cbuf_desc_slot(addr) ; i >= 0 ; i--) {
+		d = sp->descs[i];
+		if (!d) continue;
+		if ((char *)addr < (char *)d->addr + d->length) return d;
+		break;
+	}
+
+	return NULL;
+}
 
 /* 
  * Assume that m was retrieved with 
@@ -379,61 +549,124 @@ __cbuf_alloc_meta_inconsistent(struct cbuf_alloc_desc *d, struct cbuf_meta *m)
 	assert(d && m && d->addr);
 	/* we don't want the manager changing this under us */
 	assert(m->nfo.c.refcnt);
-	return (unlikely((unsigned long)d->addr >> PAGE_SHIFT != m->nfo.c.ptr ||
+	return (unlikely(d->addr != cbufm_addr(m) ||
 			 d->meta != m /*|| length*/));
 }
 
 /* 
- * Simple power-of-two allocator.  Later we can investigate going to
- * something with more precision, or a slab.  We are currently leaving
- * CBUFP_MAX_NSZ - (WORD_SIZE - PAGE_ORDER) = 64 - (32-12) = 44 unused
- * sizes that could be expanded for both of these uses.
+ * Simple power-of-two allocator with a freelist for each size class
+ * (see cbufp_size_class).  Later we can investigate going to
+ * something with more precision, or a slab.
  *
  * TODO: it appears that the compiler is not able to statically
  * calculate this...  This is a big problem for allocations of a fixed
  * size where this should translate into a direct freelist access with
  * no calculations.  Verify this and fix.
  *
- * precondition:  size must be a power of 2 && >= PAGE_SIZE
+ * precondition:  size must be a size class
+ */
+static inline int
+__cbufp_class(int size) { return ones(size-1) - CBUFP_MIN_ORDER; }
+
+static inline union cbuf_freelist *
+__cbufp_freelist_get(int size, int cpu)
+{
+	int class = __cbufp_class(size);
+
+	assert(pow2(size) && size >= CBUFP_MIN_SZ);
+	assert(class >= 0 && class < CBUFP_NCLASSES);
+
+	return &cbuf_freelists[cpu].cbufp[class];
+}
+
+static inline union cbuf_freelist *
+__cbuf_freelist_get(int size, int tmem, int cpu)
+{
+	if (tmem) return &cbuf_freelists[cpu].tmem;
+	else      return __cbufp_freelist_get(size, cpu);
+}
+
+/*
+ * Take the first reference to the cbuf of a descriptor popped from a
+ * freelist (setting the USED bit), unless the manager removed it or
+ * it is already used.  The manager updates the meta asynchronously,
+ * so this is a cas.  Returns 0 on success.
+ */
+static inline int
+__cbufm_get_free(struct cbuf_meta *cm, int tmem)
+{
+	union cbufm_info old, new;
+
+	do {
+		old.v = new.v = cm->nfo.v;
+		if (unlikely(!old.c.ptr || old.c.refcnt)) return -1;
+		new.c.refcnt = 1;
+		new.c.flags |= CBUFM_TOUCHED;
+		if (tmem) new.c.flags |= CBUFM_TMEM;
+	} while (unlikely(!cos_cas((unsigned long *)&cm->nfo.v, old.v, new.v)));
+
+	return 0;
+}
+
+static inline void
+__cbufm_put(struct cbuf_meta *cm, int clear_flags)
+{
+	union cbufm_info old, new;
+
+	do {
+		old.v = new.v = cm->nfo.v;
+		assert(old.c.refcnt);
+		new.c.refcnt--;
+		new.c.flags &= ~clear_flags;
+	} while (unlikely(!cos_cas((unsigned long *)&cm->nfo.v, old.v, new.v)));
+}
+
+/*
+ * Pop a descriptor from this core's freelist, or failing that,
+ * another core's, and take ownership of it.
  */
 static inline struct cbuf_alloc_desc *
-__cbufp_freelist_get(int size)
+__cbuf_alloc_pop(unsigned int sz, int tmem)
 {
-	int order = ones(size-1) - PAGE_ORDER;
 	struct cbuf_alloc_desc *d;
+	int cpu = cos_cpuid(), i;
+
+	for (i = 0 ; i < NUM_CPU ; i++) {
+		union cbuf_freelist *fl = __cbuf_freelist_get(sz, tmem, (cpu + i) % NUM_CPU);
 
-	assert(pow2(size) && size >= PAGE_SIZE);
-	assert(order >= 0 && order < WORD_SIZE-PAGE_ORDER);
-	d = &cbufp_alloc_freelists[order];
-	assert(d->length == size);
+		while ((d = __cbuf_fl_pop(fl))) {
+			if (likely(cos_cas(&d->state, CBUF_DESC_FREE, CBUF_DESC_BUSY))) return d;
+			/* replaced while on the freelist */
+			__cbuf_desc_retire(d);
+		}
+	}
 
-	return d;
+	return NULL;
 }
 
 static inline void *
 __cbuf_alloc(unsigned int sz, cbuf_t *cb, int tmem)
 {
 	void *ret;
-	struct cbuf_alloc_desc *d, *fl;
-	int cbid, len, already_used, mapped_in, flags;
+	struct cbuf_alloc_desc *d;
+	int cbid, len = 0;
 	struct cbuf_meta *cm;
 	long cbidx;
 
-	if (tmem) {
-		fl = &cbuf_alloc_freelists;
-	} else {
-		/* need a size >= PAGE_ORDER, that is a power of 2 */
-		sz = nlepow2(round_up_to_page(sz));
-		fl = __cbufp_freelist_get(sz);
+	if (!tmem) {
+		sz = cbufp_size_class(sz);
+		if (unlikely(!sz)) return NULL;
 	}
-	CBUF_TAKE();
 again:
-	d = FIRST_LIST(fl, next, prev);
-	if (unlikely(EMPTY_LIST(d, next, prev))) {
+	d = __cbuf_alloc_pop(sz, tmem);
+	if (unlikely(!d)) {
+		if (!tmem && __cbufp_refill(sz) > 0) goto again;
+		CBUF_TAKE();
 		d    = __cbuf_alloc_slow(sz, &len, tmem);
 		assert(d);
 		ret  = d->addr;
 		cbid = d->cbid;
+		CBUF_RELEASE();
 		goto done;
 		/*
 		 * TODO: check if this cbuf has been taken by another
@@ -441,87 +674,79 @@ again:
 		 * freelist and just continue?
 		 */
 	} 
-	REM_LIST(d, next, prev);
-	assert(EMPTY_LIST(d, next, prev));
 	cbid  = d->cbid;
 	assert(cbid);
 	cbidx            = cbid_to_meta_idx(cbid);
 	cm               = cbuf_vect_lookup_addr(cbidx, tmem);
 
-	mapped_in        = cbufm_is_mapped(cm);
-	already_used     = cm->nfo.c.refcnt;
-	flags            = CBUFM_TOUCHED;
-	if (tmem) flags |= CBUFM_TMEM;
-	cm->nfo.c.flags |= flags;
-	assert(cm->nfo.c.refcnt != CBUFP_REFCNT_MAX);
-	cm->nfo.c.refcnt++;
-
 	/* 
-	 * Now that IN_USE is set, we know the manager will not rip
-	 * this out from under us.  Check that nothing has changed,
-	 * and the pointer is consistent with the allocation
-	 * descriptor 
+	 * Once USED is set, we know the manager will not rip this
+	 * out from under us.  Check that nothing has changed, and the
+	 * pointer is consistent with the allocation descriptor.
 	 */
-	assert(!already_used);
-	if (unlikely(__cbuf_alloc_meta_inconsistent(d, cm) || already_used || !mapped_in)) {
-		/* 
-		 * This is complicated.
-		 *
-		 * See cbuf_slab_free for the rest of the story.  
-		 *
-		 * Assumptions: 
-		 * 
-		 * 1) The cbuf manager shared the cbuf meta (in the
-		 * meta_cbuf vector) information with this component.
-		 * It can remove asynchronously a cbuf from this
-		 * structure at any time IFF that cbuf is marked as
-		 * ~CBUF_IN_USE.
-		 *
-		 * 2) The slab descriptors, and the slab_desc vector
-		 * are _not_ shared with the cbuf manager for
-		 * complexity reasons.
-		 *
-		 * Question: How do we reconcile the fact that the
-		 * cbuf mgr might remove at any point a cbuf from this
-		 * component, but we still have a slab descriptor
-		 * lying around for it?  How will we know that the
-		 * cbuf has been removed, and not to use the slab
-		 * data-structure anymore?
-		 *
-		 * Answer: The slabs are deallocated lazily (seen
-		 * here).  When a slab is pulled off of the freelist
-		 * (see the following code), we check to make sure
-		 * that the cbuf meta information matches up with the
-		 * slab's information (i.e. the cbuf id and the
-		 * address in memory of the cbuf.  If they do not,
-		 * then we know that the slab is outdated and that the
-		 * cbuf backing it has been taken from this component.
-		 * In that case (shown in the following code), we
-		 * delete the slab descriptor.  Again, see
-		 * cbuf_slab_free to see the surprising fact that we
-		 * do _not_ deallocate the slab descriptor there to
-		 * reinforce that point.
-		 */
-		__cbuf_desc_free(d);
-		if (likely(!already_used)) {
-			cm->nfo.c.flags &= ~CBUFM_TOUCHED;
-			cm->nfo.c.refcnt--;
-		}
+	if (unlikely(__cbufm_get_free(cm, tmem))) goto stale;
+	if (unlikely(__cbuf_alloc_meta_inconsistent(d, cm))) {
+		__cbufm_put(cm, CBUFM_TOUCHED);
+		goto stale;
+	}
+	/* it was replaced while we validated it */
+	if (unlikely(!cos_cas(&d->state, CBUF_DESC_BUSY, CBUF_DESC_USED))) {
+		__cbufm_put(cm, CBUFM_TOUCHED);
+		__cbuf_desc_retire(d);
 		goto again;
 	}
 
 	if (tmem) {
 		cm->owner_nfo.thdid = cos_get_thd_id();
-		cos_comp_info.cos_tmem_available[COMP_INFO_TMEM_CBUF]--;
+		cos_faa((int *)&cos_comp_info.cos_tmem_available[COMP_INFO_TMEM_CBUF], -1);
 		assert(cm->nfo.c.flags & CBUFM_TMEM);
 	} else {
 		cm->owner_nfo.c.nsent = cm->owner_nfo.c.nrecvd = 0;		
 	}
-	ret = (void*)(cm->nfo.c.ptr << PAGE_ORDER);
+	ret = cbufm_addr(cm);
 done:
 	*cb = cbuf_cons(cbid, len);
-	CBUF_RELEASE();
 	return ret;
+stale:
+	/* 
+	 * This is complicated.
+	 *
+	 * See cbuf_slab_free for the rest of the story.  
+	 *
+	 * Assumptions: 
+	 * 
+	 * 1) The cbuf manager shared the cbuf meta (in the
+	 * meta_cbuf vector) information with this component.
+	 * It can remove asynchronously a cbuf from this
+	 * structure at any time IFF that cbuf is marked as
+	 * ~CBUF_IN_USE.
+	 *
+	 * 2) The slab descriptors, and the slab_desc vector
+	 * are _not_ shared with the cbuf manager for
+	 * complexity reasons.
+	 *
+	 * Question: How do we reconcile the fact that the
+	 * cbuf mgr might remove at any point a cbuf from this
+	 * component, but we still have a slab descriptor
+	 * lying around for it?  How will we know that the
+	 * cbuf has been removed, and not to use the slab
+	 * data-structure anymore?
+	 *
+	 * Answer: The slabs are deallocated lazily (seen
+	 * here).  When a slab is pulled off of the freelist
+	 * (see the previous code), we check to make sure
+	 * that the cbuf meta information matches up with the
+	 * slab's information (i.e. the cbuf id and the
+	 * address in memory of the cbuf.  If they do not,
+	 * then we know that the slab is outdated and that the
+	 * cbuf backing it has been taken from this component.
+	 * In that case (shown here), we delete the slab
+	 * descriptor.  Again, see cbuf_slab_free to see the
+	 * surprising fact that we do _not_ deallocate the slab
+	 * descriptor there to reinforce that point.
+	 */
+	__cbuf_desc_retire(d);
+	goto again;
 }
 
 static inline void *
@@ -534,49 +759,26 @@ cbufp_alloc(unsigned int sz, cbufp_t *cb)  { return __cbuf_alloc(sz, (cbuf_t*)cb
  * postcondition: cbuf lock has been released.
  */
 static inline void
-__cbuf_done(int cbid, int tmem, struct cbuf_alloc_desc *d)
+__cbufp_done(int cbid)
 {
 	struct cbuf_meta *cm;
-	int owner, relinq = 0;
+	int relinq;
 
-	cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), tmem);
-	assert(!d || !__cbuf_alloc_meta_inconsistent(d, cm));
+	cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), 0);
 	/* 
 	 * If this assertion triggers, one possibility is that you did
 	 * not successfully map it in (cbufp2buf or cbufp_alloc).
 	 */
 	assert(cm->nfo.c.refcnt);
-	owner = cm->nfo.c.flags & CBUFM_OWNER;
-	assert(!(tmem & !owner)); /* Shouldn't be calling free... */
-
-	if (tmem && d && owner) {
-		struct cbuf_alloc_desc *fl;
-
-		fl = d->flhead;
-		assert(fl);
-		ADD_LIST(fl, d, next, prev);
-		cm->owner_nfo.thdid = 0;
-	}
-	/* do this last, so that we can guarantee the manager will not steal the cbuf before now... */
-	cm->nfo.c.refcnt--;
-	if (tmem) cos_comp_info.cos_tmem_available[COMP_INFO_TMEM_CBUF]++;
-	else      relinq = cm->nfo.c.flags & CBUFM_RELINQ;
+	__cbufm_put(cm, 0);
+	relinq = cm->nfo.c.flags & CBUFM_RELINQ;
 	CBUF_RELEASE();
 	
 	/* Does the manager want the memory back? */
-	if (tmem) {
-		if (unlikely(cos_comp_info.cos_tmem_relinquish[COMP_INFO_TMEM_CBUF])) {
-			cbuf_c_delete(cos_spd_id(), cbid);
-			assert(lock_contested(&cbuf_lock) != cos_get_thd_id());
-			return;
-		}
-	} else if (unlikely(relinq)) {
+	if (unlikely(relinq)) {
 		cbufp_delete(cos_spd_id(), cbid);
 		assert(lock_contested(&cbuf_lock) != cos_get_thd_id());
-		return;
 	}
-	
-	return;
 }
 
 static inline void
@@ -586,32 +788,132 @@ cbufp_deref(cbufp_t cbid)
 	
 	cbuf_unpack(cbid, &id);
 	CBUF_TAKE();
-	__cbuf_done((int)id, 0, NULL);
+	__cbufp_done((int)id);
+}
+
+/* 
+ * Receive the elements of a vector in a buffer of sz bytes into r: a
+ * copy of the elements, that the sender can't change, and r->bufs[i]
+ * set to the data of element i, or NULL if it can't be mapped.
+ * Returns the total length of the elements, or -EINVAL if the vector
+ * is malformed (r is then empty) or an element can't be mapped.
+ * Either way, cbuf_vec_unmap must be called when done with the data,
+ * and only r is used.
+ */
+static inline int
+cbuf_vec_map(struct cbuf_vec *v, int sz, struct cbuf_vec_rcv *r)
+{
+	struct cbuf_vec_elem *e;
+	int i, n, tot = 0, ret = 0;
+
+	r->ncbufs = 0;
+	n = *(volatile int *)&v->ncbufs;
+	if (unlikely(n < 0 || n > cbuf_vec_max(sz))) return -EINVAL;
+	r->ncbufs = n;
+	for (i = 0 ; i < n ; i++) {
+		e          = &r->elem[i];
+		*e         = ((volatile struct cbuf_vec_elem *)v->elem)[i];
+		r->bufs[i] = NULL;
+		if (unlikely(!e->len || e->offset + e->len < e->offset)) {
+			ret = -EINVAL;
+			continue;
+		}
+		r->bufs[i] = cbufp2buf(e->id, e->offset + e->len);
+		if (unlikely(!r->bufs[i])) {
+			ret = -EINVAL;
+			continue;
+		}
+		r->bufs[i] += e->offset;
+		tot        += e->len;
+	}
+
+	return ret ? ret : tot;
 }
 
+static inline void
+cbuf_vec_unmap(struct cbuf_vec_rcv *r)
+{
+	int i;
+
+	for (i = 0 ; i < r->ncbufs ; i++) {
+		if (r->bufs[i]) cbufp_deref(r->elem[i].id);
+	}
+}
+
+/* 
+ * Add len bytes at offset in the cbufp cb to a vector that can hold
+ * max elements, and send it.  Returns -1 if the vector is full.
+ */
+static inline int
+cbuf_vec_add(struct cbuf_vec *v, int max, cbufp_t cb, u32_t offset, u32_t len)
+{
+	struct cbuf_vec_elem *e;
+
+	if (v->ncbufs >= max) return -1;
+	e         = &v->elem[v->ncbufs++];
+	e->id     = cb;
+	e->offset = offset;
+	e->len    = len;
+	cbufp_send(cb);
+
+	return 0;
+}
+
+/*
+ * Free a tmem cbuf we own, without the cbuf lock: push its
+ * descriptor on this core's freelist.
+ */
+static inline void
+__cbuf_done(struct cbuf_alloc_desc *d)
+{
+	struct cbuf_meta *cm;
+	int cbid = d->cbid;
+
+	cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), 1);
+	assert(!__cbuf_alloc_meta_inconsistent(d, cm));
+	assert(cm->nfo.c.flags & CBUFM_OWNER); /* Shouldn't be calling free... */
+	if (unlikely(!cos_cas(&d->state, CBUF_DESC_USED, CBUF_DESC_BUSY))) BUG();
+
+	cm->owner_nfo.thdid = 0;
+	/* do this last, so that we can guarantee the manager will not steal the cbuf before now... */
+	__cbufm_put(cm, 0);
+	cos_faa((int *)&cos_comp_info.cos_tmem_available[COMP_INFO_TMEM_CBUF], 1);
+	/* the manager reused its memory as soon as we released it */
+	if (unlikely(!cos_cas(&d->state, CBUF_DESC_BUSY, CBUF_DESC_FREE))) __cbuf_desc_retire(d);
+	else __cbuf_fl_push(__cbuf_freelist_get(d->length, 1, cos_cpuid()), d);
+
+	/* Does the manager want the memory back? */
+	if (unlikely(cos_comp_info.cos_tmem_relinquish[COMP_INFO_TMEM_CBUF])) {
+		cbuf_c_delete(cos_spd_id(), cbid);
+		assert(lock_contested(&cbuf_lock) != cos_get_thd_id());
+	}
+}
+
+/* 
+ * The descriptor lookup is lock-free: the vector is only modified
+ * with the cbuf lock, and the entry for a cbuf we own doesn't change.
+ */
 static inline void
 __cbuf_free(void *buf, int tmem)
 {
-	u32_t idx = ((u32_t)buf) >> PAGE_ORDER;
 	struct cbuf_alloc_desc *d;
-	int cbid;
 
-	CBUF_TAKE();
-	d  = __cbuf_alloc_lookup(idx);
+	d  = __cbuf_alloc_lookup(buf);
 	assert(d);
-	if (unlikely(d->tmem != tmem)) goto err;
-	cbid = d->cbid;
+	if (unlikely(d->tmem != tmem)) return;
+	if (tmem) {
+		__cbuf_done(d);
+		return;
+	}
+	CBUF_TAKE();
 	/* note: lock released in function */
-	__cbuf_done(cbid, tmem, d);
-
-	return;
-err:
-	CBUF_RELEASE();
-	return;
+	__cbufp_done(d->cbid);
 }
 
 static inline void
 cbuf_free(void *buf) { __cbuf_free(buf, 1); }
+static inline void
+cbufp_free(void *buf) { __cbuf_free(buf, 0); }
 
 /* 
  * Is it a cbuf?  If so, what's its id? 
@@ -622,12 +924,11 @@ cbuf_free(void *buf) { __cbuf_free(buf, 1); }
 static inline int 
 cbuf_id(void *buf)
 {
-	u32_t idx = ((u32_t)buf) >> PAGE_ORDER;
 	struct cbuf_alloc_desc *d;
 	int id;
 
 	CBUF_TAKE();
-	d  = __cbuf_alloc_lookup(idx);
+	d  = __cbuf_alloc_lookup(buf);
 	id = (likely(d)) ? d->cbid : 0;
 	CBUF_RELEASE();
 	assert(lock_contested(&cbuf_lock) != cos_get_thd_id());
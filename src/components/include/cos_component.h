@@ -417,9 +417,14 @@ static inline void *cos_get_prealloc_page(void)
 	return h;
 }
 
-/* allocate and release a page in the vas */
+/* 
+ * allocate and release a page (or contiguous pages) in the vas.  The
+ * vas is only released if it is at the end of the heap.
+ */
 extern void *cos_get_vas_page(void);
 extern void cos_release_vas_page(void *p);
+extern void *cos_get_vas_pages(int npages);
+extern void cos_release_vas_pages(void *p, int npages);
 
 /* only if the heap pointer is pre_addr, set it to post_addr */
 static inline void
@@ -9,6 +9,7 @@
 
 #include <cos_component.h>
 #include <cos_debug.h>
+#include <cos_trace.h>
 /* Types mainly used for documentation */
 typedef capid_t sinvcap_t;
 typedef capid_t sretcap_t;
@@ -20,6 +21,7 @@ typedef capid_t compcap_t;
 typedef capid_t captblcap_t;
 typedef capid_t pgtblcap_t;
 typedef capid_t hwcap_t;
+typedef capid_t tracecap_t;
 
 /* Memory source information */
 struct cos_meminfo {
@@ -69,8 +71,20 @@ thdcap_t  cos_initthd_alloc(struct cos_compinfo *ci, compcap_t comp);
 sinvcap_t cos_sinv_alloc(struct cos_compinfo *srcci, compcap_t dstcomp, vaddr_t entry);
 arcvcap_t cos_arcv_alloc(struct cos_compinfo *ci, thdcap_t thdcap, tcap_t tcapcap, compcap_t compcap, arcvcap_t enotif);
 asndcap_t cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap);
+/*
+ * An asnd to another core that sends at most budget notifications
+ * (IPIs) every period_usec; sends beyond that fail with -EAGAIN.
+ */
+asndcap_t cos_asnd_alloc_ratelimit(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap, u16_t budget, u16_t period_usec);
 
 void *cos_page_bump_alloc(struct cos_compinfo *ci);
+/* allocate sz bytes of contiguous pages, mapping them in with a single vector of operations */
+void *cos_page_bump_allocn(struct cos_compinfo *ci, size_t sz);
+/*
+ * allocate a super-page (PGD_RANGE bytes, aligned) mapped with a
+ * single pgd entry, or return NULL if the untyped memory is exhausted
+ */
+void *cos_page_bump_alloc_super(struct cos_compinfo *ci);
 
 capid_t cos_cap_cpy(struct cos_compinfo *dstci, struct cos_compinfo *srcci, cap_t srcctype, capid_t srccap);
 int cos_cap_cpy_at(struct cos_compinfo *dstci, capid_t dstcap, struct cos_compinfo *srcci, capid_t srccap);
@@ -81,19 +95,86 @@ int cos_thd_wakeup(thdcap_t thd, tcap_t tc, tcap_prio_t prio, tcap_res_t res);
 sched_tok_t cos_sched_sync(void);
 int cos_switch(thdcap_t c, tcap_t t, tcap_prio_t p, tcap_time_t r, arcvcap_t rcv, sched_tok_t stok);
 int cos_thd_mod(struct cos_compinfo *ci, thdcap_t c, void *tls_addr); /* set tls addr of thd in captbl */
+/*
+ * Migrate a thread that isn't executing, and isn't a scheduler, to
+ * another core: cos_thd_migrate_out on the thread's core detaches it,
+ * then cos_thd_migrate_in on the destination core attaches it, and
+ * fails with -EQUIESCENCE until the kernel's quiescence period has
+ * passed since the detach.  A thread bound to a rcv end-point migrates
+ * with its tcap (but not the tcap's budget), and rcv is the end-point
+ * on the destination core to send its notifications to.
+ */
+int cos_thd_migrate_out(struct cos_compinfo *ci, thdcap_t c, cpuid_t core);
+int cos_thd_migrate_in(struct cos_compinfo *ci, thdcap_t c, arcvcap_t rcv);
 
 int cos_asnd(asndcap_t snd, int yield);
 /* returns non-zero if there are still pending events (i.e. there have been pending snds) */
 int cos_rcv(arcvcap_t rcv);
 /* returns the same value as cos_rcv, but also information about scheduling events */
 int cos_sched_rcv(arcvcap_t rcv, thdid_t *thdid, int *blocked, cycles_t *cycles);
+/*
+ * Receive up to max scheduling events into evts in a single call
+ * (blocking as cos_rcv if there are none).  The array must not span a
+ * page boundary (so max <= COS_SCHED_EVT_BATCH_MAX).  Returns the
+ * number of events received, or a negative error, and sets pending
+ * to non-zero if there are still events to receive.
+ */
+int cos_sched_rcv_batch(arcvcap_t rcv, struct cos_sched_evt *evts, int max, int *pending);
+/* decode an event received with cos_sched_rcv_batch */
+static inline void
+cos_sched_evt_get(struct cos_sched_evt *e, thdid_t *thdid, int *blocked, cycles_t *cycles)
+{
+	*blocked = (int)(e->thd_state >> (sizeof(e->thd_state)*8-1));
+	*thdid   = (thdid_t)(e->thd_state & ((1 << (sizeof(thdid_t)*8))-1));
+	*cycles  = e->cycles;
+}
+/*
+ * Register a page-aligned ring (a page, allocated by the caller) into
+ * which the kernel writes the scheduling events for rcv as they are
+ * generated.  Events are consumed with cos_sched_ring_dequeue, and a
+ * rcv only returns events that didn't fit in the ring, and doesn't
+ * block while it is not empty.  A NULL ring removes the registration.
+ */
+int cos_sched_ring_set(arcvcap_t rcv, struct cos_sched_ring *ring);
+/* dequeue an event from the ring; returns 0 if it is empty */
+static inline int
+cos_sched_ring_dequeue(struct cos_sched_ring *r, struct cos_sched_evt *e)
+{
+	unsigned int head = r->c_head;
+	unsigned int tail = *(volatile unsigned int *)&r->p_tail;
+
+	if (head == tail) return 0;
+	/* the kernel's stores are ordered, so we need only prevent the compiler from reordering */
+	__asm__ __volatile__("" ::: "memory");
+	*e = r->ring[head & (COS_SCHED_RING_SZ - 1)];
+	__asm__ __volatile__("" ::: "memory");
+	*(volatile unsigned int *)&r->c_head = head + 1;
+
+	return 1;
+}
 
 int cos_introspect(struct cos_compinfo *ci, capid_t cap, unsigned long op);
+/*
+ * Read the invocation counts of n of our sinv caps into cnts (a
+ * negative error for each that can't be read), and if reset, reset
+ * them.  Requires COS_SINV_COUNTERS in the kernel.  Returns the
+ * number of counts read.
+ */
+int cos_sinv_invocations(struct cos_compinfo *ci, sinvcap_t *sinvs, long *cnts, int n, int reset);
+/*
+ * Execute a vector of captbl/pgtbl operations (that doesn't span a
+ * page) with a single system call on one of our captbls.  Each
+ * operation's ret is set, and the return value is the number that
+ * succeeded (i.e. the index of the first failure), or a negative error.
+ */
+int cos_captbl_opv(captblcap_t ct, struct cos_captbl_op *ops, int nops);
 
 int cos_sinv(sinvcap_t sinv, word_t arg1, word_t arg2, word_t arg3, word_t arg4);
 
 vaddr_t cos_mem_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 int cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
+/* alias the super-page that includes src; cos_mem_alias_at aliases it at a super-page aligned dst */
+vaddr_t cos_mem_alias_super(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 vaddr_t cos_mem_move(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src);
 int cos_mem_move_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src);
 int cos_mem_remove(pgtblcap_t pt, vaddr_t addr);
@@ -112,4 +193,11 @@ void *cos_hw_map(struct cos_compinfo *ci, hwcap_t hwc, paddr_t pa, unsigned int
 int cos_hw_cycles_per_usec(hwcap_t hwc);
 int cos_hw_cycles_thresh(hwcap_t hwc);
 
+/*
+ * Map a core's kernel trace ring read-only (requires
+ * COS_KERNEL_TRACE); the booter's trace capability is
+ * BOOT_CAPTBL_SELF_TRACE.
+ */
+struct cos_trace_ring *cos_trace_map(struct cos_compinfo *ci, tracecap_t trc, cpuid_t core);
+
 #endif /* COS_KERNEL_API_H */
@@ -0,0 +1,72 @@
+#ifndef COS_TRACE_DECODE_H
+#define COS_TRACE_DECODE_H
+
+/*
+ * Decoder for a kernel trace ring (see cos_trace.h and
+ * cos_trace_map): reads the records a core has written since the last
+ * decode, and accumulates latency histograms for
+ *
+ * - each invocation edge (caller to callee component, by liveness
+ *   id), from the sinv to the matching sret of the same thread, and
+ * - asnd to the switch to its receiver, and interrupt (hw asnd or
+ *   timer) to the next thread switch.
+ *
+ * Histogram buckets are powers of two of cycles.  Records overwritten
+ * before they were decoded are counted as lost, and invocations whose
+ * sinv or sret was lost are not sampled.
+ */
+
+#include <cos_component.h>
+#include <cos_trace.h>
+
+#define COS_TRACE_HIST_NBKTS 32
+#define COS_TRACE_NEDGES     64
+#define COS_TRACE_NTHDS      256 	/* threads ids are hashed into this many invocation stacks */
+#define COS_TRACE_INVSTK_SZ  16
+
+struct cos_trace_hist {
+	unsigned long cnt;
+	cycles_t      min, max, tot;
+	unsigned long bkts[COS_TRACE_HIST_NBKTS];
+};
+
+struct cos_trace_edge {
+	u32_t                 caller, callee;
+	struct cos_trace_hist lat;
+};
+
+typedef enum {
+	COS_TRACE_LAT_ASND,   /* asnd to the switch to the receiver */
+	COS_TRACE_LAT_HW,     /* interrupt to the next switch */
+	COS_TRACE_LAT_TIMER,  /* timer to the next switch */
+	COS_TRACE_LAT_NTYPES
+} cos_trace_lat_t;
+
+struct cos_trace_invstk {
+	thdid_t  tid;
+	int      depth;
+	u32_t    lid[COS_TRACE_INVSTK_SZ];
+	cycles_t tsc[COS_TRACE_INVSTK_SZ];
+};
+
+struct cos_trace_decoder {
+	struct cos_trace_ring  *ring;
+	u32_t                   cursor;
+	unsigned long           nrecs, lost, edges_dropped;
+
+	struct cos_trace_invstk invstks[COS_TRACE_NTHDS];
+	int                     nedges;
+	struct cos_trace_edge   edges[COS_TRACE_NEDGES];
+
+	/* the pending event for each latency, and the thread that ends it (0 for any) */
+	cycles_t                pending[COS_TRACE_LAT_NTYPES];
+	thdid_t                 pending_thd[COS_TRACE_LAT_NTYPES];
+	struct cos_trace_hist   lat[COS_TRACE_LAT_NTYPES];
+};
+
+void cos_trace_decoder_init(struct cos_trace_decoder *d, struct cos_trace_ring *r);
+/* decode the records written since the last call; returns the number decoded */
+int  cos_trace_decode(struct cos_trace_decoder *d);
+void cos_trace_report(struct cos_trace_decoder *d);
+
+#endif /* COS_TRACE_DECODE_H */
@@ -23,6 +23,7 @@
 #define CSLAB_FREE(x, sz) free_page(x)
 #include <cslab.h>
 CSLAB_CREATE(desc, sizeof(struct cbuf_alloc_desc));
+CSLAB_CREATE(subpage, sizeof(struct cbuf_alloc_subpage));
 
 cos_lock_t cbuf_lock;
 /* 
@@ -38,20 +39,84 @@ extern struct cos_component_information cos_comp_info;
 CVECT_CREATE_STATIC(meta_cbuf);
 CVECT_CREATE_STATIC(meta_cbufp);
 CVECT_CREATE_STATIC(alloc_descs);
-struct cbuf_alloc_desc cbuf_alloc_freelists = {.next = &cbuf_alloc_freelists, .prev = &cbuf_alloc_freelists, .addr = NULL};
-struct cbuf_alloc_desc cbufp_alloc_freelists[CBUFP_MAX_NSZ];
+struct cbuf_freelists cbuf_freelists[NUM_CPU];
 
 /*** Manage the cbuf allocation descriptors and freelists  ***/
 
+static inline int
+__cbuf_desc_subpage(struct cbuf_alloc_desc *d) { return !d->tmem && d->length < PAGE_SIZE; }
+
+static inline struct cbuf_alloc_subpage *
+__cbuf_desc_subpage_lookup(unsigned long idx)
+{
+	unsigned long e = (unsigned long)cvect_lookup(&alloc_descs, idx);
+
+	if (!(e & CBUF_DESC_SUBPAGE)) return NULL;
+	return (struct cbuf_alloc_subpage *)(e & ~CBUF_DESC_SUBPAGE);
+}
+
+/* Precondition: cbuf lock is taken, and d's slot is empty. */
+static int
+__cbuf_desc_add(struct cbuf_alloc_desc *d)
+{
+	unsigned long idx = (unsigned long)d->addr >> PAGE_ORDER;
+	struct cbuf_alloc_subpage *sp;
+
+	if (!__cbuf_desc_subpage(d)) return cvect_add(&alloc_descs, d, idx);
+
+	sp = __cbuf_desc_subpage_lookup(idx);
+	if (!sp) {
+		assert(!cvect_lookup(&alloc_descs, idx));
+		sp = cslab_alloc_subpage();
+		if (!sp) return -1;
+		memset(sp, 0, sizeof(struct cbuf_alloc_subpage));
+		if (cvect_add(&alloc_descs, (void *)((unsigned long)sp | CBUF_DESC_SUBPAGE), idx)) {
+			cslab_free_subpage(sp);
+			return -1;
+		}
+	}
+	assert(!sp->descs[__cbuf_desc_slot(d->addr)]);
+	sp->descs[__cbuf_desc_slot(d->addr)] = d;
+
+	return 0;
+}
+
+/* 
+ * Precondition: cbuf lock is taken.
+ *
+ * Remove d from the vector if it is still there.  The table of a
+ * shared page is freed with its last descriptor, so that the page
+ * can be reused for cbufs of any size.
+ */
+static void
+__cbuf_desc_del(struct cbuf_alloc_desc *d)
+{
+	unsigned long idx = (unsigned long)d->addr >> PAGE_ORDER;
+	struct cbuf_alloc_subpage *sp;
+	int i;
+
+	sp = __cbuf_desc_subpage_lookup(idx);
+	if (!sp) {
+		if (cvect_lookup(&alloc_descs, idx) == d) cvect_del(&alloc_descs, idx);
+		return;
+	}
+	i = __cbuf_desc_slot(d->addr);
+	if (sp->descs[i] != d) return;
+	sp->descs[i] = NULL;
+	for (i = 0 ; i < CBUF_DESC_NSLOTS ; i++) {
+		if (sp->descs[i]) return;
+	}
+	cvect_del(&alloc_descs, idx);
+	cslab_free_subpage(sp);
+}
+
 static struct cbuf_alloc_desc *
 __cbuf_desc_alloc(int cbid, int size, void *addr, struct cbuf_meta *cm, int tmem)
 {
 	struct cbuf_alloc_desc *d;
-	int idx = ((int)addr >> PAGE_ORDER);
 
 	assert(addr && cm);
-	assert(cm->nfo.c.ptr == idx);
-	assert(__cbuf_alloc_lookup(idx) == NULL);
+	assert(cbufm_addr(cm) == addr);
 	assert((!tmem && !(cm->nfo.c.flags & CBUFM_TMEM)) ||
 	       (tmem && cm->nfo.c.flags & CBUFM_TMEM));
 
@@ -63,11 +128,12 @@ __cbuf_desc_alloc(int cbid, int size, void *addr, struct cbuf_meta *cm, int tmem
 	d->length = size;
 	d->meta   = cm;
 	d->tmem   = tmem;
-	INIT_LIST(d, next, prev);
-	//ADD_LIST(&cbuf_alloc_freelists, d, next, prev);
-	if (tmem) d->flhead = &cbuf_alloc_freelists;
-	else      d->flhead = __cbufp_freelist_get(size);
-	cvect_add(&alloc_descs, d, idx);
+	d->next   = NULL;
+	d->state  = CBUF_DESC_USED;
+	if (__cbuf_desc_add(d)) {
+		cslab_free_desc(d);
+		return NULL;
+	}
 
 	return d;
 }
@@ -79,18 +145,82 @@ __cbuf_desc_alloc(int cbid, int size, void *addr, struct cbuf_meta *cm, int tmem
  * cbuf, or 2) when another thread is given a new cbuf (via
  * cbuf_c_create) with the same cbid as the one referred to in the
  * freelist.  Either way, we want to simply remove the descriptor.
+ *
+ * Precondition: cbuf lock is taken, and we own d (it isn't on a
+ * freelist).
  */
 void
 __cbuf_desc_free(struct cbuf_alloc_desc *d)
 {
 	assert(d);
-	assert(cvect_lookup(&alloc_descs, (unsigned long)d->addr >> PAGE_ORDER) == d);
-	
-	REM_LIST(d, next, prev);
-	cvect_del(&alloc_descs, (unsigned long)d->addr >> PAGE_ORDER);
+	/* a DEAD descriptor was already replaced in the vector */
+	__cbuf_desc_del(d);
 	cslab_free_desc(d);
 }
 
+/* 
+ * Free a stale descriptor that we popped from a freelist, or that
+ * was replaced while we owned it.
+ */
+void
+__cbuf_desc_retire(struct cbuf_alloc_desc *d)
+{
+	CBUF_TAKE();
+	__cbuf_desc_free(d);
+	CBUF_RELEASE();
+}
+
+/*
+ * Precondition: cbuf lock is taken.
+ *
+ * The manager gave us a new cbuf at the address of d's: remove d
+ * from the vector.  If it is on a freelist, or being allocated or
+ * freed without the lock, the thread that next owns it frees it.
+ */
+static void
+__cbuf_desc_replace(struct cbuf_alloc_desc *d)
+{
+	unsigned long s;
+
+	__cbuf_desc_del(d);
+	do {
+		s = d->state;
+		assert(s != CBUF_DESC_DEAD);
+	} while (!cos_cas(&d->state, s, CBUF_DESC_DEAD));
+	if (s == CBUF_DESC_USED) cslab_free_desc(d);
+}
+
+/*
+ * Precondition: cbuf lock is taken.
+ *
+ * Replace the descriptors that have the slot in the vector of a new
+ * cbuf at addr: a cbuf of a page or more needs the page's entry, so
+ * all of the sub-page cbufs that were in it are replaced.  Any other
+ * descriptors for its memory are stale, and are caught when they
+ * are next allocated (see __cbuf_alloc).
+ */
+static void
+__cbuf_descs_replace(void *addr, int size, int tmem)
+{
+	unsigned long idx = (unsigned long)addr >> PAGE_ORDER;
+	struct cbuf_alloc_subpage *sp;
+	struct cbuf_alloc_desc *d;
+	int i;
+
+	while ((sp = __cbuf_desc_subpage_lookup(idx))) {
+		if (!tmem && size < PAGE_SIZE) {
+			d = sp->descs[__cbuf_desc_slot(addr)];
+			if (d) __cbuf_desc_replace(d);
+			return;
+		}
+		/* this frees the table with the page's last descriptor */
+		for (i = 0 ; !sp->descs[i] ; i++) ;
+		__cbuf_desc_replace(sp->descs[i]);
+	}
+	d = cvect_lookup(&alloc_descs, idx);
+	if (d) __cbuf_desc_replace(d);
+}
+
 /*** Slow paths for each cbuf operation ***/
 
 /* 
@@ -130,7 +260,7 @@ __cbuf_2buf_miss(int cbid, int len, int tmem)
 	else      ret = cbufp_retrieve(cos_spd_id(), cbid, len);
 	CBUF_TAKE();
 	if (unlikely(ret < 0                                   ||
-		     mc->sz < (len >> PAGE_ORDER)              ||
+		     (!tmem && cbufm_size(mc) < (u32_t)len)   ||
 		     (tmem && !(mc->nfo.c.flags & CBUFM_TMEM)) || 
 		     (!tmem && mc->nfo.c.flags & CBUFM_TMEM))) {
 		return -1;
@@ -144,74 +274,159 @@ __cbuf_2buf_miss(int cbid, int len, int tmem)
 static inline int
 __cbufp_alloc_slow(int cbid, int size, int *len, int *error)
 {
-	int amnt = 0, i;
-	cbuf_t cb;
-	int *cbs;
-
 	assert(cbid <= 0);
-	if (cbid == 0) {
-		struct cbuf_meta *cm;
-
-		cbs    = cbuf_alloc(PAGE_SIZE, &cb);
-		assert(cbs);
-		cbs[0] = 0;
-		/* Do a garbage collection */
-		amnt = cbufp_collect(cos_spd_id(), size, cb);
-		if (amnt < 0) {
-			*error = 1;
-			return -1;
-		}
-
-		CBUF_TAKE();
-		cbid = cbs[0];
-		/* own the cbuf we just collected */
-		if (amnt > 0) {
-			cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), 0);
-			assert(cm);
-			/* (should be atomic) */
-			cm->nfo.c.flags |= CBUFM_TOUCHED; 
-			if(cm->nfo.c.refcnt == CBUFP_REFCNT_MAX) {
-				assert(0);
-			}
-			cm->nfo.c.refcnt++;
-		}
-		/* ...add the rest back into freelists */
-		for (i = 1 ; i < amnt ; i++) {
-			struct cbuf_alloc_desc *d, *fl;
-			struct cbuf_meta *meta;
-			int idx = cbid_to_meta_idx(cbs[i]);
-			u32_t page;
-			void *data;
-
-			assert(idx > 0);
-			meta = cbuf_vect_lookup_addr(idx, 0);
-			d    = __cbuf_alloc_lookup(meta->nfo.c.ptr);
-			assert(d && d->cbid == cbs[i]);
-			fl   = d->flhead;
-			assert(fl);
-			ADD_LIST(fl, d, next, prev);
-		}
-		CBUF_RELEASE();
-		cbuf_free(cbs);
-	}
-	/* Nothing collected...allocate a new cbufp! */
-	if (amnt == 0) {
-		cbid = cbufp_create(cos_spd_id(), size, cbid*-1);
-		assert(cbid != 0);
-	} 
+	/* 
+	 * Collection is done in batches by __cbufp_refill before
+	 * we get here, so allocate a new cbufp!
+	 */
+	cbid = cbufp_create(cos_spd_id(), size, cbid*-1);
+	assert(cbid != 0);
 	/* TODO update correctly */
 	*len = 1;
 
 	return cbid;
 }
 
+/* The rings of cbids from the manager for each size of cbufp (see cbufp_ring_map) */
+static struct cbufp_ring *cbufp_rings[CBUFP_NCLASSES];
+
+/* 
+ * Take a cbid from a ring.  Threads on any core can take from it, so
+ * the tail is moved with a cas after the cbid is read; the manager
+ * doesn't overwrite it until then.  Returns 0 if the ring is empty.
+ */
+static long
+__cbufp_ring_take(struct cbufp_ring *r)
+{
+	u32_t tail;
+	long cbid;
+
+	do {
+		tail = r->tail;
+		if (tail == r->head) return 0;
+		cos_mem_fence();
+		cbid = r->cbids[tail & CBUFP_RING_MASK];
+	} while (!cos_cas((unsigned long *)&r->tail, tail, tail + 1));
+
+	return cbid;
+}
+
+/* 
+ * Precondition: cbuf lock is taken (but it is released to finish
+ * creating a cbufp).
+ *
+ * Add a free cbufp from the ring to this core's freelist, with a new
+ * descriptor, or the one it had when it was last used.  Returns 0 on
+ * success.
+ */
+static int
+__cbufp_free_add(long cbid, int size)
+{
+	struct cbuf_alloc_desc *d;
+	struct cbuf_meta *cm;
+	void *addr;
+
+	/* its meta isn't mapped in: do so, and finish its creation */
+	if (cbid < 0) {
+		cbid = -cbid;
+		if (cbuf_vect_expand(&meta_cbufp, cbid_to_meta_idx(cbid), 0) < 0) return -1;
+		CBUF_RELEASE();
+		cbid = cbufp_create(cos_spd_id(), size, cbid);
+		CBUF_TAKE();
+		if (cbid <= 0) return -1;
+		/* it is created referenced: it is free until it is allocated */
+		cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), 0);
+		assert(cm && cm->nfo.c.refcnt);
+		__cbufm_put(cm, CBUFM_TOUCHED);
+	}
+	cm = cbuf_vect_lookup_addr(cbid_to_meta_idx(cbid), 0);
+	if (unlikely(!cm || !cm->nfo.c.ptr || cm->nfo.c.refcnt)) return -1;
+
+	addr = cbufm_addr(cm);
+	d    = __cbuf_alloc_lookup(addr);
+	if (d && d->cbid == cbid && d->meta == cm && d->addr == addr) {
+		/* ...unless it is already free */
+		if (!cos_cas(&d->state, CBUF_DESC_USED, CBUF_DESC_FREE)) return -1;
+	} else {
+		__cbuf_descs_replace(addr, size, 0);
+		d = __cbuf_desc_alloc(cbid, size, addr, cm, 0);
+		if (!d) return -1;
+		d->state = CBUF_DESC_FREE;
+	}
+	__cbuf_fl_push(__cbufp_freelist_get(size, cos_cpuid()), d);
+
+	return 0;
+}
+
+/* 
+ * Without a ring, collect the unreferenced cbufps a page of cbids at
+ * a time with cbufp_collect.  Returns the number of cbufps added.
+ */
+static int
+__cbufp_collect(int size)
+{
+	int amnt, i, n = 0;
+	cbuf_t cb;
+	long *cbs;
+
+	cbs = cbuf_alloc(PAGE_SIZE, &cb);
+	if (!cbs) return 0;
+	amnt = cbufp_collect(cos_spd_id(), size, cb);
+
+	CBUF_TAKE();
+	for (i = 0 ; i < amnt ; i++) {
+		if (!__cbufp_free_add(cbs[i], size)) n++;
+	}
+	CBUF_RELEASE();
+	cbuf_free(cbs);
+
+	return n;
+}
+
+/* 
+ * Refill this core's freelist of size cbufps: with those the manager
+ * collects, or if there are none, with a batch of new ones, that it
+ * adds to the ring, so that there is one invocation per batch.
+ * Returns the number of cbufps added.
+ */
+int
+__cbufp_refill(int size)
+{
+	int class = __cbufp_class(size), n = 0, amnt;
+	struct cbufp_ring *r;
+	long cbid;
+
+	r = cbufp_rings[class];
+	if (unlikely(!r)) {
+		/* returns the same ring if several threads race to map it */
+		r = (struct cbufp_ring *)cbufp_ring_map(cos_spd_id(), size);
+		if (!r) return __cbufp_collect(size);
+		cbufp_rings[class] = r;
+	}
+	if (r->tail == r->head) {
+		amnt = cbufp_collect_batch(cos_spd_id(), size);
+		if (amnt == 0) amnt = cbufp_create_batch(cos_spd_id(), size, __cbufp_batch(size));
+		/* the manager rejects the ring if its tail was corrupted */
+		if (amnt < 0) return __cbufp_collect(size);
+		if (amnt == 0) return 0;
+	}
+
+	CBUF_TAKE();
+	while ((cbid = __cbufp_ring_take(r))) {
+		if (!__cbufp_free_add(cbid, size)) n++;
+	}
+	CBUF_RELEASE();
+
+	return n;
+}
+
 /* 
  * Precondition: cbuf lock is taken.
  */
 struct cbuf_alloc_desc *
 __cbuf_alloc_slow(int size, int *len, int tmem)
 {
-	struct cbuf_alloc_desc *d_prev, *ret = NULL;
+	struct cbuf_alloc_desc *ret = NULL;
 	struct cbuf_meta *cm;
 	void *addr;
 	int cbid;
@@ -248,7 +463,7 @@ __cbuf_alloc_slow(int size, int *len, int tmem)
 	assert(cm && cm->nfo.c.ptr);
 	assert(cm && cm->nfo.c.refcnt);
 	assert(!tmem || cm->owner_nfo.thdid);
-	addr = (void*)(cm->nfo.c.ptr << PAGE_ORDER);
+	addr = cbufm_addr(cm);
 	assert(addr);
 	/* 
 	 * See __cbuf_alloc and cbuf_slab_free.  It is possible that a
@@ -259,9 +474,8 @@ __cbuf_alloc_slow(int size, int *len, int tmem)
 	 */
 	/* TODO: check if this is correct. what if this cbuf is from
 	 * the local cache and has been taken by another thd? */
-	d_prev = __cbuf_alloc_lookup((u32_t)addr>>PAGE_ORDER);
-	if (d_prev) __cbuf_desc_free(d_prev);
-	ret    = __cbuf_desc_alloc(cbid, size, addr, cm, tmem);
+	__cbuf_descs_replace(addr, size, tmem);
+	ret = __cbuf_desc_alloc(cbid, size, addr, cm, tmem);
 done:   
 	return ret;
 }
@@ -269,12 +483,5 @@ done:
 CCTOR static void
 cbuf_init(void)
 {
-	int i;
-
 	lock_static_init(&cbuf_lock);
-	for (i = 0 ; i < CBUFP_MAX_NSZ/2 ; i++) {
-		cbufp_alloc_freelists[i].next = cbufp_alloc_freelists[i].prev = &cbufp_alloc_freelists[i];
-		cbufp_alloc_freelists[i].length = PAGE_SIZE << i;
-		cbufp_alloc_freelists[i].addr   = NULL;
-	}
 }
@@ -80,13 +80,52 @@ union cbufm_ownership {
 
 struct cbuf_meta {
 	union cbufm_info nfo;
-	u16_t sz;			/* # of pages || 0 == TMEM */
+	u16_t sz;			/* # of pages || 0 == TMEM || sub-page */
 	union cbufm_ownership owner_nfo;
 };
 
+/* 
+ * Cbufs smaller than a page share their page with others of the same
+ * size.  ptr is then the shared page, and sz encodes the size (as a
+ * power of 2 order) and the offset into the page (in units of the
+ * smallest size, 1<<CBUFM_MIN_ORDER).
+ */
+#define CBUFM_SUBPAGE      (1<<15)
+#define CBUFM_MIN_ORDER    5
+#define CBUFM_ORDER_MASK   0xF
+#define CBUFM_SLOT_SHIFT   4
+
+static inline u16_t 
+cbufm_sz_subpage(int order, u32_t off)
+{ return CBUFM_SUBPAGE | ((off >> CBUFM_MIN_ORDER) << CBUFM_SLOT_SHIFT) | order; }
+
 static inline 
 int cbufm_is_mapped(struct cbuf_meta *m) { return m->nfo.c.ptr != 0; }
 static inline
 int cbufm_is_tmem(struct cbuf_meta *m)   { return m->sz == 0; }
+static inline
+int cbufm_is_subpage(struct cbuf_meta *m) { return m->sz & CBUFM_SUBPAGE; }
+
+/* offset of the cbuf into its first page */
+static inline u32_t
+cbufm_offset(struct cbuf_meta *m)
+{ 
+	if (!cbufm_is_subpage(m)) return 0;
+	return ((m->sz & ~CBUFM_SUBPAGE) >> CBUFM_SLOT_SHIFT) << CBUFM_MIN_ORDER;
+}
+
+/* size of the cbuf in bytes */
+static inline u32_t
+cbufm_size(struct cbuf_meta *m)
+{
+	if (cbufm_is_tmem(m))    return PAGE_SIZE;
+	if (cbufm_is_subpage(m)) return 1 << (m->sz & CBUFM_ORDER_MASK);
+	return m->sz << PAGE_ORDER;
+}
+
+/* address of the cbuf's data in the component with the meta */
+static inline void *
+cbufm_addr(struct cbuf_meta *m)
+{ return (void *)((m->nfo.c.ptr << PAGE_ORDER) + cbufm_offset(m)); }
 
 #endif /* CBUF_META_H */
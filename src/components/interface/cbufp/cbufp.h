@@ -11,6 +11,7 @@
 #define   	CBUFP_H
 
 #include <cos_component.h>
+#include <bitmap.h>
 
 /* 
  * These are more or less identical to the counterparts in cbuf_c.h,
@@ -31,6 +32,69 @@ vaddr_t cbufp_register(spdid_t spdid, long cbid);
  */
 int cbufp_collect(spdid_t spdid, int size, long cbid_ret);
 
+/* 
+ * Batched creation and collection.  Each size of cbufp has a ring
+ * shared between this component and the client, mapped in with
+ * cbufp_ring_map (which returns its address in the client).
+ * cbufp_create_batch creates up to n cbufps of the size, and
+ * cbufp_collect_batch collects the unreferenced cbufps of the size
+ * that the client has used since they were last collected.  Both add
+ * the cbids to the ring, and return the number added, or a negative
+ * value for an error.  The client takes them from the ring.  The
+ * cbufps are unreferenced (i.e. they are free).  A negative cbid
+ * means that its meta isn't mapped in: the client must map it in
+ * (cbufp_register), then finish the creation with cbufp_create
+ * (which returns it referenced, as usual).
+ */
+#define CBUFP_RING_ORDER 9
+#define CBUFP_RING_SZ    (1 << CBUFP_RING_ORDER)
+#define CBUFP_RING_MASK  (CBUFP_RING_SZ - 1)
+
+struct cbufp_ring {
+	/* cbufp adds cbids at the head, the client takes them at the tail */
+	u32_t head, tail;
+	long  cbids[CBUFP_RING_SZ];
+};
+
+vaddr_t cbufp_ring_map(spdid_t spdid, int size);
+int cbufp_create_batch(spdid_t spdid, int size, int n);
+int cbufp_collect_batch(spdid_t spdid, int size);
+
+/* 
+ * Cbufps come in power of 2 size classes, from 1<<CBUFP_MIN_ORDER
+ * bytes (which must be CBUFM_MIN_ORDER in cbuf_meta.h) up to
+ * 1<<CBUFP_MAX_ORDER.
+ *
+ * With CBUFP_SUBPAGE, those smaller than a page are packed into
+ * pages shared with other cbufps of the same size and owner.  A
+ * component that receives one of them is mapped its whole page, so
+ * it can read the others, that the owner might send to other
+ * components.  Only define it if the components that share cbufps
+ * trust each other.  Otherwise, the smallest class is a page, and
+ * cbufps are only shared at page granularity.
+ */
+/* #define CBUFP_SUBPAGE */
+#define CBUFP_MIN_ORDER 5
+#define CBUFP_MAX_ORDER 22
+#define CBUFP_MIN_SZ    (1 << CBUFP_MIN_ORDER)
+#define CBUFP_MAX_SZ    (1 << CBUFP_MAX_ORDER)
+#define CBUFP_NCLASSES  (CBUFP_MAX_ORDER - CBUFP_MIN_ORDER + 1)
+
+/* The size of the class for a request of sz bytes, 0 if too large */
+static inline int
+cbufp_size_class(int sz)
+{
+#ifndef CBUFP_SUBPAGE
+	if (sz <= PAGE_SIZE)    return PAGE_SIZE;
+#endif
+	if (sz <= CBUFP_MIN_SZ) return CBUFP_MIN_SZ;
+	if (sz > CBUFP_MAX_SZ)  return 0;
+	return nlepow2(sz);
+}
+
+/* Print the use of each size class of cbufp in each component */
+void cbufp_buf_report(void);
+
 /* GAP #include <cbuf_vect.h> */
 /* #include <mem_mgr_large.h> */
 /* /\* Included mainly for struct cbuf_meta: *\/ */
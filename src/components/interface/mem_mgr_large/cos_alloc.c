@@ -43,8 +43,7 @@ struct free_page {
 };
 static struct free_page page_list = {.next = NULL};
 
-extern void *mman_get_page(spdid_t spd, void *addr, int flags);
-extern void mman_release_page(spdid_t spd, void *addr, int flags);
+#include "mem_mgr_large.h"
 #endif
 
 #define DIE() (*((int*)0) = 0xDEADDEAD)
@@ -99,37 +98,28 @@ static inline REGPARM(1) void *do_mmap(size_t size) {
 #else 
 
 REGPARM(1) void *do_mmap(size_t size) {
-	void *hp, *ret;
-	unsigned long p;
+	void *hp;
 	size_t s = round_up_to_page(size);
+	int npages = s/PAGE_SIZE;
 
+	if (unlikely(npages > MMAN_NPAGES_MAX)) return NULL;
 #ifdef USE_VALLOC
-	hp = valloc_alloc(cos_spd_id(), cos_spd_id(), s/PAGE_SIZE);
-	if (!hp) return NULL;
+	hp = valloc_alloc(cos_spd_id(), cos_spd_id(), npages);
 #else
-	massert(size <= PAGE_SIZE);
-	//hp = cos_get_prealloc_page();
-	//if (!hp) 
-	hp = cos_get_vas_page();
+	hp = cos_get_vas_pages(npages);
 #endif
-	for (p = (unsigned long)hp ; 
-	     p < (unsigned long)hp + s ; 
-	     p += PAGE_SIZE) {
-		ret = (void*)mman_get_page(cos_spd_id(), (void*)p, MAPPING_RW);
-		if (unlikely(!ret)) {
-			for (p -= PAGE_SIZE ; hp <= (void*)p ; p -= PAGE_SIZE) {
-				mman_release_page(cos_spd_id(), (void*)p, 0);
-			}
+	if (!hp) return NULL;
+	/* a single invocation maps the whole region */
+	if (unlikely(!mman_get_page(cos_spd_id(), (vaddr_t)hp, MMAN_NPAGES(npages) | MAPPING_RW))) {
 #ifdef USE_VALLOC
-			if (unlikely(valloc_free(cos_spd_id(), cos_spd_id(), hp, s/PAGE_SIZE))) DIE();
+		if (unlikely(valloc_free(cos_spd_id(), cos_spd_id(), hp, npages))) DIE();
 #else
-			cos_release_vas_page(hp);
+		cos_release_vas_pages(hp, npages);
 #endif
-			return NULL;
-		}
+		return NULL;
 	}
 #if ALLOC_DEBUG >= ALLOC_DEBUG_ALL
-	if (alloc_debug) printc("malloc in %d: mmapped region into %x", cos_spd_id(), ret);
+	if (alloc_debug) printc("malloc in %d: mmapped region into %x", cos_spd_id(), hp);
 #endif
 	return hp;
 }
@@ -137,13 +127,15 @@ REGPARM(1) void *do_mmap(size_t size) {
 /* remove qualifiers to make debugging easier */
 /*static inline*/ REGPARM(2) int 
 do_munmap(void *addr, size_t size) {
-	unsigned long p;
-	
+	int npages = round_up_to_page(size)/PAGE_SIZE;
+
 	massert((unsigned long)addr == round_to_page((unsigned long)addr)); 
-	for (p = (unsigned long)addr ; p < ((unsigned long)addr + size) ; p += PAGE_SIZE) {
-		mman_release_page(cos_spd_id(), (void*)p, 0);
-	}
-	if (valloc_free(cos_spd_id(), cos_spd_id(), addr, round_up_to_page(size)/PAGE_SIZE)) DIE();
+	mman_release_page(cos_spd_id(), (vaddr_t)addr, MMAN_NPAGES(npages));
+#ifdef USE_VALLOC
+	if (valloc_free(cos_spd_id(), cos_spd_id(), addr, npages)) DIE();
+#else
+	cos_release_vas_pages(addr, npages);
+#endif
 	return 0;
 }
 #endif
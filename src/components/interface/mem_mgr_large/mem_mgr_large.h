@@ -10,7 +10,26 @@
 #ifndef   	MEM_MGR_H
 #define   	MEM_MGR_H
 
-/* Map a physical frame into a component. */
+/* 
+ * The number of pages to map, or release, is passed in the upper 16
+ * bits of the flags, so that a range takes a single invocation:
+ * mman_get_page(spd, addr, MMAN_NPAGES(n) | MAPPING_RW) maps n pages
+ * of frames at addr, and mman_release_page(spd, addr, MMAN_NPAGES(n))
+ * removes them.  0 means a single page.
+ */
+#define MMAN_NPAGES_SHIFT 16
+#define MMAN_NPAGES_MAX   0xFFFF
+#define MMAN_NPAGES(n)    ((n) << MMAN_NPAGES_SHIFT)
+
+static inline int
+mman_npages(int flags)
+{
+	int n = (u32_t)flags >> MMAN_NPAGES_SHIFT;
+
+	return n ? n : 1;
+}
+
+/* Map physical frames into a component. */
 vaddr_t mman_get_page(spdid_t spd, vaddr_t addr, int flags);
 /* 
  * remove this single mapping _and_ all descendents.  FIXME: this can
@@ -90,6 +90,8 @@ CSTUB_POST
 
 CSTUB_4(int, tread, spdid_t, td_t, int, int);
 CSTUB_4(int, twrite, spdid_t, td_t, int, int);
+CSTUB_4(int, treadv, spdid_t, td_t, int, int);
+CSTUB_4(int, twritev, spdid_t, td_t, int, int);
 
 struct __sg_trmeta_data {
         td_t td;
@@ -31,6 +31,19 @@ int tread(spdid_t spdid, td_t td, int cbid, int sz);
 int treadp(spdid_t spdid, td_t td, int *off, int *sz);
 int twrite(spdid_t spdid, td_t td, int cbid, int sz);
 int twritep(spdid_t spdid, td_t td, int cbid, int sz);
+/* 
+ * Scatter-gather versions of tread and twrite: cbid is a tmem cbuf
+ * of sz bytes holding a struct cbuf_vec (see cbuf.h).  twritev
+ * writes its elements, in order, and returns the number of bytes
+ * written.  treadv fills in the vector with cbufps holding the data
+ * read, and returns the number of bytes read.  Either way, the
+ * elements are consumed by the callee (twritev) or the caller
+ * (treadv) with cbuf_vec_map and cbuf_vec_unmap.  Servers that don't
+ * implement them get a twritev that copies the data and uses twrite,
+ * and a treadv that returns -ENOTSUP (see torlib.c).
+ */
+int treadv(spdid_t spdid, td_t td, int cbid, int sz);
+int twritev(spdid_t spdid, td_t td, int cbid, int sz);
 int trmeta(spdid_t spdid, td_t td, const char *key, unsigned int klen, char *retval, unsigned int max_rval_len);
 int twmeta(spdid_t spdid, td_t td, const char *key, unsigned int klen, const char *val, unsigned int vlen);
 
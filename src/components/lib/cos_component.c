@@ -100,23 +100,31 @@ cos_upcall_fn(upcall_type_t t, void *arg1, void *arg2, void *arg3)
 }
 
 CWEAKSYMB void *
-cos_get_vas_page(void)
+cos_get_vas_pages(int npages)
 {
 	char *h;
 	long r;
 	do {
 		h = cos_get_heap_ptr();
-		r = (long)h+PAGE_SIZE;
+		r = (long)h+(npages*PAGE_SIZE);
 	} while (cos_cmpxchg(&cos_comp_info.cos_heap_ptr, (long)h, r) != r);
 	return h;
 }
 
 CWEAKSYMB void
-cos_release_vas_page(void *p)
+cos_release_vas_pages(void *p, int npages)
 {
-	cos_set_heap_ptr_conditional(p + PAGE_SIZE, p);
+	cos_set_heap_ptr_conditional(p + (npages*PAGE_SIZE), p);
 }
 
+CWEAKSYMB void *
+cos_get_vas_page(void)
+{ return cos_get_vas_pages(1); }
+
+CWEAKSYMB void
+cos_release_vas_page(void *p)
+{ cos_release_vas_pages(p, 1); }
+
 extern const vaddr_t cos_atomic_cmpxchg, cos_atomic_cmpxchg_end,
 	cos_atomic_user1, cos_atomic_user1_end,
 	cos_atomic_user2, cos_atomic_user2_end,
@@ -77,6 +77,128 @@ cos_compinfo_init(struct cos_compinfo *ci, pgtblcap_t pgtbl_cap, captblcap_t cap
 	ci->cap16_frontier = ci->cap32_frontier = ci->cap64_frontier = cap_frontier;
 }
 
+/**************** [Vectored Capability Operations] ****************/
+
+int
+cos_captbl_opv(captblcap_t ct, struct cos_captbl_op *ops, int nops)
+{ return call_cap_op(ct, CAPTBL_OP_VECTOR, (int)ops, nops, 0, 0); }
+
+/*
+ * Bulk operations (e.g. the PTEs and pages for a component) are
+ * accumulated in a vector, and executed in order with a single system
+ * call when it is full or flushed.  There is one vector per core, as
+ * the cores allocate concurrently; the threads on a core must
+ * serialize their allocations as for the rest of the compinfo.  Each
+ * is page-aligned so that it doesn't span pages.  The operations are
+ * all on capabilities in our own captbl (the meta compinfo's).
+ *
+ * A batch is begun with __opvec_begin, and ended with __opvec_flush
+ * or __opvec_abort.  Batches nest (e.g. expanding the captbl while
+ * adding the PTEs of a range): a nested flush executes all of the
+ * operations added so far, in order, but the outermost batch
+ * continues, and its failure index still counts from its start.
+ */
+struct __opvec {
+	struct cos_captbl_op ops[COS_CAPTBL_OP_VECTOR_MAX];
+	int n;     /* operations added, yet to be executed */
+	int nexec; /* operations executed since the outermost batch began */
+	int depth; /* batches begun, and not yet ended */
+} __attribute__((aligned(PAGE_SIZE)));
+
+static struct __opvec __opvecs[NUM_CPU_COS];
+
+static inline struct __opvec *
+__opvec_curr(void)
+{ return &__opvecs[cos_cpuid()]; }
+
+static inline void
+__opvec_begin(void)
+{ __opvec_curr()->depth++; }
+
+static inline void
+__opvec_end(struct __opvec *v)
+{
+	assert(v->depth > 0);
+	if (!--v->depth) v->nexec = 0;
+}
+
+/*
+ * Execute the operations added, yet to be executed.  Returns 0 if
+ * they all succeeded.  Otherwise returns -1, and sets *failed (if not
+ * NULL) to the index of the operation that failed, counting from the
+ * first added in the outermost batch: those before it were executed,
+ * and it and those after it weren't.
+ */
+static int
+__opvec_exec(struct cos_compinfo *meta, int *failed)
+{
+	struct __opvec *v = __opvec_curr();
+	int n = v->n, ret;
+
+	v->n = 0;
+	if (!n) return 0;
+	ret = cos_captbl_opv(meta->captbl_cap, v->ops, n);
+	if (ret == n) {
+		v->nexec += n;
+		return 0;
+	}
+	if (failed) *failed = v->nexec + (ret < 0 ? 0 : ret);
+
+	return -1;
+}
+
+/* End a batch, executing its operations (see __opvec_exec) */
+static int
+__opvec_flush(struct cos_compinfo *meta, int *failed)
+{
+	int ret = __opvec_exec(meta, failed);
+
+	__opvec_end(__opvec_curr());
+
+	return ret;
+}
+
+/*
+ * End a batch, discarding the operations yet to be executed, when we
+ * fail before executing them.  Those of the batches it is nested in
+ * are discarded too, so they must fail as well.
+ */
+static inline void
+__opvec_abort(void)
+{
+	struct __opvec *v = __opvec_curr();
+
+	v->n = 0;
+	__opvec_end(v);
+}
+
+/*
+ * Add an operation to the current batch, executing those already in
+ * the vector if it is full.  Returns -1 if they fail, setting *failed
+ * as for __opvec_exec, and 0 otherwise; the batch must still be ended.
+ */
+static int
+__opvec_add(struct cos_compinfo *meta, int *failed, capid_t cap, syscall_op_t op,
+	    unsigned long a1, unsigned long a2, unsigned long a3, unsigned long a4)
+{
+	struct __opvec *v = __opvec_curr();
+	struct cos_captbl_op *o;
+
+	assert(v->depth > 0);
+	if (v->n == (int)COS_CAPTBL_OP_VECTOR_MAX && __opvec_exec(meta, failed)) return -1;
+
+	o          = &v->ops[v->n++];
+	o->cap     = cap;
+	o->op      = op;
+	o->args[0] = a1;
+	o->args[1] = a2;
+	o->args[2] = a3;
+	o->args[3] = a4;
+	o->ret     = 0;
+
+	return 0;
+}
+
 /**************** [Memory Capability Allocation Functions] ***************/
 
 static vaddr_t
@@ -100,12 +222,14 @@ __mem_bump_alloc(struct cos_compinfo *__ci, int km, int retype)
 		frontier = &ci->mi.umem_frontier;
 	}
 	if (*ptr == *frontier) {
-		/* TODO: expand frontier if introspection says there is more memory */
-		if (ci->mi.untyped_ptr == ci->mi.untyped_frontier) return 0;
-		ret                 = ci->mi.untyped_ptr;
-		ci->mi.untyped_ptr += RETYPE_MEM_SIZE; /* TODO: atomic */
-		*ptr                = ret;
-		*frontier           = ret + RETYPE_MEM_SIZE;
+		/* the untyped memory is shared with the super-page allocations */
+		do {
+			ret = ci->mi.untyped_ptr;
+			/* TODO: expand frontier if introspection says there is more memory */
+			if (ret == ci->mi.untyped_frontier) return 0;
+		} while (!cos_cas(&ci->mi.untyped_ptr, ret, ret + RETYPE_MEM_SIZE));
+		*ptr      = ret;
+		*frontier = ret + RETYPE_MEM_SIZE;
 	}
 
 	if (retype && (ret % RETYPE_MEM_SIZE == 0)) {
@@ -208,23 +332,23 @@ __capid_captbl_check_expand(struct cos_compinfo *ci)
 	assert(captblid_add % CAPTBL_EXPAND_SZ == 0);
 
 	printd("__capid_captbl_check_expand->pre-captblactivate (%d)\n", CAPTBL_OP_CAPTBLACTIVATE);
-	/* captbl internal node allocated with the resource provider's captbls */
-	if (call_cap_op(meta->captbl_cap, CAPTBL_OP_CAPTBLACTIVATE, captblcap, meta->mi.pgtbl_cap, kmem, 1)) {
-		assert(0); /* race condition? */
-		return -1;
-	}
-	printd("__capid_captbl_check_expand->post-captblactivate\n");
 	/*
+	 * The captbl internal node is allocated with the resource
+	 * provider's captbls, then constructed into ci's captbl, in a
+	 * single vector.
+	 *
 	 * Assumption:
 	 * meta->captbl_cap refers to _our_ captbl, thus
 	 * captblcap's use in the following.
 	 */
-
-	/* Construct captbl */
-	if (call_cap_op(ci->captbl_cap, CAPTBL_OP_CONS, captblcap, captblid_add, 0, 0)) {
-		assert(0); /* race? */
+	__opvec_begin();
+	if (__opvec_add(meta, NULL, meta->captbl_cap, CAPTBL_OP_CAPTBLACTIVATE, captblcap, meta->mi.pgtbl_cap, kmem, 1) ||
+	    __opvec_add(meta, NULL, ci->captbl_cap, CAPTBL_OP_CONS, captblcap, captblid_add, 0, 0)) {
+		__opvec_abort();
 		return -1;
 	}
+	if (__opvec_flush(meta, NULL)) return -1;
+	printd("__capid_captbl_check_expand->post-captblactivate\n");
 
 	/* Success!  Advance the frontiers. */
 	ci->cap_frontier      = ci->caprange_frontier;
@@ -293,6 +417,7 @@ __bump_mem_expand_range(struct cos_compinfo *ci, pgtblcap_t cipgtbl, vaddr_t mem
 
 	assert(meta == __compinfo_metacap(meta)); /* prevent unbounded structures */
 
+	__opvec_begin();
 	for (addr = mem_ptr ; addr < mem_ptr + mem_sz ; addr += PGD_RANGE) {
 		capid_t pte_cap;
 		vaddr_t ptemem_cap;
@@ -300,25 +425,22 @@ __bump_mem_expand_range(struct cos_compinfo *ci, pgtblcap_t cipgtbl, vaddr_t mem
 		pte_cap    = __capid_bump_alloc(meta, CAP_PGTBL);
 		ptemem_cap = __kmem_bump_alloc(meta);
 		/* TODO: handle the case of running out of memory */
-		if (pte_cap == 0 || ptemem_cap == 0) return 0;
-
-		/* PTE */
-		if (call_cap_op(meta->captbl_cap, CAPTBL_OP_PGTBLACTIVATE,
-				pte_cap, meta->mi.pgtbl_cap, ptemem_cap, 1)) {
-			assert(0); /* race? */
-			return 0;
-		}
+		if (pte_cap == 0 || ptemem_cap == 0) goto err;
 
-		/* Construct pgtbl */
-		if (call_cap_op(cipgtbl, CAPTBL_OP_CONS, pte_cap, addr, 0, 0)) {
-			assert(0); /* race? */
-			return 0;
+		/* PTE, and construct it into the pgtbl */
+		if (__opvec_add(meta, NULL, meta->captbl_cap, CAPTBL_OP_PGTBLACTIVATE, pte_cap, meta->mi.pgtbl_cap, ptemem_cap, 1) ||
+		    __opvec_add(meta, NULL, cipgtbl, CAPTBL_OP_CONS, pte_cap, addr, 0, 0)) {
+			goto err;
 		}
 	}
+	if (__opvec_flush(meta, NULL)) return 0;
 
 	assert(round_up_to_pgd_page(addr) == round_up_to_pgd_page(mem_ptr + mem_sz));
 	
 	return mem_ptr;
+err:
+	__opvec_abort();
+	return 0;
 }
 
 vaddr_t
@@ -332,6 +454,7 @@ __cos_meminfo_populate(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned lo
 {
 	vaddr_t addr, start_addr, retaddr;
 	struct cos_compinfo *meta = __compinfo_metacap(ci);
+	int failed;
 
 	assert(untyped_ptr == round_up_to_pgd_page(untyped_ptr));
 	assert(untyped_sz == round_up_to_pgd_page(untyped_sz));
@@ -342,9 +465,16 @@ __cos_meminfo_populate(struct cos_compinfo *ci, vaddr_t untyped_ptr, unsigned lo
 	start_addr                = meta->mi.untyped_frontier - untyped_sz;
 	meta->mi.untyped_frontier = start_addr;
 
+	__opvec_begin();
 	for (addr = untyped_ptr ; addr < untyped_ptr + untyped_sz ; addr += PAGE_SIZE, start_addr += PAGE_SIZE) {
-		if (call_cap_op(meta->mi.pgtbl_cap, CAPTBL_OP_MEMMOVE, start_addr, ci->mi.pgtbl_cap, addr, 0)) BUG();
+		if (__opvec_add(meta, &failed, meta->mi.pgtbl_cap, CAPTBL_OP_MEMMOVE, start_addr, ci->mi.pgtbl_cap, addr, 0)) goto err;
 	}
+	if (__opvec_flush(meta, &failed)) goto err;
+
+	return;
+err:
+	printd("__cos_meminfo_populate: moving page %d failed\n", failed);
+	BUG();
 }
 
 void
@@ -415,6 +545,107 @@ __page_bump_alloc(struct cos_compinfo *ci)
 	return heap_vaddr;
 }
 
+/* Allocate contiguous pages, mapping them all in with one vector of operations */
+static vaddr_t
+__page_bump_allocn(struct cos_compinfo *ci, size_t sz)
+{
+	struct cos_compinfo *meta = __compinfo_metacap(ci);
+	vaddr_t heap_vaddr = 0, heap_cursor, umem;
+	size_t  off;
+
+	assert(sz % PAGE_SIZE == 0);
+
+	__opvec_begin();
+	for (off = 0 ; off < sz ; off += PAGE_SIZE) {
+		heap_cursor = __page_bump_valloc(ci);
+		if (unlikely(!heap_cursor)) goto err;
+		if (!off) heap_vaddr = heap_cursor;
+		assert(heap_cursor == heap_vaddr + off);
+
+		/* FIXME: if this fails, we should also back out the page_bump_valloc */
+		umem = __umem_bump_alloc(ci);
+		if (!umem) goto err;
+
+		if (__opvec_add(meta, NULL, meta->mi.pgtbl_cap, CAPTBL_OP_MEMACTIVATE, umem, ci->pgtbl_cap, heap_cursor, 0)) {
+			goto err;
+		}
+	}
+	if (__opvec_flush(meta, NULL)) return 0;
+
+	return heap_vaddr;
+err:
+	__opvec_abort();
+	return 0;
+}
+
+/*
+ * Allocate a super-page of untyped memory, retyped to user memory.
+ * Untyped memory is mapped at the same offset in a super-page as its
+ * physical address, so this skips to the next super-page aligned
+ * untyped memory.  The memory skipped is lost.
+ */
+static vaddr_t
+__umem_bump_alloc_super(struct cos_compinfo *__ci)
+{
+	struct cos_compinfo *ci = __compinfo_metacap(__ci);
+	vaddr_t ret, addr, untyped;
+
+	do {
+		untyped = ci->mi.untyped_ptr;
+		ret     = round_up_to_pgd_page(untyped);
+		if (ret < untyped || ret + PGD_RANGE > ci->mi.untyped_frontier) return 0;
+	} while (!cos_cas(&ci->mi.untyped_ptr, untyped, ret + PGD_RANGE));
+
+	__opvec_begin();
+	for (addr = ret ; addr < ret + PGD_RANGE ; addr += RETYPE_MEM_SIZE) {
+		if (__opvec_add(ci, NULL, ci->mi.pgtbl_cap, CAPTBL_OP_MEM_RETYPE2USER, addr, 0, 0, 0)) {
+			__opvec_abort();
+			return 0;
+		}
+	}
+	if (__opvec_flush(ci, NULL)) return 0;
+
+	return ret;
+}
+
+/*
+ * A super-page of virtual addresses that doesn't have a PTE.  The
+ * rest of the current PTE's range is skipped.
+ */
+static vaddr_t
+__page_bump_valloc_super(struct cos_compinfo *ci)
+{
+	vaddr_t heap_vaddr, vas;
+
+	do {
+		heap_vaddr = ci->vasrange_frontier;
+		assert(heap_vaddr == round_up_to_pgd_page(heap_vaddr));
+	} while (!cos_cas(&ci->vasrange_frontier, heap_vaddr, heap_vaddr + PGD_RANGE));
+	/* page allocations continue after the super-page, unless a later one has claimed addresses past it */
+	do {
+		vas = ci->vas_frontier;
+		if (vas >= heap_vaddr + PGD_RANGE) break;
+	} while (!cos_cas(&ci->vas_frontier, vas, heap_vaddr + PGD_RANGE));
+
+	return heap_vaddr;
+}
+
+static vaddr_t
+__page_bump_alloc_super(struct cos_compinfo *ci)
+{
+	struct cos_compinfo *meta = __compinfo_metacap(ci);
+	vaddr_t heap_vaddr, umem;
+
+	umem = __umem_bump_alloc_super(ci);
+	if (!umem) return 0;
+	heap_vaddr = __page_bump_valloc_super(ci);
+
+	/* FIXME: if this fails, the memory and virtual addresses are lost */
+	if (call_cap_op(meta->mi.pgtbl_cap, CAPTBL_OP_MEMACTIVATE_SUPER, umem, ci->pgtbl_cap, heap_vaddr, 0)) return 0;
+
+	return heap_vaddr;
+}
+
 /**************** [Liveness Allocation] ****************/
 
 /*
@@ -594,7 +825,7 @@ cos_arcv_alloc(struct cos_compinfo *ci, thdcap_t thdcap, tcap_t tcapcap, compcap
 }
 
 asndcap_t
-cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap)
+cos_asnd_alloc_ratelimit(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap, u16_t budget, u16_t period_usec)
 {
 	capid_t cap;
 
@@ -602,11 +833,15 @@ cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap)
 
 	cap = __capid_bump_alloc(ci, CAP_ASND);
 	if (!cap) return 0;
-	if (call_cap_op(ci->captbl_cap, CAPTBL_OP_ASNDACTIVATE, cap, ctcap, arcvcap, 0))  BUG();
+	if (call_cap_op(ci->captbl_cap, CAPTBL_OP_ASNDACTIVATE, cap, ctcap, arcvcap, (budget << 16) | period_usec))  BUG();
 
 	return cap;
 }
 
+asndcap_t
+cos_asnd_alloc(struct cos_compinfo *ci, arcvcap_t arcvcap, captblcap_t ctcap)
+{ return cos_asnd_alloc_ratelimit(ci, arcvcap, ctcap, 0, 0); }
+
 /*
  * TODO: bitmap must be a subset of existing one.
  *       but there is no such check now, violates access control policy.
@@ -629,6 +864,14 @@ void *
 cos_page_bump_alloc(struct cos_compinfo *ci)
 { return (void*)__page_bump_alloc(ci); }
 
+void *
+cos_page_bump_allocn(struct cos_compinfo *ci, size_t sz)
+{ return (void*)__page_bump_allocn(ci, round_up_to_page(sz)); }
+
+void *
+cos_page_bump_alloc_super(struct cos_compinfo *ci)
+{ return (void*)__page_bump_alloc_super(ci); }
+
 capid_t
 cos_cap_cpy(struct cos_compinfo *dstci, struct cos_compinfo *srcci, cap_t srcctype, capid_t srccap)
 {
@@ -694,6 +937,33 @@ cos_sched_rcv(arcvcap_t rcv, thdid_t *thdid, int *blocked, cycles_t *cycles)
 	return ret;
 }
 
+int
+cos_sched_rcv_batch(arcvcap_t rcv, struct cos_sched_evt *evts, int max, int *pending)
+{
+	unsigned long nevts = 0;
+	unsigned long unused;
+	int           ret;
+
+	ret = call_cap_retvals_asm(rcv, ARCV_OP_RCV_BATCH, (int)evts, max, 0, 0, &nevts, &unused);
+	if (unlikely(ret < 0)) return ret;
+	*pending = ret;
+
+	return (int)nevts;
+}
+
+int
+cos_sched_ring_set(arcvcap_t rcv, struct cos_sched_ring *ring)
+{
+	if (ring) {
+		assert(!((vaddr_t)ring & (PAGE_SIZE - 1)));
+		ring->c_head = ring->p_tail = 0;
+		ring->size   = COS_SCHED_RING_SZ;
+		ring->mask   = COS_SCHED_RING_SZ - 1;
+	}
+
+	return call_cap_op(rcv, ARCV_OP_RING_SET, (int)ring, 0, 0, 0);
+}
+
 int
 cos_rcv(arcvcap_t rcv)
 {
@@ -723,6 +993,21 @@ cos_mem_alias(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t sr
 	return dst;
 }
 
+vaddr_t
+cos_mem_alias_super(struct cos_compinfo *dstci, struct cos_compinfo *srcci, vaddr_t src)
+{
+	vaddr_t dst;
+
+	assert(srcci && dstci);
+
+	dst = __page_bump_valloc_super(dstci);
+	if (unlikely(!dst)) return 0;
+
+	if (call_cap_op(srcci->pgtbl_cap, CAPTBL_OP_CPY, src, dstci->pgtbl_cap, dst, 0))  BUG();
+
+	return dst;
+}
+
 int
 cos_mem_alias_at(struct cos_compinfo *dstci, vaddr_t dst, struct cos_compinfo *srcci, vaddr_t src)
 {
@@ -771,11 +1056,71 @@ int
 cos_thd_mod(struct cos_compinfo *ci, thdcap_t tc, void *tlsaddr)
 { return call_cap_op(ci->captbl_cap, CAPTBL_OP_THDTLSSET, tc, (int)tlsaddr, 0, 0); }
 
+/*
+ * Each core's migrations use one liveness id to track the quiescence
+ * since its last detach: reusing it only delays the attach of threads
+ * detached earlier.
+ */
+static u32_t thd_migrate_lid[NUM_CPU];
+
+int
+cos_thd_migrate_out(struct cos_compinfo *ci, thdcap_t tc, cpuid_t core)
+{
+	u32_t *lid = &thd_migrate_lid[cos_cpuid()];
+
+	assert(core != cos_cpuid());
+	if (!*lid) *lid = livenessid_bump_alloc();
+
+	return call_cap_op(ci->captbl_cap, CAPTBL_OP_THDMIGRATE, tc, core, 0, *lid);
+}
+
+int
+cos_thd_migrate_in(struct cos_compinfo *ci, thdcap_t tc, arcvcap_t rcv)
+{ return call_cap_op(ci->captbl_cap, CAPTBL_OP_THDMIGRATE, tc, cos_cpuid(), rcv, 0); }
+
 /* FIXME: problems when we got to 64 bit systems with the return value */
 int
 cos_introspect(struct cos_compinfo *ci, capid_t cap, unsigned long op)
 { return call_cap_op(ci->captbl_cap, CAPTBL_OP_INTROSPECT, cap, (int)op, 0, 0); }
 
+/* per-core, and separate from __opvecs, which can hold operations that are yet to be flushed */
+static struct __opvec __sinv_opvecs[NUM_CPU_COS];
+
+int
+cos_sinv_invocations(struct cos_compinfo *ci, sinvcap_t *sinvs, long *cnts, int n, int reset)
+{
+	unsigned long op = reset ? SINV_GET_INVOCATIONS_RESET : SINV_GET_INVOCATIONS;
+	struct cos_captbl_op *ops = __sinv_opvecs[cos_cpuid()].ops;
+	int i, j, nops, ret;
+
+	assert(ci && sinvs && cnts);
+
+	/* one system call for each vector of introspections */
+	for (i = 0 ; i < n ; i += nops) {
+		nops = n - i < (int)COS_CAPTBL_OP_VECTOR_MAX ? n - i : (int)COS_CAPTBL_OP_VECTOR_MAX;
+		for (j = 0 ; j < nops ; j++) {
+			struct cos_captbl_op *o = &ops[j];
+
+			o->cap     = ci->captbl_cap;
+			o->op      = CAPTBL_OP_INTROSPECT;
+			o->args[0] = sinvs[i + j];
+			o->args[1] = op;
+			o->args[2] = o->args[3] = 0;
+			o->ret     = 0;
+		}
+		ret = cos_captbl_opv(ci->captbl_cap, ops, nops);
+		if (ret < 0) return i;
+		for (j = 0 ; j < ret ; j++) cnts[i + j] = ops[j].ret;
+		/* the vector stops at the first failure: record it, and continue after it */
+		if (ret < nops) {
+			cnts[i + ret] = ops[ret].ret;
+			nops = ret + 1;
+		}
+	}
+
+	return n;
+}
+
 /***************** [Kernel Tcap Operations] *****************/
 
 tcap_t
@@ -866,3 +1211,23 @@ cos_hw_map(struct cos_compinfo *ci, hwcap_t hwc, paddr_t pa, unsigned int len)
 
 	return (void *)fva;
 }
+
+struct cos_trace_ring *
+cos_trace_map(struct cos_compinfo *ci, tracecap_t trc, cpuid_t core)
+{
+	vaddr_t va, fva;
+	int     i;
+
+	assert(ci && trc);
+
+	fva = __page_bump_valloc(ci);
+	if (unlikely(!fva)) return NULL;
+	for (i = 1 ; i < COS_TRACE_NPAGES ; i++) {
+		va = __page_bump_valloc(ci);
+		if (unlikely(!va)) return NULL;
+		assert(va == fva + i * PAGE_SIZE);
+	}
+	if (call_cap_op(trc, CAPTBL_OP_TRACE_MAP, ci->pgtbl_cap, fva, core, 0)) return NULL;
+
+	return (struct cos_trace_ring *)fva;
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include <cos_component.h>
+#include <cos_debug.h>
+#include <cos_trace_decode.h>
+
+static void
+hist_add(struct cos_trace_hist *h, cycles_t c)
+{
+	int b = 0;
+
+	if (!h->cnt || c < h->min) h->min = c;
+	if (c > h->max)            h->max = c;
+	h->cnt++;
+	h->tot += c;
+	while (c > 1 && b < COS_TRACE_HIST_NBKTS - 1) {
+		c >>= 1;
+		b++;
+	}
+	h->bkts[b]++;
+}
+
+static void
+hist_print(struct cos_trace_hist *h)
+{
+	int i;
+
+	if (!h->cnt) return;
+	printc("\tn %lu, avg %llu, min %llu, max %llu\n", h->cnt, h->tot / h->cnt, h->min, h->max);
+	for (i = 0 ; i < COS_TRACE_HIST_NBKTS ; i++) {
+		if (!h->bkts[i]) continue;
+		printc("\t[%llu, %llu): %lu\n", 1ULL << i, 2ULL << i, h->bkts[i]);
+	}
+}
+
+static struct cos_trace_invstk *
+invstk_get(struct cos_trace_decoder *d, thdid_t tid)
+{
+	struct cos_trace_invstk *s = &d->invstks[tid % COS_TRACE_NTHDS];
+
+	/* another thread hashed here: its invocations are lost */
+	if (s->tid != tid) {
+		s->tid   = tid;
+		s->depth = 0;
+	}
+
+	return s;
+}
+
+static struct cos_trace_hist *
+edge_get(struct cos_trace_decoder *d, u32_t caller, u32_t callee)
+{
+	int i;
+
+	for (i = 0 ; i < d->nedges ; i++) {
+		if (d->edges[i].caller == caller && d->edges[i].callee == callee) return &d->edges[i].lat;
+	}
+	if (d->nedges == COS_TRACE_NEDGES) return NULL;
+	d->edges[i].caller = caller;
+	d->edges[i].callee = callee;
+	d->nedges++;
+
+	return &d->edges[i].lat;
+}
+
+static void
+lat_start(struct cos_trace_decoder *d, cos_trace_lat_t l, cycles_t tsc, thdid_t to)
+{
+	/* only the first of several events before a switch is sampled */
+	if (d->pending[l]) return;
+	d->pending[l]     = tsc;
+	d->pending_thd[l] = to;
+}
+
+static void
+lat_switch(struct cos_trace_decoder *d, cycles_t tsc, thdid_t to)
+{
+	int l;
+
+	for (l = 0 ; l < COS_TRACE_LAT_NTYPES ; l++) {
+		if (!d->pending[l] || (d->pending_thd[l] && d->pending_thd[l] != to)) continue;
+		hist_add(&d->lat[l], tsc - d->pending[l]);
+		d->pending[l] = 0;
+	}
+}
+
+static void
+rec_process(struct cos_trace_decoder *d, struct cos_trace_rec *r)
+{
+	struct cos_trace_invstk *s;
+	struct cos_trace_hist   *h;
+
+	switch (r->evt) {
+	case COS_TRACE_SINV:
+		s = invstk_get(d, r->b);
+		if (s->depth < COS_TRACE_INVSTK_SZ) {
+			s->lid[s->depth] = r->a;
+			s->tsc[s->depth] = r->tsc;
+		}
+		s->depth++;
+		break;
+	case COS_TRACE_SRET:
+		s = invstk_get(d, r->b);
+		/* the sinv was lost, or was from before we started decoding */
+		if (s->depth == 0) break;
+		s->depth--;
+		if (s->depth >= COS_TRACE_INVSTK_SZ) break;
+		/* the caller of the outermost invocation isn't known: it is recorded as 0 */
+		h = edge_get(d, s->depth ? s->lid[s->depth - 1] : 0, s->lid[s->depth]);
+		if (!h) {
+			d->edges_dropped++;
+			break;
+		}
+		hist_add(h, r->tsc - s->tsc[s->depth]);
+		break;
+	case COS_TRACE_THD_SWITCH:
+		lat_switch(d, r->tsc, r->b);
+		break;
+	case COS_TRACE_ASND:
+		lat_start(d, COS_TRACE_LAT_ASND, r->tsc, r->b);
+		break;
+	case COS_TRACE_HW_ASND:
+		lat_start(d, COS_TRACE_LAT_HW, r->tsc, 0);
+		break;
+	case COS_TRACE_TIMER:
+		lat_start(d, COS_TRACE_LAT_TIMER, r->tsc, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+void
+cos_trace_decoder_init(struct cos_trace_decoder *d, struct cos_trace_ring *r)
+{
+	assert(d && r);
+
+	memset(d, 0, sizeof(struct cos_trace_decoder));
+	d->ring   = r;
+	/* start with the records that are currently in the ring */
+	d->cursor = r->head > COS_TRACE_NRECS ? r->head - COS_TRACE_NRECS : 0;
+}
+
+int
+cos_trace_decode(struct cos_trace_decoder *d)
+{
+	struct cos_trace_ring *r    = d->ring;
+	u32_t                  head = r->head;
+	struct cos_trace_rec   rec;
+	int                    n    = 0;
+
+	if (head - d->cursor > COS_TRACE_NRECS) {
+		d->lost  += head - d->cursor - COS_TRACE_NRECS;
+		d->cursor = head - COS_TRACE_NRECS;
+	}
+
+	for ( ; d->cursor != head ; d->cursor++) {
+		rec = r->recs[d->cursor & COS_TRACE_MASK];
+		/*
+		 * The kernel writes the record at the head before
+		 * advancing it, so if the head has since moved a full
+		 * ring past the cursor, the copy might be torn.
+		 */
+		__asm__ __volatile__("" ::: "memory");
+		if (r->head - d->cursor >= COS_TRACE_NRECS) {
+			d->lost++;
+			continue;
+		}
+		rec_process(d, &rec);
+		n++;
+	}
+	d->nrecs += n;
+
+	return n;
+}
+
+void
+cos_trace_report(struct cos_trace_decoder *d)
+{
+	static const char *lat_names[COS_TRACE_LAT_NTYPES] = {
+		[COS_TRACE_LAT_ASND]  = "asnd to receiver switch",
+		[COS_TRACE_LAT_HW]    = "interrupt to switch",
+		[COS_TRACE_LAT_TIMER] = "timer to switch",
+	};
+	int i;
+
+	printc("Trace: %lu records, %lu lost, %lu edges dropped\n", d->nrecs, d->lost, d->edges_dropped);
+	for (i = 0 ; i < d->nedges ; i++) {
+		printc("Invocation %u -> %u (cycles):\n", d->edges[i].caller, d->edges[i].callee);
+		hist_print(&d->edges[i].lat);
+	}
+	for (i = 0 ; i < COS_TRACE_LAT_NTYPES ; i++) {
+		if (!d->lat[i].cnt) continue;
+		printc("Latency %s (cycles):\n", lat_names[i]);
+		hist_print(&d->lat[i]);
+	}
+}
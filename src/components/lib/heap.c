@@ -146,7 +146,7 @@ struct heap *heap_alloc(int max_sz, cmp_fn_t c, update_fn_t u)
 {
 	struct heap *h;
 
-	h = malloc(sizeof(struct heap) + (max_sz * sizeof(void*)) + 1);
+	h = malloc(sizeof(struct heap) + ((max_sz + 1) * sizeof(void*)));
 	if (NULL == h) return NULL;
 
 	h->max_sz = max_sz+1;
@@ -308,6 +308,89 @@ static void test_driver(int amnt)
 	free(es);
 }
 
+/*
+ * Timer-queue benchmark: insert and then cancel (in random order) a
+ * large number of timeouts, as the timed_blk component does, using
+ * the heap, and using the sorted list it previously used (linear
+ * insertion, and linear search for the thread's event to cancel).
+ */
+#define TIMER_BENCH_N 10000
+
+struct tentry {
+	int index;
+	unsigned long long expiration;
+	struct tentry *next, *prev;
+};
+
+int tc(void *a, void *b) { return ((struct tentry*)a)->expiration <= ((struct tentry*)b)->expiration; }
+void tu(void *e, int pos) { ((struct tentry*)e)->index = pos; }
+
+static unsigned long long bench_now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void timer_bench(void)
+{
+	struct tentry *es, head, *t;
+	struct heap *h;
+	int i, *order;
+	unsigned long long s, ins, can;
+
+	es    = malloc(sizeof(struct tentry) * TIMER_BENCH_N);
+	order = malloc(sizeof(int) * TIMER_BENCH_N);
+	h     = heap_alloc(TIMER_BENCH_N, tc, tu);
+	assert(es && order && h);
+	for (i = 0 ; i < TIMER_BENCH_N ; i++) {
+		es[i].expiration = rand();
+		order[i]         = i;
+	}
+	for (i = TIMER_BENCH_N-1 ; i > 0 ; i--) {
+		int j = rand() % (i+1), tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	s = bench_now();
+	for (i = 0 ; i < TIMER_BENCH_N ; i++) assert(!heap_add(h, &es[i]));
+	ins = bench_now() - s;
+	s = bench_now();
+	for (i = 0 ; i < TIMER_BENCH_N ; i++) assert(heap_remove(h, es[order[i]].index) == &es[order[i]]);
+	can = bench_now() - s;
+	assert(heap_size(h) == 0);
+	printd("heap:        %d timers, insert %llu ns/op, cancel %llu ns/op\n",
+	       TIMER_BENCH_N, ins / TIMER_BENCH_N, can / TIMER_BENCH_N);
+
+	head.next = head.prev = &head;
+	s = bench_now();
+	for (i = 0 ; i < TIMER_BENCH_N ; i++) {
+		for (t = head.next ; t != &head && t->expiration <= es[i].expiration ; t = t->next) ;
+		es[i].next = t;
+		es[i].prev = t->prev;
+		t->prev->next = &es[i];
+		t->prev = &es[i];
+	}
+	ins = bench_now() - s;
+	s = bench_now();
+	for (i = 0 ; i < TIMER_BENCH_N ; i++) {
+		for (t = head.next ; t != &es[order[i]] ; t = t->next) assert(t != &head);
+		t->prev->next = t->next;
+		t->next->prev = t->prev;
+	}
+	can = bench_now() - s;
+	assert(head.next == &head);
+	printd("sorted list: %d timers, insert %llu ns/op, cancel %llu ns/op\n",
+	       TIMER_BENCH_N, ins / TIMER_BENCH_N, can / TIMER_BENCH_N);
+
+	heap_destroy(h);
+	free(order);
+	free(es);
+}
+
 #define ITER 50
 #define BOUND 4096
 
@@ -320,6 +403,7 @@ int main(void)
 	for (i = 0 ; i < ITER ; i++) {
 		test_driver(rand() % BOUND);
 	}
+	timer_bench();
 
 	return 0;
 }
@@ -15,9 +15,17 @@
 #include "include/tcap.h"
 #include "include/chal/defs.h"
 #include "include/hw.h"
+#include "include/fpu.h"
+#include "include/trace.h"
 
 #define COS_DEFAULT_RET_CAP 0
 
+#ifdef COS_SINV_COUNTERS
+struct sinv_counters sinv_counters[NUM_CPU];
+u32_t sinv_counters_base[COS_SINV_NCOUNTERS];
+u32_t sinv_counters_next = 1; 	/* 0 is for sinvs that aren't counted */
+#endif
+
 /*
  * TODO: switch to a dedicated TLB flush thread (in a separate
  * protection domain) to do this.
@@ -92,6 +100,14 @@ cos_cap_ipi_handling(void)
 	struct xcore_ring *ring;
 
 	receiver_rings = &IPI_cap_dest[get_cpuid()];
+	/*
+	 * Clear the flag before the scan, so that an entry enqueued
+	 * in a ring we've already scanned sends another IPI.
+	 */
+	if (IPI_COALESCE) {
+		receiver_rings->ipi_pending = 0;
+		cos_mem_fence();
+	}
 
 	/* We need to scan the entire buffer once. */
 	idx = receiver_rings->start;
@@ -366,7 +382,16 @@ cap_cpy(struct captbl *t, capid_t cap_to, capid_t capin_to,
 		if (unlikely(ctto->type != cap_type)) return -EINVAL;
 		if (unlikely(((struct cap_pgtbl *)ctto)->refcnt_flags & CAP_MEM_FROZEN_FLAG)) return -EINVAL;
 		f = pgtbl_lkup_pte(((struct cap_pgtbl *)ctfrom)->pgtbl, capin_from, &flags);
-		if (!f) return -ENOENT;
+		if (!f) {
+			/* Super-pages are aliased whole, between top-level page-tables */
+			if (unlikely(((struct cap_pgtbl *)ctfrom)->lvl || ((struct cap_pgtbl *)ctto)->lvl)) return -EINVAL;
+			f = pgtbl_lkup_super(((struct cap_pgtbl *)ctfrom)->pgtbl, capin_from, &flags);
+			if (!f) return -ENOENT;
+			old_v = *f;
+
+			return pgtbl_mapping_add_super(((struct cap_pgtbl *)ctto)->pgtbl, capin_to,
+						       old_v & PGTBL_SUPER_FRAME_MASK, old_v & PGTBL_FLAG_MASK & ~PGTBL_SUPER);
+		}
 		old_v = *f;
 
 		/* Cannot copy frame, or kernel entry. */
@@ -437,6 +462,117 @@ cap_move(struct captbl *t, capid_t cap_to, capid_t capin_to,
 	return ret;
 }
 
+/*
+ * The kernel address of a user-level array of max scheduler events,
+ * or NULL if it isn't mapped writable in the component, or spans a
+ * page boundary.
+ */
+static inline struct cos_sched_evt *
+arcv_evts_translate(struct comp_info *ci, vaddr_t uevts, int max)
+{
+	vaddr_t kaddr;
+	u32_t   flags;
+	u32_t   req = PGTBL_PRESENT | PGTBL_USER | PGTBL_WRITABLE;
+
+	if (unlikely(max <= 0 || max > (int)COS_SCHED_EVT_BATCH_MAX)) return NULL;
+	if (unlikely(uevts % sizeof(unsigned long))) return NULL;
+	if (unlikely((uevts & ~PGTBL_FRAME_MASK) + max * sizeof(struct cos_sched_evt) > PAGE_SIZE)) return NULL;
+
+	kaddr = pgtbl_translate(ci->pgtbl, uevts, &flags);
+	if (unlikely(!kaddr || (flags & req) != req)) return NULL;
+
+	return (struct cos_sched_evt *)(kaddr + (uevts & ~PGTBL_FRAME_MASK));
+}
+
+/* Deliver a batch of events into a user-level array, and set the return values for the batched rcv */
+static int
+arcv_evts_deliver(struct thread *t, struct comp_info *ci, vaddr_t uevts, int max, struct pt_regs *regs)
+{
+	struct cos_sched_evt *evts = arcv_evts_translate(ci, uevts, max);
+	int n;
+
+	if (unlikely(!evts)) return -EINVAL;
+	n = thd_state_evts_deliver(t, evts, max);
+	__userregs_setretvals(regs, thd_rcvcap_pending(t), n, 0);
+
+	return 0;
+}
+
+/*
+ * The kernel address of a thread's scheduler event ring, or NULL if
+ * it hasn't registered one, its component has since been deactivated
+ * (its page-table might be freed), or the page has been unmapped.
+ */
+static inline struct cos_sched_ring *
+arcv_evt_ring(struct thread *t)
+{
+	struct rcvcap_info *rc = &t->rcvcap;
+	vaddr_t kaddr;
+	u32_t   flags;
+	u32_t   req = PGTBL_PRESENT | PGTBL_USER | PGTBL_WRITABLE;
+
+	if (likely(!rc->evt_ring)) return NULL;
+	if (unlikely(!ltbl_isalive(&t->evt_ring_liveness))) {
+		rc->evt_ring = 0;
+		return NULL;
+	}
+	kaddr = pgtbl_translate(t->evt_ring_pgtbl, rc->evt_ring, &flags);
+	if (unlikely(!kaddr || (flags & req) != req)) return NULL;
+
+	return (struct cos_sched_ring *)kaddr;
+}
+
+/*
+ * Move the events pending for a scheduler into its ring; we're the
+ * ring's only producer.  Events that don't fit remain pending for the
+ * rcv operations.  Returns the number of events in the ring that
+ * the scheduler hasn't yet consumed.
+ */
+static int
+arcv_evt_ring_flush(struct thread *t)
+{
+	struct cos_sched_ring *r = arcv_evt_ring(t);
+	unsigned int head, tail;
+
+	if (!r) return 0;
+	head = *(volatile unsigned int *)&r->c_head;
+	tail = r->p_tail;
+	/* as for CK_RING, the ring holds at most size - 1 events */
+	while (tail - head < COS_SCHED_RING_SZ - 1) {
+		struct cos_sched_evt *e = &r->ring[tail & (COS_SCHED_RING_SZ - 1)];
+
+		if (!thd_state_evt_deliver(t, &e->thd_state, &e->cycles)) break;
+		tail++;
+	}
+	/* the events must be visible before the tail that publishes them */
+	cos_mem_fence();
+	*(volatile unsigned int *)&r->p_tail = tail;
+
+	return tail - head;
+}
+
+static int
+arcv_evt_ring_set(struct thread *t, struct comp_info *ci, vaddr_t uring)
+{
+	struct rcvcap_info *rc = &t->rcvcap;
+
+	if (!uring) {
+		rc->evt_ring = 0;
+		return 0;
+	}
+	if (unlikely(uring & ~PGTBL_FRAME_MASK)) return -EINVAL;
+	/* a copy, as ci can be the per-core invstk cache */
+	rc->evt_ring         = uring;
+	t->evt_ring_pgtbl    = ci->pgtbl;
+	t->evt_ring_liveness = ci->liveness;
+	if (unlikely(!arcv_evt_ring(t))) {
+		rc->evt_ring = 0;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int
 cap_thd_switch(struct pt_regs *regs, struct thread *curr, struct thread  *next,
 	       struct comp_info *ci, struct cos_cpu_local_info *cos_info)
@@ -467,14 +603,15 @@ cap_thd_switch(struct pt_regs *regs, struct thread *curr, struct thread  *next,
 		copy_all_regs(regs, &curr->regs);
 	}
 
-	thd_current_update(next, curr, cos_info);
+	COS_TRACE(COS_TRACE_THD_SWITCH, curr->tid, next->tid);
+	/* ci can be the per-core invstk cache (COS_INVSTK_CACHE) that thd_current_update replaces */
 	if (likely(ci->pgtbl != next_ci->pgtbl)) pgtbl_update(next_ci->pgtbl);
+	thd_current_update(next, curr, cos_info);
 
 	/* Not sure of the trade-off here: Branch cost vs. segment register update */
 	if (next->tls != curr->tls) chal_tls_update(next->tls);
 
-	/* TODO: check FPU */
-	/* fpu_save(thd); */
+	fpu_switch(next);
 	if (next->state & THD_STATE_PREEMPTED) {
 		assert(!(next->state & THD_STATE_RCVING));
 		next->state &= ~THD_STATE_PREEMPTED;
@@ -484,9 +621,19 @@ cap_thd_switch(struct pt_regs *regs, struct thread *curr, struct thread  *next,
 
 		assert(!(next->state & THD_STATE_PREEMPTED));
 		next->state &= ~THD_STATE_RCVING;
-		thd_state_evt_deliver(next, &a, &b);
-		thd_rcvcap_pending_dec(next);
-		__userregs_setretvals(&next->regs, thd_rcvcap_pending(next), a, b);
+		/* events go into the ring first, and the rcv only returns those that don't fit */
+		if (unlikely(next->rcvcap.evt_ring)) arcv_evt_ring_flush(next);
+		if (unlikely(next->rcvcap.evts_batch)) {
+			/* the array was validated when it blocked, but might have been unmapped since */
+			if (arcv_evts_deliver(next, next_ci, next->rcvcap.evts_batch, next->rcvcap.evts_batch_max, &next->regs)) {
+				__userregs_setretvals(&next->regs, -EFAULT, 0, 0);
+			}
+			next->rcvcap.evts_batch = 0;
+		} else {
+			thd_state_evt_deliver(next, &a, &b);
+			thd_rcvcap_pending_dec(next);
+			__userregs_setretvals(&next->regs, thd_rcvcap_pending(next), a, b);
+		}
 	}
 
 	/* if it was suspended for budget expiration, clear it */
@@ -512,6 +659,8 @@ notify_parent(struct thread *rcv_thd)
 		assert(depth < ARCV_NOTIF_DEPTH);
 
 		thd_rcvcap_evt_enqueue(curr_notif, prev_notif);
+		/* publish the event now, so the scheduler needn't rcv to see it */
+		if (unlikely(curr_notif->rcvcap.evt_ring)) arcv_evt_ring_flush(curr_notif);
 		if (!(curr_notif->state & THD_STATE_RCVING)) break;
 
 		prev_notif = curr_notif;
@@ -556,6 +705,7 @@ asnd_process(struct thread *rcv_thd, struct thread *thd, struct tcap *rcv_tcap,
 {
 	struct thread *next;
 
+	COS_TRACE(COS_TRACE_ASND, thd->tid, rcv_thd->tid);
 	thd_rcvcap_pending_inc(rcv_thd);
 	next = notify_process(rcv_thd, thd, rcv_tcap, tcap, tcap_next, yield);
 
@@ -577,6 +727,7 @@ cap_update(struct pt_regs *regs, struct thread *thd_curr, struct thread *thd_nex
 	/* which tcap should we use?  is the current expended? */
 	if (tcap_budgets_update(cos_info, thd_curr, tc_curr, &now)) {
 		assert(!tcap_is_active(tc_curr) && tcap_expended(tc_curr));
+		COS_TRACE(COS_TRACE_TCAP_EXPIRE, thd_curr->tid, 0);
 
 		if (intr_context) tc_next = thd_rcvcap_tcap(thd_next);
 
@@ -635,14 +786,14 @@ cap_thd_op(struct cap_thd *thd_cap, struct thread *thd, struct pt_regs *regs,
 	struct tcap *tcap   = tcap_current(cos_info);
 	int ret;
 
-	if (thd_cap->cpuid != get_cpuid() || thd_cap->cpuid != next->cpuid) return -EINVAL;
+	if (next->cpuid != get_cpuid()) return -EINVAL;
 
 	if (arcv) {
 		struct cap_arcv *arcv_cap;
 		struct thread *rcvt;
 
 		arcv_cap = (struct cap_arcv *)captbl_lkup(ci->captbl, arcv);
-		if (!CAP_TYPECHK_CORE(arcv_cap, CAP_ARCV)) return -EINVAL;
+		if (!CAP_ARCV_TYPECHK_CORE(arcv_cap)) return -EINVAL;
 
 		rcvt = arcv_cap->thd;
 		/* race-condition check for user-level thread switches */
@@ -661,7 +812,7 @@ cap_thd_op(struct cap_thd *thd_cap, struct thread *thd, struct pt_regs *regs,
 		struct cap_tcap *tcap_cap;
 
 		tcap_cap = (struct cap_tcap *)captbl_lkup(ci->captbl, tc);
-		if (!CAP_TYPECHK_CORE(tcap_cap, CAP_TCAP)) return -EINVAL;
+		if (!CAP_TCAP_TYPECHK_CORE(tcap_cap)) return -EINVAL;
 		tcap = tcap_cap->tcap;
 		if (!tcap_rcvcap_thd(tcap)) return -EINVAL;
 	}
@@ -685,6 +836,24 @@ __cap_asnd_to_arcv(struct cap_asnd *asnd)
 	return arcv;
 }
 
+/*
+ * The receiver's thread has migrated away from the core the asnd
+ * records: update the asnd, and forward the notification to the
+ * thread's new core.  Notifications to a thread that is between
+ * cores are dropped.
+ */
+static int
+__cap_asnd_migrated(struct cap_asnd *asnd, struct cap_arcv *arcv)
+{
+	cpuid_t core = arcv->thd->cpuid;
+
+	if (unlikely(core < 0 || core >= NUM_CPU_COS)) return -EAGAIN;
+	asnd->arcv_cpuid = core;
+	if (unlikely(!asnd_ratelimit(asnd)))            return -EAGAIN;
+
+	return cos_cap_send_ipi(core, asnd);
+}
+
 static int
 cap_asnd_op(struct cap_asnd *asnd, struct thread *thd, struct pt_regs *regs,
 	    struct comp_info *ci, struct cos_cpu_local_info *cos_info)
@@ -697,9 +866,13 @@ cap_asnd_op(struct cap_asnd *asnd, struct thread *thd, struct pt_regs *regs,
 
 	assert(asnd->arcv_capid);
 	/* IPI notification to another core */
-	if (asnd->arcv_cpuid != curr_cpu) return cos_cap_send_ipi(asnd->arcv_cpuid, asnd);
+	if (asnd->arcv_cpuid != curr_cpu) {
+		if (unlikely(!asnd_ratelimit(asnd))) return -EAGAIN;
+		return cos_cap_send_ipi(asnd->arcv_cpuid, asnd);
+	}
 	arcv = __cap_asnd_to_arcv(asnd);
 	if (unlikely(!arcv)) return -EINVAL;
+	if (unlikely(arcv->thd->cpuid != curr_cpu)) return __cap_asnd_migrated(asnd, arcv);
 
 	rcv_thd  = arcv->thd;
 	tcap     = tcap_current(cos_info);
@@ -720,26 +893,31 @@ cap_hw_asnd(struct cap_asnd *asnd, struct pt_regs *regs)
 	struct thread *rcv_thd, *next, *thd;
 	struct tcap *rcv_tcap, *tcap, *tcap_next;
 	struct comp_info *ci;
-	unsigned long ip, sp;
 
 	if (!CAP_TYPECHK(asnd, CAP_ASND)) return 1;
 	assert(asnd->arcv_capid);
+	COS_TRACE(COS_TRACE_HW_ASND, asnd - hw_asnd_caps, asnd->arcv_cpuid);
 
 	/* IPI notification to another core */
 	if (asnd->arcv_cpuid != curr_cpu) {
-		cos_cap_send_ipi(asnd->arcv_cpuid, asnd);
+		/* interrupts beyond the asnd's rate are dropped */
+		if (likely(asnd_ratelimit(asnd))) cos_cap_send_ipi(asnd->arcv_cpuid, asnd);
 		return 1;
 	}
 
 	arcv     = __cap_asnd_to_arcv(asnd);
 	if (unlikely(!arcv)) return 1;
+	if (unlikely(arcv->thd->cpuid != curr_cpu)) {
+		__cap_asnd_migrated(asnd, arcv);
+		return 1;
+	}
 
 	cos_info = cos_cpu_local_info();
 	assert(cos_info);
 	thd      = thd_current(cos_info);
 	tcap     = tcap_current(cos_info);
 	assert(thd);
-	ci       = thd_invstk_current(thd, &ip, &sp, cos_info);
+	ci       = thd_invstk_current_comp(thd, cos_info);
 	assert(ci  && ci->captbl);
 	assert(!(thd->state & THD_STATE_PREEMPTED));
 	rcv_thd  = arcv->thd;
@@ -785,15 +963,15 @@ timer_process(struct pt_regs *regs)
 	struct cos_cpu_local_info *cos_info;
 	struct thread    *thd_curr;
 	struct comp_info *comp;
-	unsigned long     ip, sp;
 	cycles_t          now;
 
 	cos_info = cos_cpu_local_info();
 	assert(cos_info);
 	thd_curr = thd_current(cos_info);
 	assert(thd_curr);
-	comp     = thd_invstk_current(thd_curr, &ip, &sp, cos_info);
+	comp     = thd_invstk_current_comp(thd_curr, cos_info);
 	assert(comp);
+	COS_TRACE(COS_TRACE_TIMER, thd_curr->tid, 0);
 
 	return expended_process(regs, thd_curr, comp, cos_info, 1);
 }
@@ -806,11 +984,46 @@ cap_arcv_op(struct cap_arcv *arcv, struct thread *thd, struct pt_regs *regs,
 	struct tcap   *tc_next   = tcap_current(cos_info);
 	struct next_thdinfo *nti = &cos_info->next_ti;
 	tcap_time_t timeout      = TCAP_TIME_NIL;
+	arcv_op_t op             = __userregs_getop(regs);
+	vaddr_t uevts            = 0;
+	int max                  = 0;
+
+	if (unlikely(arcv->thd != thd)) return -EINVAL;
+
+	if (unlikely(op == ARCV_OP_RING_SET)) {
+		int ret = arcv_evt_ring_set(thd, ci, __userregs_get1(regs));
+
+		if (ret) return ret;
+		__userregs_set(regs, 0, __userregs_getsp(regs), __userregs_getip(regs));
+
+		return 0;
+	}
+	/* don't block while there are events in the ring that the scheduler hasn't consumed */
+	if (unlikely(thd->rcvcap.evt_ring) && arcv_evt_ring_flush(thd)) {
+		__userregs_set(regs, 0, __userregs_getsp(regs), __userregs_getip(regs));
+		__userregs_setretvals(regs, thd_rcvcap_pending(thd), 0, 0);
 
-	if (unlikely(arcv->thd != thd || arcv->cpuid != get_cpuid())) return -EINVAL;
+		return 0;
+	}
 
-	/* deliver pending notifications? */
-	if (thd_rcvcap_pending(thd)) {
+	/*
+	 * Batched rcv: all pending events (up to the array's size)
+	 * are delivered in a single call, or if there are none,
+	 * delivered into the array when we're next activated.
+	 */
+	if (op == ARCV_OP_RCV_BATCH) {
+		uevts = __userregs_get1(regs);
+		max   = __userregs_get2(regs);
+
+		if (unlikely(!arcv_evts_translate(ci, uevts, max))) return -EINVAL;
+		if (thd_rcvcap_pending(thd)) {
+			__userregs_set(regs, 0, __userregs_getsp(regs), __userregs_getip(regs));
+			return arcv_evts_deliver(thd, ci, uevts, max, regs);
+		}
+		/* no events if we don't end up blocking */
+		__userregs_setretvals(regs, 0, 0, 0);
+	} else if (thd_rcvcap_pending(thd)) {
+		/* deliver pending notifications */
 		unsigned long a = 0, b = 0;
 
 		__userregs_set(regs, 0, __userregs_getsp(regs), __userregs_getip(regs));
@@ -821,7 +1034,8 @@ cap_arcv_op(struct cap_arcv *arcv, struct thread *thd, struct pt_regs *regs,
 		return 0;
 	}
 
-	next = notify_parent(thd);
+	/* the notification is sent once we know if we block, as the event reports it */
+	next = arcv_thd_notif(thd);
 	/* if preempted/awoken thread is waiting, switch to that */
 	if (nti->thd) {
 		assert(nti->tc);
@@ -850,7 +1064,11 @@ cap_arcv_op(struct cap_arcv *arcv, struct thread *thd, struct pt_regs *regs,
 	if (likely(thd != next)) {
 		assert(!(thd->state & THD_STATE_PREEMPTED));
 		thd->state |= THD_STATE_RCVING;
+		/* events are delivered into the array on activation (if a batched rcv) */
+		thd->rcvcap.evts_batch     = uevts;
+		thd->rcvcap.evts_batch_max = max;
 	}
+	notify_parent(thd);
 
 	return cap_switch(regs, thd, next, tc_next, timeout, ci, cos_info);
 }
@@ -864,8 +1082,11 @@ cap_introspect(struct captbl *ct, capid_t capid, u32_t op, unsigned long *retval
 
 	switch(ch->type) {
 	case CAP_THD: return thd_introspect(((struct cap_thd*)ch)->t, op, retval);
+	case CAP_SINV: return sinv_introspect((struct cap_sinv *)ch, op, retval);
+	/* the trace rings' layout is fixed (cos_trace.h) */
+	case CAP_TRACE: return -EINVAL;
+	default:        return -EINVAL;
 	}
-	return -EINVAL;
 }
 
 #define ENABLE_KERNEL_PRINT
@@ -873,6 +1094,53 @@ cap_introspect(struct captbl *ct, capid_t capid, u32_t op, unsigned long *retval
 static int
 composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch);
 
+/*
+ * Execute a vector of captbl and pgtbl operations from a user-level
+ * array, in order, setting the return value of each, and stopping at
+ * the first that fails.  Returns the number of operations that
+ * succeeded (thus the index of the failure), or a negative error if
+ * the array isn't valid.
+ */
+static int
+cap_op_vector(struct comp_info *ci, vaddr_t uops, int nops)
+{
+	struct cos_captbl_op *ops;
+	struct pt_regs        r;
+	vaddr_t               kaddr;
+	u32_t                 flags;
+	u32_t                 req = PGTBL_PRESENT | PGTBL_USER | PGTBL_WRITABLE;
+	int                   i;
+
+	if (unlikely(nops <= 0 || nops > (int)COS_CAPTBL_OP_VECTOR_MAX)) return -EINVAL;
+	if (unlikely(uops % sizeof(unsigned long))) return -EINVAL;
+	if (unlikely((uops & ~PGTBL_FRAME_MASK) + nops * sizeof(struct cos_captbl_op) > PAGE_SIZE)) return -EINVAL;
+	kaddr = pgtbl_translate(ci->pgtbl, uops, &flags);
+	if (unlikely(!kaddr || (flags & req) != req)) return -EINVAL;
+	ops = (struct cos_captbl_op *)(kaddr + (uops & ~PGTBL_FRAME_MASK));
+
+	for (i = 0 ; i < nops ; i++) {
+		struct cos_captbl_op  o;
+		struct cap_header    *ch;
+		int thd_switch = 0, ret;
+
+		/* other threads can write the ops, so only our copy is checked and used */
+		o  = *(volatile struct cos_captbl_op *)&ops[i];
+		ch = captbl_lkup(ci->captbl, o.cap);
+		/* only the resource-table operations, which never switch threads */
+		if (unlikely(!ch || (ch->type != CAP_CAPTBL && ch->type != CAP_PGTBL) || o.op == CAPTBL_OP_VECTOR)) {
+			ops[i].ret = -EINVAL;
+			break;
+		}
+		__userregs_setinv(&r, o.cap, o.op, o.args[0], o.args[1], o.args[2], o.args[3]);
+		ret        = composite_syscall_slowpath(&r, &thd_switch);
+		ops[i].ret = ret;
+		assert(!thd_switch);
+		if (ret < 0) break;
+	}
+
+	return i;
+}
+
 COS_SYSCALL __attribute__((section("__ipc_entry")))
 int
 composite_syscall_handler(struct pt_regs *regs)
@@ -881,7 +1149,6 @@ composite_syscall_handler(struct pt_regs *regs)
 	struct comp_info *ci;
 	struct thread *thd;
 	capid_t cap;
-	unsigned long ip, sp;
 
 	/*
 	 * We lookup this struct (which is on stack) only once, and
@@ -912,7 +1179,7 @@ composite_syscall_handler(struct pt_regs *regs)
 		return 0;
 	}
 
-	ci = thd_invstk_current(thd, &ip, &sp, cos_info);
+	ci = thd_invstk_current_comp(thd, cos_info);
 	assert(ci && ci->captbl);
 
 	/*
@@ -948,6 +1215,9 @@ composite_syscall_handler(struct pt_regs *regs)
 		ret = cap_arcv_op((struct cap_arcv *)ch, thd, regs, ci, cos_info);
 		if (ret < 0) cos_throw(done, ret);
 		return ret;
+	default:
+		/* the resource-table, hw and trace capabilities */
+		break;
 	}
 
 	/* slowpath restbl (captbl and pgtbl) operations */
@@ -981,7 +1251,6 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 	syscall_op_t op;
 	int ret = -ENOENT;
 	struct cos_cpu_local_info *cos_info = cos_cpu_local_info();
-	unsigned long ip, sp;
 
 	/*
 	 * These variables are:
@@ -998,7 +1267,7 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 	cap = __userregs_getcap(regs);
 	capin = __userregs_get1(regs);
 
-	ci = thd_invstk_current(thd, &ip, &sp, cos_info);
+	ci = thd_invstk_current_comp(thd, cos_info);
 	assert(ci && ci->captbl);
 	ct = ci->captbl;
 
@@ -1175,6 +1444,19 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 			if (thd_tls_set(op_cap->captbl, thd_cap, tlsaddr, thd)) cos_throw(err, -EINVAL);
 			break;
 		}
+		case CAPTBL_OP_THDMIGRATE:
+		{
+			capid_t thd_cap  = __userregs_get1(regs);
+			cpuid_t core     = __userregs_get2(regs);
+			capid_t arcv_cap = __userregs_get3(regs);
+			livenessid_t lid = __userregs_get4(regs);
+
+			assert(op_cap->captbl);
+			/* detach from this core, or attach a thread migrating to it */
+			if (core != get_cpuid()) ret = thd_migrate_out(op_cap->captbl, thd_cap, core, lid, cos_info);
+			else                     ret = thd_migrate_in(op_cap->captbl, thd_cap, arcv_cap);
+			break;
+		}
 		case CAPTBL_OP_THDDEACTIVATE_ROOT:
 		{
 			livenessid_t lid      = __userregs_get2(regs);
@@ -1239,8 +1521,11 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 		{
 			capid_t rcv_captbl = __userregs_get2(regs);
 			capid_t rcv_cap    = __userregs_get3(regs);
+			/* the rate-limit: the budget of notifications, and its period in microseconds */
+			u32_t   budget     = __userregs_get4(regs) >> 16;
+			u32_t   period     = __userregs_get4(regs) & 0xFFFF;
 
-			ret = asnd_activate(ct, cap, capin, rcv_captbl, rcv_cap, 0, 0);
+			ret = asnd_activate(ct, cap, capin, rcv_captbl, rcv_cap, budget, period);
 			break;
 		}
 		case CAPTBL_OP_ASNDDEACTIVATE:
@@ -1322,6 +1607,14 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 			ret = hw_deactivate(op_cap, capin, lid);
 			break;
 		}
+		case CAPTBL_OP_VECTOR:
+		{
+			vaddr_t uops = __userregs_get1(regs);
+			int     nops = __userregs_get2(regs);
+
+			ret = cap_op_vector(ci, uops, nops);
+			break;
+		}
 		default: goto err;
 		}
 		break;
@@ -1387,6 +1680,16 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 
 			break;
 		}
+		case CAPTBL_OP_MEMACTIVATE_SUPER:
+		{
+			capid_t frame_cap = __userregs_get1(regs);
+			capid_t dest_pt   = __userregs_get2(regs);
+			vaddr_t vaddr     = __userregs_get3(regs);
+
+			ret = cap_memactivate_super(ct, (struct cap_pgtbl *)ch, frame_cap, dest_pt, vaddr);
+
+			break;
+		}
 		case CAPTBL_OP_MEMDEACTIVATE:
 		{
 			vaddr_t addr      = __userregs_get1(regs);
@@ -1478,7 +1781,7 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 			struct tcap     *tc;
 
 			rcv = (struct cap_arcv *)captbl_lkup(ci->captbl, tcpdst);
-			if (!CAP_TYPECHK_CORE(rcv, CAP_ARCV)) cos_throw(err, -EINVAL);
+			if (!CAP_ARCV_TYPECHK_CORE(rcv)) cos_throw(err, -EINVAL);
 
 			rthd = rcv->thd;
 			tc = rthd->rcvcap.rcvcap_tcap;
@@ -1550,7 +1853,7 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 			struct cap_tcap *tcaprm;
 
 			tcaprm = (struct cap_tcap *)captbl_lkup(ci->captbl, tcaprem);
-			if (!CAP_TYPECHK_CORE(tcaprm, CAP_TCAP)) cos_throw(err, -EINVAL);
+			if (!CAP_TCAP_TYPECHK_CORE(tcaprm)) cos_throw(err, -EINVAL);
 
 			ret = tcap_merge(tcapdst->tcap, tcaprm->tcap);
 			if (unlikely(ret)) cos_throw(err, -ENOENT);
@@ -1568,7 +1871,7 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 			tcap_res_t budget         = __userregs_get4(regs);
 
 			thdwkup = (struct cap_thd *)captbl_lkup(ci->captbl, thdcap);
-			if (!CAP_TYPECHK_CORE(thdwkup, CAP_THD)) return -EINVAL;
+			if (!CAP_THD_TYPECHK_CORE(thdwkup)) return -EINVAL;
 
 			ret = tcap_wakeup(tcapwkup->tcap, prio, budget, thdwkup->t, cos_info);
 			if (unlikely(ret)) cos_throw(err, -EINVAL);
@@ -1642,6 +1945,26 @@ composite_syscall_slowpath(struct pt_regs *regs, int *thd_switch)
 		}
 		break;
 	}
+	case CAP_TRACE:
+	{
+		switch(op) {
+		case CAPTBL_OP_TRACE_MAP:
+		{
+			capid_t ptcap = __userregs_get1(regs);
+			vaddr_t va    = __userregs_get2(regs);
+			cpuid_t core  = __userregs_get3(regs);
+			struct cap_pgtbl *ptc;
+
+			ptc = (struct cap_pgtbl *)captbl_lkup(ci->captbl, ptcap);
+			if (!CAP_TYPECHK(ptc, CAP_PGTBL)) cos_throw(err, -EINVAL);
+
+			ret = trace_map(ptc->pgtbl, core, va);
+			break;
+		}
+		default: goto err;
+		}
+		break;
+	}
 	default: break;
 	}
 err:
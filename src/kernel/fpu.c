@@ -1,4 +1,36 @@
 #include "include/fpu.h"
 
 PERCPU_VAR(fpu_disabled);
-PERCPU_VAR(fpu_last_used);
+PERCPU_VAR(fpu_owner);
+
+u32_t          fpu_xfeatures;
+struct cos_fpu fpu_init_state;
+
+/*
+ * The thread is being freed, or migrated to another core: it can't
+ * remain the owner of its core's FPU.  On its own core, the state is
+ * saved so that it is restored wherever the thread next uses the FPU.
+ * From another core, the registers can't be saved, but the thread is
+ * being freed, so the state is discarded.
+ */
+void
+fpu_thread_release(struct thread *thd)
+{
+#ifdef FPU_ENABLED
+	struct thread **owner;
+
+	if (thd->cpuid < 0 || thd->cpuid >= NUM_CPU) return;
+	owner = PERCPU_GET_TARGET(fpu_owner, thd->cpuid);
+	if (*owner != thd) return;
+
+	if (thd->cpuid != get_cpuid()) {
+		cos_cas((unsigned long *)owner, (unsigned long)thd, 0);
+		return;
+	}
+	fpu_enable();
+	fpu_state_save(&thd->fpu);
+	thd->fpu.saved_fpu = 1;
+	*owner             = NULL;
+	fpu_disable();
+#endif
+}
@@ -128,6 +128,9 @@ cap_cons(struct captbl *t, capid_t capto, capid_t capsub, capid_t expandid)
 		if (!intern)                  return -ENOENT;
 		old_pte = *intern;
 		if (pgtbl_ispresent(old_pte)) return -EPERM;
+		/* the entry might have been a super-page */
+		ret = pgtbl_quie_check(old_pte);
+		if (ret) return ret;
 
 		old_v = refcnt_flags = ((struct cap_pgtbl *)ctsub)->refcnt_flags;
 		if (refcnt_flags & CAP_MEM_FROZEN_FLAG) return -EINVAL;
@@ -188,6 +191,8 @@ cap_decons(struct captbl *t, capid_t cap, capid_t capsub, capid_t pruneid, unsig
 	old_v = *intern;
 
 	if (old_v == 0) return 0; /* return an error here? */
+	/* (removed) super-pages are not pgtbl nodes, see MEMDEACTIVATE */
+	if (head->type == CAP_PGTBL && (old_v & (PGTBL_SUPER|PGTBL_QUIESCENCE))) return -EPERM;
 	/* commit; note that 0 is "no entry" in both pgtbl and captbl */
 	if (cos_cas(intern, old_v, 0) != CAS_SUCCESS) return -ECASFAIL;
 
@@ -1,24 +1,54 @@
 #ifndef FPU_H
 #define FPU_H
 
-#include "thread.h"
+#include "thd.h"
+#include "per_cpu.h"
+
+/*
+ * Lazy FPU (x87/SSE/AVX) state switching.  Each core has an owner:
+ * the thread whose FPU state is in its registers.  A thread switch
+ * only enables the FPU (clears CR0.TS) when switching to the owner,
+ * and disables it otherwise, so switches between threads that don't
+ * use the FPU never save or restore its state.  When a thread that
+ * isn't the owner uses the FPU, it faults (#NM), and
+ * fpu_disabled_exception_handler saves the owner's state, restores
+ * its state, and makes it the owner.
+ *
+ * With XSAVE, the state includes the extended (AVX) registers, as
+ * much of it as fits in struct cos_fpu.
+ */
 
 #define ENABLE            1
 #define DISABLE           0
-#define FPU_DISABLED_MASK 0x8
-#define FXSR              (1<<24)
+#define FPU_DISABLED_MASK 0x8 	/* CR0.TS */
+#define FPU_CR0_MP        0x2
+#define FPU_CR0_EM        0x4
+#define FPU_CR4_OSFXSR    (1<<9)
+#define FPU_CR4_OSXMMEXCPT (1<<10)
+#define FPU_CR4_OSXSAVE   (1<<18)
+#define FXSR              (1<<24) 	/* cpuid(1).edx */
+#define XSAVE             (1<<26) 	/* cpuid(1).ecx */
+#define FPU_XSTATE_X87    (1<<0)
+#define FPU_XSTATE_SSE    (1<<1)
+#define FPU_XSTATE_AVX    (1<<2)
+#define FPU_MXCSR_DEFAULT 0x1f80
 
 PERCPU_DECL(int, fpu_disabled);
 PERCPU_EXTERN(fpu_disabled);
 
-PERCPU_DECL(struct thread *, fpu_last_used);
-PERCPU_EXTERN(fpu_last_used);
+PERCPU_DECL(struct thread *, fpu_owner);
+PERCPU_EXTERN(fpu_owner);
+
+/* the XSAVE state components saved, 0 if fxsave is used */
+extern u32_t fpu_xfeatures;
+/* the state a thread starts with, saved after initialization */
+extern struct cos_fpu fpu_init_state;
 
 /* fucntions called outside */
 static inline int fpu_init(void);
 static inline int fpu_disabled_exception_handler(void);
 static inline void fpu_thread_init(struct thread *thd);
-static inline int fpu_save(struct thread *next);
+static inline void fpu_switch(struct thread *next);
 
 /* packed functions for FPU operation */
 static inline void fpu_enable(void);
@@ -27,228 +57,240 @@ static inline int fpu_is_disabled(void);
 static inline int fpu_thread_uses_fp(struct thread *thd);
 
 /* packed low level (assemmbly) functions */
-static inline void fxsave(struct thread*);
-static inline void fxrstor(struct thread*);
+static inline void fpu_state_save(struct cos_fpu *f);
+static inline void fpu_state_restore(struct cos_fpu *f);
 static inline unsigned long fpu_read_cr0(void);
 static inline void fpu_set(int);
-static inline int fpu_get_info(void);
+static inline void fpu_cpuid(u32_t leaf, u32_t subleaf, u32_t *a, u32_t *b, u32_t *c, u32_t *d);
 static inline int fpu_check_fxsr(void);
 
 #ifdef FPU_ENABLED
+static inline void
+fpu_cpuid(u32_t leaf, u32_t subleaf, u32_t *a, u32_t *b, u32_t *c, u32_t *d)
+{ asm volatile("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "0" (leaf), "2" (subleaf)); }
+
 static inline int
-fpu_get_info(void)
+fpu_check_fxsr(void)
 {
-        int cpu_info;
+	u32_t a, b, c, d;
+
+	fpu_cpuid(1, 0, &a, &b, &c, &d);
 
-        asm volatile("mov $1, %%eax\n\t"
-                     "cpuid\n\t"
-                     "movl %%edx, %0"
-                     : "=m" (cpu_info) 
-		     : 
-		     : "eax", "ebx", "ecx", "edx");
+	return (d & FXSR) != 0;
+}
 
-	/* printk("cpu %d cpuid_edx %x\n", get_cpuid(), cpu_info); */
+static inline unsigned long
+fpu_read_cr4(void)
+{
+	unsigned long val;
+	asm volatile("mov %%cr4, %0" : "=r" (val));
 
-        return cpu_info;
+	return val;
 }
 
-static inline int
-fpu_check_fxsr(void)
+static inline void
+fpu_write_cr4(unsigned long val)
+{ asm volatile("mov %0, %%cr4" : : "r" (val)); }
+
+static inline void
+fpu_xsetbv(u32_t features)
+{ asm volatile("xsetbv" : : "c" (0), "a" (features), "d" (0)); }
+
+/*
+ * Enable XSAVE for the x87, SSE and, if the CPU has it and its state
+ * fits in struct cos_fpu, AVX state.  Returns the enabled state
+ * components, or 0 if the CPU doesn't support XSAVE.
+ */
+static inline u32_t
+fpu_xsave_init(void)
 {
-        int cpu_info;
-        int fxsr_status;
-	
-	cpu_info = fpu_get_info();
-	/* fxsr is the 25th bit (start from bit 1) in EDX. So FXSR is 1<<24. */
-        fxsr_status = ((cpu_info & FXSR) != 0) ? 1 : 0 ;
-
-        return fxsr_status;
+	u32_t a, b, c, d, features;
+
+	fpu_cpuid(1, 0, &a, &b, &c, &d);
+	if (!(c & XSAVE)) return 0;
+
+	fpu_write_cr4(fpu_read_cr4() | FPU_CR4_OSXSAVE);
+	fpu_cpuid(0xd, 0, &a, &b, &c, &d);
+	features = FPU_XSTATE_X87 | FPU_XSTATE_SSE | (a & FPU_XSTATE_AVX);
+	fpu_xsetbv(features);
+
+	/* ebx is the size of the area for the enabled components */
+	fpu_cpuid(0xd, 0, &a, &b, &c, &d);
+	if (b > FPU_XSAVE_AREA_SZ) {
+		features = FPU_XSTATE_X87 | FPU_XSTATE_SSE;
+		fpu_xsetbv(features);
+	}
+
+	return features;
 }
 
 static inline int
 fpu_init(void)
 {
-#if FPU_SUPPORT_FXSR > 0
-	int fxsr = fpu_check_fxsr();
+	unsigned long cr0;
+	u32_t mxcsr = FPU_MXCSR_DEFAULT;
 
-	if (fxsr == 0) {
+#if FPU_SUPPORT_FXSR > 0
+	if (!fpu_check_fxsr()) {
 		printk("Core %d: FPU doesn't support fxsave/fxrstor. Need to use fsave/frstr instead. Check FPU_SUPPORT_FXSR in cos_config.\n", get_cpuid());
 		return -1;
 	}
+	fpu_write_cr4(fpu_read_cr4() | FPU_CR4_OSFXSR | FPU_CR4_OSXMMEXCPT);
+	fpu_xfeatures = fpu_xsave_init();
 #endif
+	/* no emulation, and wait/fwait also fault with TS set */
+	cr0 = (fpu_read_cr0() & ~FPU_CR0_EM) | FPU_CR0_MP;
+	asm volatile("mov %0, %%cr0" : : "r" (cr0));
 
-        fpu_set(DISABLE);
-	*PERCPU_GET(fpu_disabled) = 1;
-	*PERCPU_GET(fpu_last_used) = NULL;
+	fpu_set(ENABLE);
+	asm volatile("fninit");
+#if FPU_SUPPORT_FXSR > 0
+	asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+#endif
+	fpu_state_save(&fpu_init_state);
 
-        /* printk("fpu_init on core %d\n", get_cpuid()); */
+	fpu_set(DISABLE);
+	*PERCPU_GET(fpu_disabled) = 1;
+	*PERCPU_GET(fpu_owner)    = NULL;
 
-        return 0;
+	return 0;
 }
 
-static inline int 
+/*
+ * The current thread used the FPU while it was disabled: it isn't
+ * the owner, so move the state of the owner out of the registers,
+ * and that of the current thread in.
+ */
+static inline int
 fpu_disabled_exception_handler(void)
 {
-        struct thread *curr_thd;
+	struct thread **owner = PERCPU_GET(fpu_owner);
+	struct thread  *curr_thd;
 
-        if ((curr_thd = cos_get_curr_thd()) == NULL) return 1;
+	if ((curr_thd = cos_get_curr_thd()) == NULL) return 1;
 
-        assert(fpu_is_disabled());
+	assert(fpu_is_disabled());
+	fpu_enable();
+	if (*owner == curr_thd) return 1;
 
-        curr_thd->fpu.status = 1;
-        fpu_save(curr_thd);
+	if (*owner) {
+		fpu_state_save(&(*owner)->fpu);
+		(*owner)->fpu.saved_fpu = 1;
+	}
+	/* a thread's first use starts from the initial state, not the last owner's */
+	fpu_state_restore(curr_thd->fpu.saved_fpu ? &curr_thd->fpu : &fpu_init_state);
+	curr_thd->fpu.status = 1;
+	*owner               = curr_thd;
 
-        return 1;
+	return 1;
 }
 
 static inline void
 fpu_thread_init(struct thread *thd)
 {
-        thd->fpu.status = 0;
-        thd->fpu.saved_fpu = 0;
-
-        return;
+	thd->fpu.status    = 0;
+	thd->fpu.saved_fpu = 0;
 }
 
-static inline int
-fpu_save(struct thread *next)
+/* Called on each thread switch: only the owner runs with the FPU enabled */
+static inline void
+fpu_switch(struct thread *next)
 {
-	struct thread **last_used = PERCPU_GET(fpu_last_used);
-        /* if next thread doesn't use fpu, then we just disable the fpu */
-	if (!fpu_thread_uses_fp(next)) {
-                fpu_disable();
-                return 0;
-        }
-
-        /*
-         * next thread uses fpu
-         * if no thread used fpu before, then we set next thread as the fpu_last_used
-         */
-        if (unlikely(*last_used == NULL)) {
-                fpu_enable();
-		*last_used = next;
-                return 0;
-        }
-
-        /*
-         * next thread uses fpu
-         * fpu_last_used exists
-         * if fpu_last_used == next, then we simply re-enable the fpu for the thread
-         */
-        if (*last_used == next) {
-                fpu_enable();
-                return 0;
-        }
-
-        /*
-         * next thread uses fpu
-         * fpu_last_used exists
-         * if fpu_last_used != next, then we save current fpu states to fpu_last_used, restore next thread's fpu state
-         */
-        fpu_enable();
-        fxsave(*last_used);
-        if (next->fpu.saved_fpu) fxrstor(next);
-	*last_used = next;
-
-        return 0;
+	if (likely(*PERCPU_GET(fpu_owner) != next)) fpu_disable();
+	else                                          fpu_enable();
 }
 
 static inline void
 fpu_enable(void)
 {
-        if (!fpu_is_disabled()) return;
+	int *disabled = PERCPU_GET(fpu_disabled);
 
+	if (!*disabled) return;
 	fpu_set(ENABLE);
-	*PERCPU_GET(fpu_disabled) = 0;
-
-        return;
+	*disabled = 0;
 }
 
 static inline void
 fpu_disable(void)
 {
-        if (fpu_is_disabled()) return;
-
-        fpu_set(DISABLE);
-	*PERCPU_GET(fpu_disabled) = 1;
+	int *disabled = PERCPU_GET(fpu_disabled);
 
-        return;
+	if (*disabled) return;
+	fpu_set(DISABLE);
+	*disabled = 1;
 }
 
 static inline int
 fpu_is_disabled(void)
 {
 	int *disabled = PERCPU_GET(fpu_disabled);
-        assert(fpu_read_cr0() & FPU_DISABLED_MASK ? *disabled : !*disabled);
+	assert(fpu_read_cr0() & FPU_DISABLED_MASK ? *disabled : !*disabled);
 
-        return *disabled;
+	return *disabled;
 }
 
 static inline int
 fpu_thread_uses_fp(struct thread *thd)
-{
-        return thd->fpu.status;
-}
+{ return thd->fpu.status; }
 
 static inline unsigned long
 fpu_read_cr0(void)
 {
-        unsigned long val;
-        asm volatile("mov %%cr0, %0" : "=r" (val));
+	unsigned long val;
+	asm volatile("mov %%cr0, %0" : "=r" (val));
 
-        return val;
+	return val;
 }
 
 static inline void
 fpu_set(int status)
 {
-        unsigned long val, cr0;
-
-        cr0 = fpu_read_cr0();
-        val = status ?  (cr0 & ~FPU_DISABLED_MASK) : (cr0 | FPU_DISABLED_MASK); // ENABLE(status == 1) : DISABLE(status == 0)
-        asm volatile("mov %0, %%cr0" : : "r" (val));
+	unsigned long cr0;
 
-        return;
+	if (status) {
+		asm volatile("clts");
+		return;
+	}
+	cr0 = fpu_read_cr0() | FPU_DISABLED_MASK;
+	asm volatile("mov %0, %%cr0" : : "r" (cr0));
 }
 
 static inline void
-fxsave(struct thread *thd)
+fpu_state_save(struct cos_fpu *f)
 {
 #if FPU_SUPPORT_FXSR > 0
-	asm volatile("fxsave %0" : "=m" (thd->fpu));
+	if (fpu_xfeatures) asm volatile("xsave %0" : "+m" (*f) : "a" (fpu_xfeatures), "d" (0));
+	else               asm volatile("fxsave %0" : "=m" (*f));
 #else
-	asm volatile("fsave %0" : "=m" (thd->fpu));
+	asm volatile("fsave %0" : "=m" (*f));
 #endif
-        thd->fpu.saved_fpu = 1;
-
-        return;
 }
 
 static inline void
-fxrstor(struct thread *thd)
+fpu_state_restore(struct cos_fpu *f)
 {
 #if FPU_SUPPORT_FXSR > 0
-	asm volatile("fxrstor %0" : : "m" (thd->fpu));
+	if (fpu_xfeatures) asm volatile("xrstor %0" : : "m" (*f), "a" (fpu_xfeatures), "d" (0));
+	else               asm volatile("fxrstor %0" : : "m" (*f));
 #else
-	asm volatile("frstor %0" : : "m" (thd->fpu));
+	asm volatile("frstor %0" : : "m" (*f));
 #endif
-        return;
 }
 #else
-/* if FPU_DISABLED is not defined, then we use these dummy functions */
+/* if FPU_ENABLED is not defined, then we use these dummy functions */
 static inline int fpu_init(void) { return 0;}
 static inline int fpu_disabled_exception_handler(void) { return 1; }
 static inline void fpu_thread_init(struct thread *thd) { return; }
-static inline int fpu_save(struct thread *next) { return 0; }
+static inline void fpu_switch(struct thread *next) { return; }
 static inline void fpu_enable(void) { return; }
 static inline void fpu_disable(void) { return; }
 static inline int fpu_is_disabled(void){ return 1; }
 static inline int fpu_thread_uses_fp(struct thread *thd) { return 0; }
-static inline void fxsave(struct thread *thd) { return; }
-static inline void fxrstor(struct thread *thd) { return; }
+static inline void fpu_state_save(struct cos_fpu *f) { return; }
+static inline void fpu_state_restore(struct cos_fpu *f) { return; }
 static inline unsigned long fpu_read_cr0(void) { return 0; };
 static inline void fpu_set(int status) { return; }
-static inline int fpu_get_info(void) { return 0; }
+static inline void fpu_cpuid(u32_t leaf, u32_t subleaf, u32_t *a, u32_t *b, u32_t *c, u32_t *d) { return; }
 static inline int fpu_check_fxsr(void) { return 0; }
 #endif
 
@@ -1,6 +1,15 @@
 #ifndef FPU_REGS_H
 #define FPU_REGS_H
 
+/* legacy (fxsave) region, XSAVE header, and AVX state */
+#define FPU_XSAVE_AREA_SZ (512 + 64 + 256)
+
+/* XSAVE needs its area 64 byte aligned, fxsave only 16 */
+#ifdef FPU_ENABLED
+#define FPU_ALIGN 64
+#else
+#define FPU_ALIGN 16
+#endif
 
 struct cos_fpu {
 #ifdef FPU_ENABLED
@@ -35,9 +44,14 @@ struct cos_fpu {
                 u32_t             padding1[12];
                 u32_t             sw_reserved[12];
         };
-        int status;
-        int saved_fpu;
+
+        /* only written with XSAVE (see fpu_xfeatures) */
+        u8_t                      xsave_hdr[64];
+        u8_t                      xsave_ext[FPU_XSAVE_AREA_SZ - 512 - 64];
+
+        int status;     /* has the thread used the FPU? */
+        int saved_fpu;  /* is its state saved here (rather than in the registers, or not at all)? */
 #endif
-} __attribute__((aligned(16)));
+} __attribute__((aligned(FPU_ALIGN)));
 
 #endif
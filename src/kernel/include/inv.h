@@ -15,11 +15,16 @@
 #include "component.h"
 #include "thd.h"
 #include "chal/call_convention.h"
+#include "trace.h"
+#include "fpu.h"
 
 struct cap_sinv {
 	struct cap_header h;
 	struct comp_info comp_info;
 	vaddr_t entry_addr;
+#ifdef COS_SINV_COUNTERS
+	u16_t cntid; 		/* index of its invocation counters */
+#endif
 } __attribute__((packed));
 
 struct cap_sret {
@@ -33,10 +38,9 @@ struct cap_asnd {
 	u32_t arcv_capid, arcv_epoch; /* identify receiver */
 	struct comp_info comp_info;
 
-	/* deferrable server to rate-limit IPIs */
+	/* deferrable server to rate-limit IPIs (period in cycles, 0 if not rate-limited) */
 	u32_t budget, period, replenish_amnt;
-	/* Following not used for now. */
-	/* u64_t replenish_time; 	   /\* time of last replenishment *\/ */
+	u64_t replenish_time; 	   /* time of last replenishment */
 } __attribute__((packed));
 
 struct cap_arcv {
@@ -49,6 +53,83 @@ struct cap_arcv {
 	u8_t depth;
 } __attribute__((packed));
 
+/* an arcv is on the core of its thread, which can migrate (see thd_migrate_out) */
+#define CAP_ARCV_TYPECHK_CORE(c) (CAP_TYPECHK((c), CAP_ARCV) && (c)->thd->cpuid == get_cpuid())
+
+/*
+ * Invocation counts of sinv capabilities (COS_SINV_COUNTERS).  Each
+ * core only increments its own counters, so sinv_call needs no
+ * atomic instructions, and reads sum over the cores.  A reset records
+ * the current sum rather than writing the other cores' counters, and
+ * reads subtract it.
+ *
+ * The index of a cap's counters doesn't fit in the 32 bytes of a
+ * sinv cap, so with the counters, sinv caps take 64 bytes (see
+ * __captbl_cap2sz).  Indexes are allocated on activation and are not
+ * reused; once they run out, new sinv caps count into index 0, which
+ * isn't read.
+ */
+#ifndef COS_SINV_NCOUNTERS
+#define COS_SINV_NCOUNTERS 1024
+#endif
+
+#ifdef COS_SINV_COUNTERS
+struct sinv_counters {
+	u32_t cnt[COS_SINV_NCOUNTERS];
+} CACHE_ALIGNED;
+
+extern struct sinv_counters sinv_counters[NUM_CPU];
+extern u32_t sinv_counters_base[COS_SINV_NCOUNTERS];
+extern u32_t sinv_counters_next;
+
+static inline u16_t
+sinv_cntid_alloc(void)
+{
+	u32_t id;
+
+	if (sinv_counters_next >= COS_SINV_NCOUNTERS) return 0;
+	id = cos_faa((int *)&sinv_counters_next, 1);
+
+	return id < COS_SINV_NCOUNTERS ? id : 0;
+}
+
+static inline void
+sinv_count(struct cap_sinv *s, struct cos_cpu_local_info *cos_info)
+{
+	u16_t id = s->cntid;
+
+	if (likely(id < COS_SINV_NCOUNTERS)) sinv_counters[cos_info->cpuid].cnt[id]++;
+}
+#else
+static inline void sinv_count(struct cap_sinv *s, struct cos_cpu_local_info *cos_info) { return; }
+#endif
+
+static inline int
+sinv_introspect(struct cap_sinv *s, unsigned long op, unsigned long *retval)
+{
+#ifdef COS_SINV_COUNTERS
+	u16_t id  = s->cntid;
+	u32_t sum = 0, n;
+	int   i;
+
+	if (!id || id >= COS_SINV_NCOUNTERS) return -ENOENT;
+	for (i = 0 ; i < NUM_CPU ; i++) sum += sinv_counters[i].cnt[id];
+	n = sum - sinv_counters_base[id];
+
+	switch (op) {
+	case SINV_GET_INVOCATIONS:                                          break;
+	case SINV_GET_INVOCATIONS_RESET: sinv_counters_base[id] = sum;      break;
+	default: return -EINVAL;
+	}
+	/* the count is returned in the system call's (signed) return value */
+	*retval = n > (~0U >> 1) ? (~0U >> 1) : n;
+
+	return 0;
+#else
+	return -EINVAL;
+#endif
+}
+
 static int
 sinv_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t comp_cap, vaddr_t entry_addr)
 {
@@ -64,6 +145,9 @@ sinv_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t comp_cap, va
 
 	memcpy(&sinvc->comp_info, &compc->info, sizeof(struct comp_info));
 	sinvc->entry_addr = entry_addr;
+#ifdef COS_SINV_COUNTERS
+	sinvc->cntid      = sinv_cntid_alloc();
+#endif
 	__cap_capactivate_post(&sinvc->h, CAP_SINV);
 
 	return 0;
@@ -99,18 +183,42 @@ asnd_construct(struct cap_asnd *asndc, struct cap_arcv *arcvc, capid_t rcv_cap,
 	memcpy(&asndc->comp_info, &arcvc->comp_info, sizeof(struct comp_info));
 	asndc->h.type         = CAP_ASND;
 	asndc->arcv_epoch     = arcvc->epoch;
-	asndc->arcv_cpuid     = arcvc->cpuid;
+	asndc->arcv_cpuid     = arcvc->thd->cpuid; /* updated if the thread migrates */
 	/* ...and initialize our own data */
 	asndc->cpuid          = get_cpuid();
 	asndc->arcv_capid     = rcv_cap;
-	asndc->period         = period;
+	asndc->period         = period * chal_cyc_usec();
 	asndc->budget         = budget;
 	asndc->replenish_amnt = budget;
-	/* FIXME:  add rdtscll(asndc->replenish_time); */
+	rdtscll(asndc->replenish_time);
 
 	return 0;
 }
 
+/*
+ * Deferrable server: an asnd with a period can send budget
+ * notifications in each period, and unused budget isn't carried over.
+ * Returns 1 if the notification can be sent, and 0 if the budget for
+ * this period is exhausted.
+ */
+static inline int
+asnd_ratelimit(struct cap_asnd *asnd)
+{
+	u64_t now;
+
+	if (likely(!asnd->period)) return 1;
+
+	rdtscll(now);
+	if (now - asnd->replenish_time >= asnd->period) {
+		asnd->budget         = asnd->replenish_amnt;
+		asnd->replenish_time = now;
+	}
+	if (unlikely(!asnd->budget)) return 0;
+	asnd->budget--;
+
+	return 1;
+}
+
 static int
 asnd_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t rcv_captbl, capid_t rcv_cap, u32_t budget, u32_t period)
 {
@@ -196,18 +304,18 @@ arcv_activate(struct captbl *t, capid_t cap, capid_t capin, capid_t comp_cap, ca
 	if (unlikely(!CAP_TYPECHK(compc, CAP_COMP)))      return -EINVAL;
 
 	thdc = (struct cap_thd *)captbl_lkup(t, thd_cap);
-	if (unlikely(!CAP_TYPECHK_CORE(thdc, CAP_THD)))   return -EINVAL;
+	if (unlikely(!CAP_THD_TYPECHK_CORE(thdc)))   return -EINVAL;
 	thd = thdc->t;
 
 	tcapc = (struct cap_tcap *)captbl_lkup(t, tcap_cap);
-	if (unlikely(!CAP_TYPECHK_CORE(tcapc, CAP_TCAP))) return -EINVAL;
+	if (unlikely(!CAP_TCAP_TYPECHK_CORE(tcapc))) return -EINVAL;
 	/* a single thread cannot be bound to multiple rcvcaps */
 	if (thd_bound2rcvcap(thd)) return -EINVAL;
 	assert(!thd->rcvcap.rcvcap_tcap); 	/* an unbound thread should not have a tcap */
 
 	if (!init) {
 	        arcv_p = (struct cap_arcv *)captbl_lkup(t, arcv_cap);
-	        if (unlikely(!CAP_TYPECHK_CORE(arcv_p, CAP_ARCV))) return -EINVAL;
+	        if (unlikely(!CAP_ARCV_TYPECHK_CORE(arcv_p))) return -EINVAL;
 
 		depth = arcv_p->depth + 1;
 		if (depth >= ARCV_NOTIF_DEPTH) return -EINVAL;
@@ -235,22 +343,125 @@ arcv_deactivate(struct cap_captbl *t, capid_t capin, livenessid_t lid)
 	struct cap_arcv *arcvc;
 
 	arcvc = (struct cap_arcv *)captbl_lkup(t->captbl, capin);
-	if (unlikely(!arcvc || arcvc->h.type != CAP_ARCV || arcvc->cpuid != get_cpuid())) return -EINVAL;
+	if (unlikely(!CAP_ARCV_TYPECHK_CORE(arcvc))) return -EINVAL;
 	if (thd_rcvcap_isreferenced(arcvc->thd)) return -EBUSY;
 	if (__arcv_teardown(arcvc, arcvc->thd))  return -EBUSY;
 
 	return cap_capdeactivate(t, capin, CAP_ARCV, lid);
 }
 
+/*
+ * Cross-core thread migration.  Each core only modifies the
+ * scheduling data-structures it owns, so migration is two steps: the
+ * thread's core detaches it (thd_migrate_out) from its scheduler's
+ * rcv end-point and from its tcap list, after which the thread (and
+ * its tcap) are on no core, and can't be used; the destination core
+ * then attaches it (thd_migrate_in) to one of its own schedulers.
+ * Other cores might have read the thread's core before the detach
+ * (e.g. to send it an asnd), so the attach must wait for a quiescence
+ * period after it, which is tracked in the liveness table entry
+ * passed to the detach.
+ *
+ * Only a thread that is neither executing nor a scheduler (the
+ * notification target of other end-points) can migrate, and its tcap
+ * only with it if it isn't bound to other end-points.
+ */
+static int
+thd_migrate_out(struct captbl *ct, capid_t thd_cap, cpuid_t core, livenessid_t lid, struct cos_cpu_local_info *cli)
+{
+	struct cap_thd *thdc;
+	struct thread  *thd, *notif;
+	struct tcap    *tcap = NULL;
+	int ret;
+
+	thdc = (struct cap_thd *)captbl_lkup(ct, thd_cap);
+	if (unlikely(!CAP_THD_TYPECHK_CORE(thdc)))                   return -EINVAL;
+	thd = thdc->t;
+	if (unlikely(core < 0 || core >= NUM_CPU_COS || core == get_cpuid())) return -EINVAL;
+	if (thd == thd_current(cli) || thd == cli->next_ti.thd)      return -EBUSY;
+	if (thd_rcvcap_isreferenced(thd))                            return -EBUSY;
+	if (thd_bound2rcvcap(thd)) {
+		tcap = thd->rcvcap.rcvcap_tcap;
+		/* the tcap's own reference, and this end-point's */
+		if (tcap->arcv_ep != thd || tcap_ref(tcap) > 2)      return -EBUSY;
+		if (tcap == tcap_current(cli))                       return -EBUSY;
+	}
+
+	ret = ltbl_timestamp_update(lid);
+	if (ret) return ret;
+
+	/* the scheduler on this core is no longer notified of the thread's events */
+	if (thd_bound2rcvcap(thd)) {
+		notif = thd->rcvcap.rcvcap_thd_notif;
+		if (notif) {
+			thd_list_rem(notif, thd);
+			thd_rcvcap_release(notif);
+		}
+		thd->rcvcap.rcvcap_thd_notif = NULL;
+		thd->rcvcap.pending          = 0;
+		tcap_migrate_out(tcap);
+	}
+	/* its FPU state might still be in this core's registers */
+	fpu_thread_release(thd);
+	/* the quiescence period orders these with the destination's accesses */
+	thd->cpuid        = THD_CPUID_MIGRATING;
+	thd->exec         = 0;
+	thd->migrate_lid  = lid;
+	thd->migrate_core = core;
+	thd->state       |= THD_STATE_MIGRATING;
+
+	return 0;
+}
+
+/*
+ * Attach a thread migrated to this core.  If it is bound to a rcv
+ * end-point, the rcv end-point (arcv_cap) of the scheduler on this
+ * core that is to receive its notifications is required.
+ */
+static int
+thd_migrate_in(struct captbl *ct, capid_t thd_cap, capid_t arcv_cap)
+{
+	struct cap_thd  *thdc;
+	struct cap_arcv *arcv_p = NULL;
+	struct thread   *thd;
+	u64_t curr_ts, past_ts;
+
+	thdc = (struct cap_thd *)captbl_lkup(ct, thd_cap);
+	if (unlikely(!CAP_TYPECHK(thdc, CAP_THD)))               return -EINVAL;
+	thd = thdc->t;
+	if (!(thd->state & THD_STATE_MIGRATING) || thd->migrate_core != get_cpuid()) return -EINVAL;
+	if (thd_bound2rcvcap(thd)) {
+		arcv_p = (struct cap_arcv *)captbl_lkup(ct, arcv_cap);
+		if (unlikely(!CAP_ARCV_TYPECHK_CORE(arcv_p)))    return -EINVAL;
+	}
+
+	if (ltbl_get_timestamp(thd->migrate_lid, &past_ts))      return -EFAULT;
+	rdtscll(curr_ts);
+	if (!QUIESCENCE_CHECK(curr_ts, past_ts, KERN_QUIESCENCE_CYCLES)) return -EQUIESCENCE;
+
+	if (arcv_p) {
+		thd->rcvcap.rcvcap_thd_notif = arcv_p->thd;
+		thd_rcvcap_take(arcv_p->thd);
+		tcap_migrate_in(thd->rcvcap.rcvcap_tcap);
+	}
+	thd->state &= ~THD_STATE_MIGRATING;
+	thd->cpuid  = get_cpuid();
+
+	return 0;
+}
+
 /*
  * Invocation (call and return) fast path.  We want this to be as
- * optimized as possible.  The only two optimizations not yet
- * performed are 1) to cache the invocation stack pointer with the
- * thread id to avoid that cache-line access, and 2) to cache the
- * entire invocation stack on the kernel stack.  Option 1. represents
- * a more practical amount of caching.  Both require consistency
- * between the thread structure and the cached contents to be achieved
- * on context switches.
+ * optimized as possible.  Two optimizations are possible here: 1) to
+ * cache the invocation stack top in per-core storage to avoid that
+ * cache-line access, and 2) to cache the entire invocation stack on
+ * the kernel stack.  Option 1. represents a more practical amount of
+ * caching, and is implemented with COS_INVSTK_CACHE: the top's index
+ * and component are cached in the cos_cpu_local_info, so an
+ * invocation or return only accesses the one invocation stack entry
+ * that holds the return ip and sp.  Both require consistency between
+ * the thread structure and the cached contents to be achieved on
+ * context switches (thd_current_update).
  */
 
 static inline void
@@ -279,6 +490,8 @@ sinv_call(struct thread *thd, struct cap_sinv *sinvc, struct pt_regs *regs, stru
 		return;
 	}
 
+	COS_TRACE(COS_TRACE_SINV, sinvc->comp_info.liveness.id, thd->tid);
+	sinv_count(sinvc, cos_info);
 	pgtbl_update(sinvc->comp_info.pgtbl);
 
 	/* TODO: test this before pgtbl update...pre- vs. post-serialization */
@@ -308,6 +521,7 @@ sret_ret(struct thread *thd, struct pt_regs *regs, struct cos_cpu_local_info *co
 		return;
 	}
 
+	COS_TRACE(COS_TRACE_SRET, ci->liveness.id, thd->tid);
 	pgtbl_update(ci->pgtbl);
 	/* Set 2/3 return values into esi and edi */
 	__userregs_setretvals(regs, 0, thd->tid, 0);
@@ -17,8 +17,19 @@
  * Ring size should be power of 2
  * We have N*N rings (N= # of cpus).
  */
-#define IPI_RING_SIZE (16)
-#define IPI_RING_MASK (IPI_RING_SIZE - 1);
+#ifndef IPI_RING_SIZE
+#define IPI_RING_SIZE (64)
+#endif
+#define IPI_RING_MASK (IPI_RING_SIZE - 1)
+
+/*
+ * Coalesce IPIs: only send an IPI to a core that hasn't been sent
+ * one since it last scanned its rings, as that scan (or the one the
+ * pending IPI triggers) will find the new entries.
+ */
+#ifndef IPI_COALESCE
+#define IPI_COALESCE 1
+#endif
 
 struct ipi_cap_data {
 	capid_t arcv_capid;
@@ -46,6 +57,9 @@ struct IPI_receiving_rings {
 	u32_t start;
 	/* padding to prevent false sharing. */
 	char _pad[CACHE_LINE - sizeof(u32_t)];
+	/* Has this core been sent an IPI it hasn't yet handled? Written by the senders. */
+	unsigned long ipi_pending;
+	char __pad[CACHE_LINE - sizeof(unsigned long)];
 } CACHE_ALIGNED __attribute__((packed));
 
 struct IPI_receiving_rings IPI_cap_dest[NUM_CPU] CACHE_ALIGNED;
@@ -64,35 +78,8 @@ cos_ipi_ring_dequeue(struct xcore_ring *ring, struct ipi_cap_data *ret) {
 	return 1;
 }
 
-static inline void
-handle_ipi_arcv(struct ipi_cap_data *data)
-{
-	struct comp_info *ci = &data->comp_info;
-	struct cap_arcv *arcv;
-	/* FIXME: check epoch and liveness! */
-
-	assert(ci->captbl);
-	arcv = (struct cap_arcv *)captbl_lkup(ci->captbl, data->arcv_capid);
-	if (unlikely(arcv->h.type != CAP_ARCV)) {
-		printk("cos: IPI handling received invalid arcv cap %d\n", (int)data->arcv_capid);
-		return;
-	}
-
-	/* Activate the associated thread. */
-	chal_attempt_arcv(arcv);
-}
-
-static inline void
-process_ring(struct xcore_ring *ring) {
-	struct ipi_cap_data data;
-
-	while ((cos_ipi_ring_dequeue(ring, &data)) != 0) {
-		handle_ipi_arcv(&data);
-	}
-}
-
 static inline int
-cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd) {
+cos_ipi_ring_enqueue(u32_t dest, capid_t arcv_capid, capid_t arcv_epoch, struct comp_info *ci) {
 	struct xcore_ring *ring = &IPI_cap_dest[dest].IPI_source[get_cpuid()];
 	u32_t tail = ring->sender;
 	u32_t delta;
@@ -102,9 +89,9 @@ cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd) {
 	data = &ring->ring[tail];
 	if (unlikely(delta == ring->receiver)) return -1;
 
-	data->arcv_capid = asnd->arcv_capid;
-	data->arcv_epoch = asnd->arcv_epoch;
-	memcpy(&data->comp_info, &asnd->comp_info, sizeof(struct comp_info));
+	data->arcv_capid = arcv_capid;
+	data->arcv_epoch = arcv_epoch;
+	memcpy(&data->comp_info, ci, sizeof(struct comp_info));
 
 	ring->sender = delta;
 
@@ -113,15 +100,64 @@ cos_ipi_ring_enqueue(u32_t dest, struct cap_asnd *asnd) {
 	return 0;
 }
 
-static int cos_cap_send_ipi(int cpu, struct cap_asnd *asnd) {
+static int
+__cos_cap_send_ipi(int cpu, capid_t arcv_capid, capid_t arcv_epoch, struct comp_info *ci) {
+	struct IPI_receiving_rings *dest;
 	int ret;
 
-	ret = cos_ipi_ring_enqueue(cpu, asnd);
+	/* also tells the compiler that the index is in bounds (e.g. none is with NUM_CPU == 1) */
+	if (unlikely(cpu < 0 || cpu >= NUM_CPU || cpu == get_cpuid())) return -1;
+	dest = &IPI_cap_dest[cpu];
+	ret  = cos_ipi_ring_enqueue(cpu, arcv_capid, arcv_epoch, ci);
 	if (unlikely(ret)) return -1;
 
+	/* the enqueue's fence orders the entry before the check of the flag */
+	if (IPI_COALESCE && (dest->ipi_pending || !cos_cas(&dest->ipi_pending, 0, 1))) return 0;
 	chal_send_ipi(cpu);
 
 	return 0;
 }
 
+static int cos_cap_send_ipi(int cpu, struct cap_asnd *asnd)
+{ return __cos_cap_send_ipi(cpu, asnd->arcv_capid, asnd->arcv_epoch, &asnd->comp_info); }
+
+static inline void
+handle_ipi_arcv(struct ipi_cap_data *data)
+{
+	struct comp_info *ci = &data->comp_info;
+	struct cap_arcv *arcv;
+	cpuid_t core;
+	/* FIXME: check epoch and liveness! */
+
+	assert(ci->captbl);
+	arcv = (struct cap_arcv *)captbl_lkup(ci->captbl, data->arcv_capid);
+	if (unlikely(arcv->h.type != CAP_ARCV)) {
+		printk("cos: IPI handling received invalid arcv cap %d\n", (int)data->arcv_capid);
+		return;
+	}
+
+	/*
+	 * The receiving thread migrated away after the notification
+	 * was sent: forward it to the thread's new core, or drop it
+	 * if the thread is still between cores.
+	 */
+	core = arcv->thd->cpuid;
+	if (unlikely(core != get_cpuid())) {
+		if (core >= 0 && core < NUM_CPU_COS) __cos_cap_send_ipi(core, data->arcv_capid, data->arcv_epoch, ci);
+		return;
+	}
+
+	/* Activate the associated thread. */
+	chal_attempt_arcv(arcv);
+}
+
+static inline void
+process_ring(struct xcore_ring *ring) {
+	struct ipi_cap_data data;
+
+	while ((cos_ipi_ring_dequeue(ring, &data)) != 0) {
+		handle_ipi_arcv(&data);
+	}
+}
+
 #endif /* IPI_CAP_H */
@@ -48,6 +48,12 @@ typedef enum {
 #define PGTBL_DEPTH         2
 #define PGTBL_ORD           10
 
+/* super-pages are mapped directly by a first-level (pgd) entry */
+#define PGTBL_SUPER_SHIFT      (PGTBL_PAGEIDX_SHIFT + PGTBL_ORD)
+#define PGTBL_SUPER_SIZE       (1UL << PGTBL_SUPER_SHIFT)
+#define PGTBL_SUPER_NPAGES     (1 << PGTBL_ORD)
+#define PGTBL_SUPER_FRAME_MASK (~(PGTBL_SUPER_SIZE - 1))
+
 struct tlb_quiescence {
 	/* Updated by timer. */
 	u64_t last_periodic_flush;
@@ -81,8 +87,9 @@ __pgtbl_get(struct ert_intern *a, void *accum, int isleaf)
 	*(u32_t*)accum = (((u32_t)a->next) & PGTBL_FLAG_MASK);
 	return chal_pa2va((paddr_t)((((u32_t)a->next) & PGTBL_FRAME_MASK)));
 }
+/* A super-page has no next level to walk into, so lookups below it fail */
 static int __pgtbl_isnull(struct ert_intern *a, void *accum, int isleaf)
-{ (void)isleaf; (void)accum; return !(((u32_t)(a->next)) & (PGTBL_PRESENT|PGTBL_COSFRAME)); }
+{ (void)isleaf; (void)accum; return !(((u32_t)(a->next)) & (PGTBL_PRESENT|PGTBL_COSFRAME)) || (((u32_t)(a->next)) & PGTBL_SUPER); }
 static void
 __pgtbl_init(struct ert_intern *a, int isleaf)
 {
@@ -296,6 +303,77 @@ pgtbl_mapping_add(pgtbl_t pt, u32_t addr, u32_t page, u32_t flags)
 	return ret;
 }
 
+/*
+ * The pgd entry of the user super-page mapping that includes addr,
+ * or NULL if there isn't one.
+ */
+static unsigned long *
+pgtbl_lkup_super(pgtbl_t pt, u32_t addr, u32_t *flags)
+{
+	unsigned long *pgd, v;
+
+	pgd = pgtbl_get_pgd(pt, addr);
+	if (!pgd) return NULL;
+	v = *pgd;
+	if ((v & (PGTBL_PRESENT|PGTBL_SUPER|PGTBL_USER)) != (PGTBL_PRESENT|PGTBL_SUPER|PGTBL_USER)) return NULL;
+	*flags = v & PGTBL_FLAG_MASK;
+
+	return pgd;
+}
+
+/*
+ * Map the super-page at page (physical, super-page aligned) at addr.
+ * The pgd entry must be empty: neither mapped, nor a page of ptes.
+ * Only user memory can be mapped, and each of its memory sets is
+ * referenced, as with pgtbl_mapping_add.
+ */
+static int
+pgtbl_mapping_add_super(pgtbl_t pt, u32_t addr, u32_t page, u32_t flags)
+{
+	unsigned long *pgd;
+	u32_t orig_v;
+	int ret;
+
+	assert(pt);
+	assert((PGTBL_FRAME_MASK & flags) == 0);
+	if (unlikely((addr | page) & ~PGTBL_SUPER_FRAME_MASK)) return -EINVAL;
+	if (unlikely(addr >= COS_MEM_KERN_START_VA))           return -EINVAL;
+
+	pgd = pgtbl_get_pgd(pt, addr);
+	if (!pgd) return -ENOENT;
+	orig_v = *pgd;
+
+	if (orig_v & (PGTBL_PRESENT|PGTBL_COSFRAME)) return -EEXIST;
+	ret = pgtbl_quie_check(orig_v);
+	if (ret) return ret;
+
+	ret = retypetbl_ref_range((void *)page, PGTBL_SUPER_SIZE);
+	if (ret) return ret;
+
+	if (!cos_cas(pgd, orig_v, page | flags | PGTBL_SUPER)) {
+		retypetbl_deref_range((void *)page, PGTBL_SUPER_SIZE);
+		return -ECASFAIL;
+	}
+
+	return 0;
+}
+
+/* Remove the super-page mapping that includes addr, see pgtbl_mapping_del */
+static int
+pgtbl_mapping_del_super(pgtbl_t pt, u32_t addr, u32_t liv_id)
+{
+	unsigned long *pgd, orig_v;
+	u32_t flags;
+
+	pgd = pgtbl_lkup_super(pt, addr, &flags);
+	if (!pgd) return -ENOENT;
+	orig_v = *pgd;
+
+	if (!cos_cas(pgd, orig_v, (liv_id << PGTBL_PAGEIDX_SHIFT) | PGTBL_QUIESCENCE)) return -ECASFAIL;
+
+	return retypetbl_deref_range((void *)(orig_v & PGTBL_SUPER_FRAME_MASK), PGTBL_SUPER_SIZE);
+}
+
 /*
  * FIXME: a hack used to get more kmem available in Linux booting
  * environment. Only used when booting up in Linux (hijack.c). This
@@ -399,6 +477,7 @@ pgtbl_mapping_del(pgtbl_t pt, u32_t addr, u32_t liv_id)
 	/* get the pte */
 	pte = (struct ert_intern *)__pgtbl_lkupan((pgtbl_t)((u32_t)pt|PGTBL_PRESENT),
 						  addr >> PGTBL_PAGEIDX_SHIFT, PGTBL_DEPTH, &accum);
+	if (!pte) return pgtbl_mapping_del_super(pt, addr, liv_id);
 	orig_v = (u32_t)(pte->next);
 	if (!(orig_v & PGTBL_PRESENT)) return -EEXIST;
 	if (orig_v & PGTBL_COSFRAME)   return -EPERM;
@@ -443,6 +522,12 @@ pgtbl_lkup(pgtbl_t pt, u32_t addr, u32_t *flags)
 
 	ret = __pgtbl_lkupan((pgtbl_t)((unsigned long)pt | PGTBL_PRESENT),
 			     addr >> PGTBL_PAGEIDX_SHIFT, PGTBL_DEPTH+1, flags);
+	if (unlikely(!ret)) {
+		unsigned long *pgd = pgtbl_lkup_super(pt, addr, flags);
+
+		if (!pgd) return NULL;
+		return chal_pa2va((paddr_t)((*pgd & PGTBL_SUPER_FRAME_MASK) | (addr & ~PGTBL_SUPER_FRAME_MASK & PGTBL_FRAME_MASK)));
+	}
 	if (!pgtbl_ispresent(*flags)) return NULL;
 	return ret;
 }
@@ -559,6 +644,7 @@ static void pgtbl_init(void) {
 }
 
 int cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr);
+int cap_memactivate_super(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr);
 int pgtbl_kmem_act(pgtbl_t pt, u32_t addr, unsigned long *kern_addr, unsigned long **pte);
 
 #endif /* PGTBL_H */
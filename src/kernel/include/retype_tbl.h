@@ -101,5 +101,7 @@ void retype_tbl_init(void);
 int retypetbl_ref(void *pa);
 int retypetbl_kern_ref(void *pa);
 int retypetbl_deref(void *pa);
+int retypetbl_ref_range(void *pa, unsigned long sz);
+int retypetbl_deref_range(void *pa, unsigned long sz);
 
 #endif /* RETYPE_TBL_H */
@@ -56,6 +56,19 @@
 //#define FPU_ENABLED
 #define FPU_SUPPORT_FXSR       1   /* >0 : CPU supports FXSR. */
 
+/*
+ * cache the current component of the invocation stack top in per-core
+ * storage, avoiding an access to the thread's invocation stack on
+ * invocations and capability lookups (see thd.h)
+ */
+//#define COS_INVSTK_CACHE
+
+/* per-core kernel trace rings of invocations, switches and interrupts (see cos_trace.h) */
+//#define COS_KERNEL_TRACE
+
+/* per-core invocation counts of sinv caps, read with CAPTBL_OP_INTROSPECT (see inv.h) */
+//#define COS_SINV_COUNTERS
+
 /* the CPU that does initialization for Composite */
 #define INIT_CORE              0
 #define NUM_CPU_COS            (NUM_CPU > 1 ? NUM_CPU - 1 : 1)
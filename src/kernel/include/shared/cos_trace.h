@@ -0,0 +1,54 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ */
+
+/*
+ * The format of the kernel's per-core trace rings (see
+ * COS_KERNEL_TRACE in cos_config.h), shared between the kernel that
+ * writes them, and the tracer component that maps them read-only
+ * (CAPTBL_OP_TRACE_MAP on a CAP_TRACE capability) and decodes them.
+ */
+
+#ifndef COS_TRACE_H
+#define COS_TRACE_H
+
+#include "./cos_types.h"
+
+typedef enum {
+	COS_TRACE_SINV,        /* a: liveness id of the callee, b: thread */
+	COS_TRACE_SRET,        /* a: liveness id of the component returned to, b: thread */
+	COS_TRACE_THD_SWITCH,  /* a: thread switched from, b: thread switched to */
+	COS_TRACE_ASND,        /* a: sending thread, b: receiving thread */
+	COS_TRACE_TIMER,       /* a: interrupted thread, b: 0 */
+	COS_TRACE_HW_ASND,     /* a: interrupt line, b: core of the receiver */
+	COS_TRACE_TCAP_EXPIRE, /* a: thread whose tcap expired, b: 0 */
+	COS_TRACE_NEVTS
+} cos_trace_evt_t;
+
+struct cos_trace_rec {
+	u64_t tsc;
+	u32_t a;
+	u16_t b;
+	u16_t evt;
+} __attribute__((packed));
+
+/*
+ * The first page holds the head, the number of records ever written.
+ * The record pages hold the last COS_TRACE_NRECS of them, the most
+ * recent at recs[(head - 1) & COS_TRACE_MASK].  A reader copies the
+ * records, then re-reads the head to discard those that were
+ * overwritten in the meantime.
+ */
+#define COS_TRACE_REC_PAGES 16
+#define COS_TRACE_NPAGES    (1 + COS_TRACE_REC_PAGES)
+#define COS_TRACE_NRECS     (COS_TRACE_REC_PAGES * PAGE_SIZE / sizeof(struct cos_trace_rec))
+#define COS_TRACE_MASK      (COS_TRACE_NRECS - 1)
+
+struct cos_trace_ring {
+	volatile u32_t head;
+	u8_t __pad[PAGE_SIZE - sizeof(u32_t)];
+	struct cos_trace_rec recs[COS_TRACE_NRECS];
+};
+
+#endif /* COS_TRACE_H */
@@ -121,8 +121,67 @@ typedef enum {
 	CAPTBL_OP_HW_MAP,
 	CAPTBL_OP_HW_CYC_USEC,
 	CAPTBL_OP_HW_CYC_THRESH,
+	CAPTBL_OP_VECTOR,
+	CAPTBL_OP_MEMACTIVATE_SUPER,
+	CAPTBL_OP_TRACE_MAP,
+	CAPTBL_OP_THDMIGRATE,
 } syscall_op_t;
 
+/*
+ * A captbl or pgtbl operation for CAPTBL_OP_VECTOR: the capability,
+ * operation and arguments are those of its system call, and ret is
+ * set to its return value.  Vectors must not span a page boundary.
+ */
+struct cos_captbl_op {
+	unsigned long cap;
+	syscall_op_t  op;
+	unsigned long args[4];
+	long          ret;
+};
+
+#define COS_CAPTBL_OP_VECTOR_MAX (PAGE_SIZE / sizeof(struct cos_captbl_op))
+
+/* Operations on arcv capabilities */
+typedef enum {
+	ARCV_OP_RCV = 0,	/* receive a single scheduler event */
+	ARCV_OP_RCV_BATCH,	/* receive scheduler events into an array (struct cos_sched_evt) */
+	ARCV_OP_RING_SET,	/* register (or with 0, remove) a page for a scheduler event ring */
+} arcv_op_t;
+
+/*
+ * A scheduler event as delivered by the kernel: the thread id, with
+ * the most significant bit set if the thread blocked, and the cycles
+ * it executed since its last event.  Arrays of events for a batched
+ * rcv must not span a page boundary.
+ */
+struct cos_sched_evt {
+	unsigned long thd_state;
+	unsigned long cycles;
+};
+
+#define COS_SCHED_EVT_BATCH_MAX (PAGE_SIZE / sizeof(struct cos_sched_evt))
+
+/*
+ * A page-sized, single-producer (the kernel), single-consumer (the
+ * scheduler) ring of scheduler events, with the layout of
+ * ck_ring_cos.h's CK_RING(cos_sched_evt, ...).  The head and tail are
+ * free-running, and indexed modulo COS_SCHED_RING_SZ, which the
+ * kernel uses regardless of the size field.  Events the kernel can't
+ * fit in the ring are instead delivered by the rcv operations.
+ */
+struct cos_sched_ring {
+	unsigned int          c_head;
+	char                  pad[CACHE_LINE - sizeof(unsigned int)];
+	unsigned int          p_tail;
+	char                  _pad[CACHE_LINE - sizeof(unsigned int)];
+	unsigned int          size;
+	unsigned int          mask;
+	char                  __pad[CACHE_LINE - sizeof(unsigned int) * 2];
+	struct cos_sched_evt  ring[0];
+};
+
+#define COS_SCHED_RING_SZ 128
+
 typedef enum {
 	CAP_FREE = 0,
 	CAP_SINV,		/* synchronous communication -- invoke */
@@ -138,6 +197,7 @@ typedef enum {
 	CAP_QUIESCENCE,         /* when deactivating, set to track quiescence state */
 	CAP_TCAP, 		/* tcap captable entry */
 	CAP_HW,			/* hardware (interrupt) */
+	CAP_TRACE,		/* kernel trace rings (see cos_trace.h) */
 } cap_t;
 
 /* TODO: pervasive use of these macros */
@@ -230,12 +290,18 @@ __captbl_cap2sz(cap_t c)
 	case CAP_SRET:
 	case CAP_THD:
 	case CAP_TCAP:
+	case CAP_TRACE:
 		return CAP_SZ_16B;
+#ifndef COS_SINV_COUNTERS
 	case CAP_SINV:
+#endif
 	case CAP_CAPTBL:
 	case CAP_PGTBL:
 	case CAP_HW: /* TODO: 256bits = 32B * 8b */
 		return CAP_SZ_32B;
+#ifdef COS_SINV_COUNTERS
+	case CAP_SINV: /* with the index of its invocation counters */
+#endif
 	case CAP_COMP:
 	case CAP_ASND:
 	case CAP_ARCV:
@@ -286,7 +352,12 @@ enum {
 	BOOT_CAPTBL_SELF_INITTCAP_BASE = BOOT_CAPTBL_SELF_INITTHD_BASE + NUM_CPU_COS*CAP16B_IDSZ,
 	BOOT_CAPTBL_SELF_INITRCV_BASE  = round_up_to_pow2(BOOT_CAPTBL_SELF_INITTCAP_BASE + NUM_CPU_COS*CAP16B_IDSZ, CAPMAX_ENTRY_SZ),
 	BOOT_CAPTBL_SELF_INITHW_BASE   = round_up_to_pow2(BOOT_CAPTBL_SELF_INITRCV_BASE + NUM_CPU_COS*CAP64B_IDSZ, CAPMAX_ENTRY_SZ),
+#ifdef COS_KERNEL_TRACE
+	BOOT_CAPTBL_SELF_TRACE         = round_up_to_pow2(BOOT_CAPTBL_SELF_INITHW_BASE + CAP32B_IDSZ, CAPMAX_ENTRY_SZ),
+	BOOT_CAPTBL_LAST_CAP           = BOOT_CAPTBL_SELF_TRACE + CAP16B_IDSZ,
+#else
 	BOOT_CAPTBL_LAST_CAP           = BOOT_CAPTBL_SELF_INITHW_BASE + CAP32B_IDSZ,
+#endif
 	/* round up to next entry */
 	BOOT_CAPTBL_FREE               = round_up_to_pow2(BOOT_CAPTBL_LAST_CAP, CAPMAX_ENTRY_SZ)
 };
@@ -311,6 +382,12 @@ enum {
 	THD_GET_TID,
 };
 
+/* sinv capability introspection (with COS_SINV_COUNTERS) */
+enum {
+	SINV_GET_INVOCATIONS,		/* invocations since the last reset, summed over cores */
+	SINV_GET_INVOCATIONS_RESET,	/* the same, and reset them */
+};
+
 enum {
 	/* cap 0-3 reserved for sret. 4-7 is the sinv cap. FIXME: make this general. */
 	SCHED_CAPTBL_ALPHATHD_BASE = 16,
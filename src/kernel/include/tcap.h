@@ -29,6 +29,9 @@ struct cap_tcap {
 	cpuid_t cpuid;
 } __attribute__((packed));
 
+/* as with threads (CAP_THD_TYPECHK_CORE), a tcap's core is the one in the tcap */
+#define CAP_TCAP_TYPECHK_CORE(c) (CAP_TYPECHK((c), CAP_TCAP) && (c)->tcap->cpuid == get_cpuid())
+
 /*
  * This is a reference to a tcap, and the epoch tracks which
  * "generation" of the tcap is valid for this reference.  This enables
@@ -45,6 +48,19 @@ struct tcap_sched_info {
 	tcap_prio_t prio;
 };
 
+/*
+ * The result of the last tcap_higher_prio comparison of this tcap
+ * against the tcap with uid @uid.  It is valid while neither tcap has
+ * changed since, as tracked by their epochs.  uids are never reused
+ * on a core, so a tcap that is deleted and reallocated can't be
+ * mistaken for the one that was compared against.
+ */
+struct tcap_prio_cache {
+	tcap_uid_t uid;
+	u32_t      epoch, c_epoch;
+	int        higher;
+};
+
 struct tcap {
 	struct thread     *arcv_ep; /* the arcv endpoint this tcap is hooked into */
 	u32_t 		   refcnt;
@@ -52,6 +68,9 @@ struct tcap {
 	u8_t               ndelegs, curr_sched_off;
 	u16_t              cpuid;
 	tcap_prio_t        perm_prio;
+	/* incremented on each change to the delegations, or the priorities in them */
+	u32_t              epoch;
+	struct tcap_prio_cache prio_cache;
 
 	/*
 	 * Which chain of temporal capabilities resulted in this
@@ -79,6 +98,8 @@ int tcap_delegate(struct tcap *tcapdst, struct tcap *tcapsrc, tcap_res_t cycles,
 int tcap_merge(struct tcap *dst, struct tcap *rm);
 void tcap_promote(struct tcap *t, struct thread *thd);
 int tcap_wakeup(struct tcap *tc, tcap_prio_t prio, tcap_res_t budget, struct thread *thd, struct cos_cpu_local_info *cli);
+void tcap_migrate_out(struct tcap *t);
+void tcap_migrate_in(struct tcap *t);
 
 struct thread *tcap_tick_handler(void);
 void tcap_timer_choose(int c);
@@ -87,6 +108,11 @@ static inline struct tcap_sched_info *
 tcap_sched_info(struct tcap *t)
 { return &t->delegations[t->curr_sched_off]; }
 
+/* Must be called after any change that can alter the result of tcap_higher_prio */
+static inline void
+tcap_prio_changed(struct tcap *t)
+{ t->epoch++; }
+
 static inline void
 tcap_ref_take(struct tcap *t)
 { t->refcnt++; }
@@ -144,6 +170,7 @@ tcap_consume(struct tcap *t, tcap_res_t cycles)
 			memcpy(&t->delegations[0], tcap_sched_info(t), sizeof(struct tcap_sched_info));
 			t->curr_sched_off = 0;
 		}
+		tcap_prio_changed(t);
 	} else {
 		t->budget.cycles -= cycles;
 	}
@@ -162,8 +189,14 @@ tcap_expended(struct tcap *t)
 static inline void
 tcap_setprio(struct tcap *t, tcap_prio_t p)
 {
+	struct tcap_sched_info *si;
+
 	assert(t);
-	tcap_sched_info(t)->prio = p;
+	si = tcap_sched_info(t);
+	/* tcap_wakeup and thread switches often set the same priority: keep the cached comparisons */
+	if (si->prio == p) return;
+	si->prio = p;
+	tcap_prio_changed(t);
 }
 
 static inline struct tcap *
@@ -234,19 +267,12 @@ tcap_timer_update(struct cos_cpu_local_info *cos_info, struct tcap *next, tcap_t
 	chal_timer_set(timer);
 }
 
-/*
- * Is the newly activated thread of a higher priority than the current
- * thread?  Of all of the code in tcaps, this is the fast path that is
- * called for each interrupt and asynchronous thread invocation.
- */
 static inline int
-tcap_higher_prio(struct tcap *a, struct tcap *c)
+__tcap_higher_prio(struct tcap *a, struct tcap *c)
 {
 	int i, j;
 	int ret = 0;
 
-	if (tcap_expended(a)) return 0;
-
 	for (i = 0, j = 0 ; i < a->ndelegs && j < c->ndelegs ; ) {
 		/*
 		 * These cases are for the case where the tcaps don't
@@ -269,4 +295,35 @@ fixup:
 	return ret;
 }
 
+/*
+ * Is the newly activated thread of a higher priority than the current
+ * thread?  Of all of the code in tcaps, this is the fast path that is
+ * called for each interrupt and asynchronous thread invocation.
+ *
+ * Walking the delegation chains is linear in their length, but the
+ * same pair of tcaps is usually compared repeatedly (e.g. each
+ * interrupt for the same handler, while the same thread runs), and
+ * their chains rarely change between the comparisons, so the last
+ * result is cached in @a.  Expended budget isn't part of the cached
+ * result, as it changes without the chain changing.
+ */
+static inline int
+tcap_higher_prio(struct tcap *a, struct tcap *c)
+{
+	struct tcap_prio_cache *pc = &a->prio_cache;
+	tcap_uid_t              cu;
+
+	if (tcap_expended(a)) return 0;
+
+	cu = tcap_sched_info(c)->tcap_uid;
+	if (likely(pc->uid == cu && pc->epoch == a->epoch && pc->c_epoch == c->epoch)) return pc->higher;
+
+	pc->higher  = __tcap_higher_prio(a, c);
+	pc->uid     = cu;
+	pc->epoch   = a->epoch;
+	pc->c_epoch = c->epoch;
+
+	return pc->higher;
+}
+
 #endif	/* TCAP_H */
@@ -37,43 +37,82 @@ struct rcvcap_info {
 	sched_tok_t sched_count;
 	struct tcap   *rcvcap_tcap;      /* This rcvcap's tcap */
 	struct thread *rcvcap_thd_notif; /* The parent rcvcap thread for notifications */
+	/* if blocked in a batched rcv, the user-level array, and its size, to deliver events into */
+	vaddr_t        evts_batch;
+	int            evts_batch_max;
+	/* the user-level event ring, if one is registered (see struct thread for its page-table) */
+	vaddr_t        evt_ring;
 };
 
 typedef enum {
 	THD_STATE_PREEMPTED   = 1,
 	THD_STATE_RCVING      = 1<<1, /* report to parent rcvcap that we're receiving */
 	THD_STATE_SUSPENDED   = 1<<2,
+	THD_STATE_MIGRATING   = 1<<3, /* detached from its core, not yet attached to another */
 } thd_state_t;
 
+/* the core of a thread (and its tcap) between thd_migrate_out and thd_migrate_in */
+#define THD_CPUID_MIGRATING NUM_CPU
+
 /**
  * The thread descriptor.  Contains all information pertaining to a
  * thread including its registers, id, rcvcap information, and, most
  * importantly, the kernel invocation stack of execution through
  * components.
+ *
+ * The layout is by how often the fields are accessed: the first
+ * cache-line holds everything that sinv/sret and thread switches
+ * read other than the invocation stack entries and the registers,
+ * which follow it.  The fault registers and FPU state are only
+ * accessed on faults and lazy FPU switches, so they are last, where
+ * they don't share cache-lines with the rest.  A thread is allocated
+ * from a kernel memory page, so they are in the tail of that page.
  */
 struct thread {
-	thdid_t tid;
-	u16_t invstk_top;
-        struct pt_regs regs;
-        struct pt_regs fault_regs;
-        struct cos_fpu fpu;
-
-	/* TODO: same cache-line as the tid */
-	struct invstk_entry invstk[THD_INVSTK_MAXSZ];
-
+	/* hot: sinv, sret and switches */
+	thdid_t      tid;
+	u16_t        invstk_top;
 	thd_state_t  state;
-	u32_t        tls;
 	cpuid_t      cpuid;
+	u32_t        tls;
 	unsigned int refcnt;
-	tcap_res_t   exec;   /* execution time */
 	struct thread *interrupted_thread;
-
-	/* rcv end-point data-structures */
+	/* rcv end-point data-structures, including the tcap */
 	struct rcvcap_info rcvcap;
-	struct list        event_head; /* all events for *this* end-point */
-	struct list_node   event_list; /* the list of events for another end-point */
+
+	struct invstk_entry invstk[THD_INVSTK_MAXSZ];
+	struct pt_regs      regs;
+
+	/* warm: scheduling events */
+	tcap_res_t       exec;   /* execution time */
+	struct list      event_head; /* all events for *this* end-point */
+	struct list_node event_list; /* the list of events for another end-point */
+	/* cold: cross-core migration (see thd_migrate_out) */
+	livenessid_t     migrate_lid;
+	cpuid_t          migrate_core;
+	/*
+	 * cold: the page-table the event ring is mapped in, and its
+	 * component's liveness, that guards against translating
+	 * through the page-table after it's deactivated
+	 */
+	pgtbl_t              evt_ring_pgtbl;
+	struct liveness_data evt_ring_liveness;
+
+	/* cold: faults and FPU */
+	struct pt_regs fault_regs CACHE_ALIGNED;
+	struct cos_fpu fpu;
 } CACHE_ALIGNED;
 
+/* in fpu.c to avoid a header file circular dependency */
+void fpu_thread_release(struct thread *thd);
+
+/*
+ * Threads can migrate between cores, so it is the thread's cpuid that
+ * is checked against the current core, not the cap's (which records
+ * the core the thread was on when the cap was created).
+ */
+#define CAP_THD_TYPECHK_CORE(c) (CAP_TYPECHK((c), CAP_THD) && (c)->t->cpuid == get_cpuid())
+
 /*
  * Thread capability descriptor that is minimal and contains only
  * consistency checking information (cpuid to ensure we're accessing
@@ -172,6 +211,11 @@ thd_rcvcap_init(struct thread *t)
 	rc->isbound = rc->pending = rc->refcnt = 0;
 	rc->sched_count = 0;
 	rc->rcvcap_thd_notif = NULL;
+	rc->evts_batch = 0;
+	rc->evts_batch_max = 0;
+	rc->evt_ring       = 0;
+	t->evt_ring_pgtbl  = 0;
+	memset(&t->evt_ring_liveness, 0, sizeof(struct liveness_data));
 }
 
 static inline void
@@ -234,6 +278,23 @@ thd_state_evt_deliver(struct thread *t, unsigned long *thd_state, unsigned long
 	return 1;
 }
 
+/*
+ * Deliver up to max events into evts, and consume all pending
+ * notifications.  Returns the number of events delivered.
+ */
+static inline int
+thd_state_evts_deliver(struct thread *t, struct cos_sched_evt *evts, int max)
+{
+	int n;
+
+	for (n = 0 ; n < max ; n++) {
+		if (!thd_state_evt_deliver(t, &evts[n].thd_state, &evts[n].cycles)) break;
+	}
+	t->rcvcap.pending = 0;
+
+	return n;
+}
+
 static int
 thd_activate(struct captbl *t, capid_t cap, capid_t capin, struct thread *thd, capid_t compcap, int init_data)
 {
@@ -318,6 +379,7 @@ thd_deactivate(struct captbl *ct, struct cap_captbl *dest_ct, unsigned long capi
 	/* deactivation success */
 	if (thd->refcnt == 0) {
 		if (cli->next_ti.thd == thd) thd_next_thdinfo_update(cli, 0, 0, 0, 0);
+		fpu_thread_release(thd);
 
 		/* move the kmem for the thread to a location
 		 * in a pagetable as COSFRAME */
@@ -337,7 +399,7 @@ thd_tls_set(struct captbl *ct, capid_t thd_cap, vaddr_t tlsaddr, struct thread *
 	struct thread *thd;
 
 	tc = (struct cap_thd *)captbl_lkup(ct, thd_cap);
-	if (!tc || tc->h.type != CAP_THD || get_cpuid() != tc->cpuid) return -EINVAL;
+	if (!CAP_THD_TYPECHK_CORE(tc)) return -EINVAL;
 
 	thd = tc->t;
 	assert(thd);
@@ -352,6 +414,10 @@ static void
 thd_init(void)
 {
 	assert(sizeof(struct cap_thd) <= __captbl_cap2bytes(CAP_THD));
+	/* threads are allocated from a single page of kernel memory */
+	assert(sizeof(struct thread) <= PAGE_SIZE);
+	assert(__builtin_offsetof(struct thread, invstk) <= CACHE_LINE);
+	assert(sizeof(struct comp_info) == CPU_LOCAL_COMP_INFO_SZ);
 	//assert(offsetof(struct thread, regs) == 4); /* see THD_REGS in entry.S */
 }
 
@@ -359,11 +425,29 @@ static inline struct thread *
 thd_current(struct cos_cpu_local_info *cos_info)
 { return (struct thread *)(cos_info->curr_thd); }
 
+/*
+ * With COS_INVSTK_CACHE, the comp_info of the current thread's top
+ * invstk entry is only kept in the per-core cos_info->invstk_ci, not
+ * in the thread: entries are written back to the thread when they
+ * stop being the top (on invocation and thread switch), and loaded
+ * from it when they become the top (on return and thread switch).
+ * The thread's own top entry is thus only valid when it isn't
+ * executing.
+ */
+static inline struct comp_info *
+curr_invstk_ci(struct cos_cpu_local_info *cos_info)
+{ return (struct comp_info *)cos_info->invstk_ci; }
+
 static inline void
 thd_current_update(struct thread *next, struct thread *prev, struct cos_cpu_local_info *cos_info)
 {
 	/* commit the cached data */
 	prev->invstk_top     = cos_info->invstk_top;
+#ifdef COS_INVSTK_CACHE
+	/* at boot, there is no previous thread (prev == next) and nothing cached */
+	if (prev != next) memcpy(&prev->invstk[prev->invstk_top].comp_info, curr_invstk_ci(cos_info), sizeof(struct comp_info));
+	memcpy(curr_invstk_ci(cos_info), &next->invstk[next->invstk_top].comp_info, sizeof(struct comp_info));
+#endif
 	cos_info->invstk_top = next->invstk_top;
 	cos_info->curr_thd   = next;
 }
@@ -393,7 +477,22 @@ thd_invstk_current(struct thread *curr_thd, unsigned long *ip, unsigned long *sp
 	*ip = curr->ip;
 	*sp = curr->sp;
 
+#ifdef COS_INVSTK_CACHE
+	return curr_invstk_ci(cos_info);
+#else
 	return &curr->comp_info;
+#endif
+}
+
+/* The current component, without the return ip and sp, which require accessing the invstk */
+static inline struct comp_info *
+thd_invstk_current_comp(struct thread *curr_thd, struct cos_cpu_local_info *cos_info)
+{
+#ifdef COS_INVSTK_CACHE
+	return curr_invstk_ci(cos_info);
+#else
+	return &curr_thd->invstk[curr_invstk_top(cos_info)].comp_info;
+#endif
 }
 
 static inline pgtbl_t
@@ -410,17 +509,22 @@ thd_current_pgtbl(struct thread *thd)
 static inline int
 thd_invstk_push(struct thread *thd, struct comp_info *ci, unsigned long ip, unsigned long sp, struct cos_cpu_local_info *cos_info)
 {
-	struct invstk_entry *top, *prev;
+	struct invstk_entry *prev;
 
 	if (unlikely(curr_invstk_top(cos_info) >= THD_INVSTK_MAXSZ)) return -1;
 
 	prev = &thd->invstk[curr_invstk_top(cos_info)];
-	top  = &thd->invstk[curr_invstk_top(cos_info)+1];
 	curr_invstk_inc(cos_info);
 	prev->ip = ip;
 	prev->sp = sp;
-	memcpy(&top->comp_info, ci, sizeof(struct comp_info));
-	top->ip  = top->sp = 0;
+#ifdef COS_INVSTK_CACHE
+	/* prev's line is written anyway, and the new top's isn't accessed */
+	memcpy(&prev->comp_info, curr_invstk_ci(cos_info), sizeof(struct comp_info));
+	memcpy(curr_invstk_ci(cos_info), ci, sizeof(struct comp_info));
+#else
+	memcpy(&prev[1].comp_info, ci, sizeof(struct comp_info));
+	prev[1].ip = prev[1].sp = 0;
+#endif
 
 	return 0;
 }
@@ -430,6 +534,9 @@ thd_invstk_pop(struct thread *thd, unsigned long *ip, unsigned long *sp, struct
 {
 	if (unlikely(curr_invstk_top(cos_info) == 0)) return NULL;
 	curr_invstk_dec(cos_info);
+#ifdef COS_INVSTK_CACHE
+	memcpy(curr_invstk_ci(cos_info), &thd->invstk[curr_invstk_top(cos_info)].comp_info, sizeof(struct comp_info));
+#endif
 	return thd_invstk_current(thd, ip, sp, cos_info);
 }
 
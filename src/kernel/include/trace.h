@@ -0,0 +1,71 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "shared/cos_config.h"
+#include "shared/cos_trace.h"
+#include "shared/util.h"
+#include "chal/cpuid.h"
+#include "captbl.h"
+#include "pgtbl.h"
+#include "cap_ops.h"
+
+/*
+ * Per-core rings of timestamped records of invocations, thread
+ * switches and interrupts.  Each core only writes its own ring, and
+ * the kernel isn't preemptible, so writing a record needs no
+ * synchronization; the head is only advanced after the record is
+ * written so that a reader never sees a partial record as valid.
+ */
+
+#ifdef COS_KERNEL_TRACE
+
+extern struct cos_trace_ring trace_rings[NUM_CPU];
+
+static inline void
+trace_evt(cos_trace_evt_t evt, u32_t a, u16_t b)
+{
+	struct cos_trace_ring *r   = &trace_rings[get_cpuid()];
+	struct cos_trace_rec  *rec = &r->recs[r->head & COS_TRACE_MASK];
+
+	rdtscll(rec->tsc);
+	rec->a   = a;
+	rec->b   = b;
+	rec->evt = evt;
+	/* x86 doesn't reorder stores with other stores, so only the compiler must be prevented from doing so */
+	__asm__ __volatile__("" ::: "memory");
+	r->head++;
+}
+
+#define COS_TRACE(evt, a, b) trace_evt(evt, a, b)
+
+#else
+
+#define COS_TRACE(evt, a, b)
+
+#endif /* COS_KERNEL_TRACE */
+
+struct cap_trace {
+	struct cap_header h;
+} __attribute__((packed));
+
+static int
+trace_activate(struct captbl *t, capid_t cap, capid_t capin)
+{
+	struct cap_trace *trc;
+	int ret;
+
+	trc = (struct cap_trace *)__cap_capactivate_pre(t, cap, capin, CAP_TRACE, &ret);
+	if (!trc) return ret;
+	__cap_capactivate_post(&trc->h, CAP_TRACE);
+
+	return 0;
+}
+
+int trace_map(pgtbl_t pt, cpuid_t core, vaddr_t va);
+
+#endif /* TRACE_H */
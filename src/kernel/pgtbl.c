@@ -108,6 +108,43 @@ cap_memactivate(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capi
 	return ret;
 }
 
+/*
+ * Map the PGTBL_SUPER_NPAGES frames starting at frame_cap as a
+ * super-page at vaddr.  They must be physically contiguous, starting
+ * at a super-page aligned frame.
+ */
+int
+cap_memactivate_super(struct captbl *ct, struct cap_pgtbl *pt, capid_t frame_cap, capid_t dest_pt, vaddr_t vaddr)
+{
+	unsigned long *pte, cosframe = 0, orig_v;
+	struct cap_header *dest_pt_h;
+	u32_t flags;
+	int i;
+
+	if (unlikely(pt->lvl || (pt->refcnt_flags & CAP_MEM_FROZEN_FLAG))) return -EINVAL;
+
+	dest_pt_h = captbl_lkup(ct, dest_pt);
+	if (!dest_pt_h || dest_pt_h->type != CAP_PGTBL) return -EINVAL;
+	if (((struct cap_pgtbl *)dest_pt_h)->lvl) return -EINVAL;
+	if (frame_cap & ~PGTBL_FRAME_MASK) return -EINVAL;
+
+	for (i = 0; i < PGTBL_SUPER_NPAGES; i++) {
+		pte = pgtbl_lkup_pte(pt->pgtbl, frame_cap + i * PAGE_SIZE, &flags);
+		if (!pte) return -EINVAL;
+		orig_v = *pte;
+
+		if (!(orig_v & PGTBL_COSFRAME) || (orig_v & PGTBL_COSKMEM)) return -EPERM;
+		assert(!(orig_v & PGTBL_QUIESCENCE));
+
+		if (i == 0) cosframe = orig_v & PGTBL_FRAME_MASK;
+		if ((orig_v & PGTBL_FRAME_MASK) != cosframe + i * PAGE_SIZE) return -EINVAL;
+	}
+	if (cosframe & ~PGTBL_SUPER_FRAME_MASK) return -EINVAL;
+
+	return pgtbl_mapping_add_super(((struct cap_pgtbl *)dest_pt_h)->pgtbl, vaddr,
+				       cosframe, PGTBL_USER_DEF);
+}
+
 int
 pgtbl_activate(struct captbl *t, unsigned long cap, unsigned long capin, pgtbl_t pgtbl, u32_t lvl)
 {
@@ -71,6 +71,50 @@ retypetbl_deref(void *pa)
 	return mod_ref_cnt(pa, 0, -1);
 }
 
+/*
+ * Reference each of the memory sets in [pa, pa + sz) for a single
+ * (super-page) mapping.  They must all be user memory, and either all
+ * of them are referenced, or none are.
+ */
+int
+retypetbl_ref_range(void *pa, unsigned long sz)
+{
+	unsigned long off;
+	int ret = 0;
+
+	assert(sz % RETYPE_MEM_SIZE == 0);
+
+	for (off = 0; off < sz; off += RETYPE_MEM_SIZE) {
+		ret = mod_ref_cnt((char *)pa + off, 1, RETYPETBL_USER);
+		if (ret) break;
+	}
+	if (!ret) return 0;
+
+	/* undo the references we took */
+	while (off > 0) {
+		off -= RETYPE_MEM_SIZE;
+		mod_ref_cnt((char *)pa + off, 0, -1);
+	}
+
+	return ret;
+}
+
+int
+retypetbl_deref_range(void *pa, unsigned long sz)
+{
+	unsigned long off;
+	int ret = 0, r;
+
+	assert(sz % RETYPE_MEM_SIZE == 0);
+
+	for (off = 0; off < sz; off += RETYPE_MEM_SIZE) {
+		r = mod_ref_cnt((char *)pa + off, 0, -1);
+		if (r && !ret) ret = r;
+	}
+
+	return ret;
+}
+
 static inline int
 mod_mem_type(void *pa, const mem_type_t type)
 {
@@ -38,6 +38,8 @@ __tcap_init(struct tcap *t)
 	t->arcv_ep                 = NULL;
 	t->perm_prio               = 0;
 	tcap_setprio(t, 0);
+	/* the epoch is never reset, so comparisons cached before a tcap was deleted are stale */
+	tcap_prio_changed(t);
 	list_init(&t->active_list, t);
 }
 
@@ -55,6 +57,7 @@ tcap_delete(struct tcap *tcap)
 	memset(&tcap->budget, 0, sizeof(struct tcap_budget));
 	memset(tcap->delegations, 0, sizeof(struct tcap_sched_info) * TCAP_MAX_DELEGATIONS);
 	tcap->ndelegs = tcap->cpuid = tcap->curr_sched_off = tcap->perm_prio = 0;
+	tcap_prio_changed(tcap);
 	if (cli->next_ti.tc == tcap) thd_next_thdinfo_update(cli, 0, 0, 0, 0);
 
 	return 0;
@@ -107,6 +110,7 @@ __tcap_transfer(struct tcap *tcapdst, struct tcap *tcapsrc, tcap_res_t cycles, t
 	if (unlikely(__tcap_budget_xfer(tcapdst, tcapsrc, cycles))) return -1;
 	tcap_sched_info(tcapdst)->prio = prio;
 	tcapdst->perm_prio             = prio;
+	tcap_prio_changed(tcapdst);
 
 	return 0;
 }
@@ -158,6 +162,7 @@ tcap_delegate(struct tcap *dst, struct tcap *src, tcap_res_t cycles, tcap_prio_t
 	if (unlikely(dst == src)) {
 		tcap_sched_info(dst)->prio = prio;
 		dst->perm_prio             = prio;
+		tcap_prio_changed(dst);
 		return 0;
 	}
 	if (!prio) prio = tcap_sched_info(src)->prio;
@@ -195,6 +200,7 @@ tcap_delegate(struct tcap *dst, struct tcap *src, tcap_res_t cycles, tcap_prio_t
 	dst->ndelegs = ndelegs;
 	assert(si != -1);
 	dst->curr_sched_off = si;
+	tcap_prio_changed(dst);
 
 	/*
 	 * If the component is not already a listed root, add it.
@@ -246,3 +252,39 @@ fixup:
 void
 tcap_active_init(struct cos_cpu_local_info *cli)
 { list_head_init(&cli->tcaps); }
+
+/*
+ * Detach a tcap from this core to migrate it along with its rcv
+ * end-point's thread.  Budget is time on this core, so it isn't
+ * migrated, and the delegation chain refers to tcaps on this core, so,
+ * as when a tcap's budget is expended, only the current priority is
+ * kept.
+ */
+void
+tcap_migrate_out(struct tcap *t)
+{
+	struct cos_cpu_local_info *cli = cos_cpu_local_info();
+
+	assert(t->cpuid == get_cpuid());
+	if (tcap_is_active(t))  tcap_active_rem(t);
+	if (cli->next_ti.tc == t) thd_next_thdinfo_update(cli, 0, 0, 0, 0);
+
+	t->budget.cycles = 0;
+	t->ndelegs       = 1;
+	if (t->curr_sched_off != 0) {
+		memcpy(&t->delegations[0], tcap_sched_info(t), sizeof(struct tcap_sched_info));
+		t->curr_sched_off = 0;
+	}
+	tcap_prio_changed(t);
+	t->cpuid = THD_CPUID_MIGRATING;
+}
+
+/* Attach a migrated tcap to this core, where it needs an id of its own */
+void
+tcap_migrate_in(struct tcap *t)
+{
+	assert(t->cpuid == THD_CPUID_MIGRATING);
+	t->delegations[0].tcap_uid = (*tcap_uid_get())++;
+	t->cpuid                   = get_cpuid();
+	tcap_prio_changed(t);
+}
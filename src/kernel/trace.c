@@ -0,0 +1,57 @@
+/**
+ * Redistribution of this file is permitted under the GNU General
+ * Public License v2.
+ */
+
+#include "include/shared/cos_types.h"
+#include "include/pgtbl.h"
+#include "include/trace.h"
+#include "include/chal/defs.h"
+
+#ifdef COS_KERNEL_TRACE
+struct cos_trace_ring trace_rings[NUM_CPU] PAGE_ALIGNED;
+#endif
+
+/*
+ * Map a core's trace ring read-only at va.  As with
+ * CAPTBL_OP_HW_MAP, the frames are kernel memory that isn't
+ * reference counted, so the mappings are never removed.  All of the
+ * ptes are checked before any is written, so that a failure doesn't
+ * leave the ring partially mapped.
+ */
+int
+trace_map(pgtbl_t pt, cpuid_t core, vaddr_t va)
+{
+#ifdef COS_KERNEL_TRACE
+	struct ert_intern *ptes[COS_TRACE_NPAGES];
+	u32_t              orig_v[COS_TRACE_NPAGES];
+	int                i, ret;
+
+	if (core < 0 || core >= NUM_CPU_COS)                            return -EINVAL;
+	if (va & ~PGTBL_FRAME_MASK)                                     return -EINVAL;
+	if (va > COS_MEM_KERN_START_VA - COS_TRACE_NPAGES * PAGE_SIZE) return -EINVAL;
+
+	for (i = 0 ; i < COS_TRACE_NPAGES ; i++) {
+		u32_t accum = 0;
+
+		ptes[i] = (struct ert_intern *)__pgtbl_lkupan((pgtbl_t)((u32_t)pt | PGTBL_PRESENT),
+							      (va + i * PAGE_SIZE) >> PGTBL_PAGEIDX_SHIFT, PGTBL_DEPTH, &accum);
+		if (!ptes[i]) return -ENOENT;
+		orig_v[i] = (u32_t)(ptes[i]->next);
+		if (orig_v[i] & (PGTBL_PRESENT | PGTBL_COSFRAME)) return -EEXIST;
+		ret = pgtbl_quie_check(orig_v[i]);
+		if (ret) return ret;
+	}
+
+	for (i = 0 ; i < COS_TRACE_NPAGES ; i++) {
+		paddr_t pa = chal_va2pa((char *)&trace_rings[core] + i * PAGE_SIZE);
+
+		/* no PGTBL_WRITABLE: the tracer can only read the ring */
+		if (__pgtbl_update_leaf(ptes[i], (void *)(pa | PGTBL_PRESENT | PGTBL_USER | PGTBL_ACCESSED), orig_v[i])) return -ECASFAIL;
+	}
+
+	return 0;
+#else
+	return -EINVAL;
+#endif
+}
@@ -9,6 +9,7 @@
 #include <component.h>
 #include <inv.h>
 #include <hw.h>
+#include <trace.h>
 
 extern u8_t *boot_comp_pgd;
 
@@ -137,7 +138,7 @@ kern_boot_comp(void)
 	int ret = 0, nkmemptes;
 	struct captbl *ct;
 	unsigned int i;
-	u8_t *boot_comp_captbl;
+	u8_t *boot_comp_captbl, *utmem;
 	void *thd_mem, *tcap_mem;
 	pgtbl_t pgtbl   = (pgtbl_t)chal_va2pa(&boot_comp_pgd), boot_vm_pgd;
 	u32_t hw_bitmap = 0xFFFFFFFF;
@@ -168,6 +169,9 @@ kern_boot_comp(void)
 
 	hw_asndcap_init();
 	if (hw_activate(ct, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_INITHW_BASE, hw_bitmap)) assert(0);
+#ifdef COS_KERNEL_TRACE
+	if (trace_activate(ct, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_TRACE)) assert(0);
+#endif
 
 	/*
 	 * separate pgd for boot component virtual memory
@@ -190,8 +194,14 @@ kern_boot_comp(void)
 	 */
 	if (pgtbl_activate(ct, BOOT_CAPTBL_SELF_CT, BOOT_CAPTBL_SELF_UNTYPED_PT, pgtbl, 0)) assert(0);
 	nkmemptes = boot_nptes(mem_utmem_end() - mem_boot_end());
-	ret = boot_pgtbl_mappings_add(ct, BOOT_CAPTBL_SELF_UNTYPED_PT, BOOT_CAPTBL_KM_PTE, "untyped memory", mem_boot_nalloc_end(nkmemptes),
-				      BOOT_MEM_KM_BASE, mem_utmem_end() - mem_boot_nalloc_end(nkmemptes), 0);
+	/*
+	 * Untyped memory starts at a super-page aligned physical
+	 * address, as it is mapped at a super-page aligned virtual
+	 * address, so that it can be mapped with super-pages.
+	 */
+	utmem     = (u8_t *)round_up_to_pgd_page(mem_boot_nalloc_end(nkmemptes));
+	ret = boot_pgtbl_mappings_add(ct, BOOT_CAPTBL_SELF_UNTYPED_PT, BOOT_CAPTBL_KM_PTE, "untyped memory", utmem,
+				      BOOT_MEM_KM_BASE, mem_utmem_end() - utmem, 0);
 	assert(ret == 0);
 
 	printk("\tCapability table and page-table created.\n");
@@ -39,6 +39,16 @@ __userregs_setretvals(struct pt_regs *regs, unsigned long ret, unsigned long ret
 	regs->si = ret1;
 	regs->di = ret2;
 }
+/* Set up the registers as if user-level had invoked cap with op, and these arguments */
+static inline void
+__userregs_setinv(struct pt_regs *regs, capid_t cap, u32_t op, unsigned long a1, unsigned long a2, unsigned long a3, unsigned long a4)
+{
+	regs->ax = ((cap + 1) << COS_CAPABILITY_OFFSET) | op;
+	regs->bx = a1;
+	regs->si = a2;
+	regs->di = a3;
+	regs->dx = a4;
+}
 static inline void
 __userregs_sinvupdate(struct pt_regs *regs)
 {
@@ -39,6 +39,8 @@ struct next_thdinfo {
 	tcap_res_t  budget;
 };
 
+#define CPU_LOCAL_COMP_INFO_SZ 24 /* sizeof(struct comp_info) */
+
 struct cos_cpu_local_info {
 	/*
 	 * orig_sysenter_esp SHOULD be the first variable here. The
@@ -61,6 +63,13 @@ struct cos_cpu_local_info {
 	 * things. (e.g. captbl, etc)
 	 */
 	int invstk_top;
+	/*
+	 * With COS_INVSTK_CACHE, the struct comp_info of the top
+	 * invstk entry, so that inv/ret and capability lookups don't
+	 * access the thread's invocation stack for it (see thd.h).
+	 * The field is here regardless so the struct size is fixed.
+	 */
+	u8_t invstk_ci[CPU_LOCAL_COMP_INFO_SZ];
 	unsigned long epoch;
 	/***********************************************/
 	/*
@@ -3,6 +3,7 @@
 
 #include <pgtbl.h>
 #include <thd.h>
+#include <fpu.h>
 #include "isr.h"
 #include "tss.h"
 
@@ -84,6 +85,7 @@ chal_cpu_init(void)
 	writemsr(IA32_SYSENTER_ESP, (u32_t)tss.esp0, 0);
 	writemsr(IA32_SYSENTER_EIP, (u32_t)sysenter_entry, 0);
 	chal_cpu_eflags_init();
+	if (fpu_init()) die("FPU initialization failed\n");
 }
 
 static inline vaddr_t
@@ -78,6 +78,10 @@ invalid_opcode_fault_handler(struct pt_regs *regs)
 int
 device_not_avail_fault_handler(struct pt_regs *regs)
 {
+#ifdef FPU_ENABLED
+	/* the FPU is disabled as it holds another thread's state (see fpu.h) */
+	return fpu_disabled_exception_handler();
+#endif
 	print_regs_state(regs);
 	die("FAULT: Device Not Available\n");
 
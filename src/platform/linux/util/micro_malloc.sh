@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# malloc/free latency across allocation sizes
+
+./cos_loader \
+"c0.o, ;llboot.o, ;*fprr.o, ;mm.o, ;print.o, ;boot.o, ;\
+\
+!mpool.o,a3;!sm.o,a4;!l.o,a1;(!mal.o=micmalloc.o),a9;!va.o,a2;!vm.o,a1:\
+\
+c0.o-llboot.o;\
+fprr.o-print.o|[parent_]mm.o|[faulthndlr_]llboot.o;\
+mm.o-[parent_]llboot.o|print.o;\
+boot.o-print.o|fprr.o|mm.o|llboot.o;\
+l.o-fprr.o|mm.o|print.o;\
+sm.o-print.o|fprr.o|mm.o|boot.o|va.o|l.o|mpool.o;\
+mpool.o-print.o|fprr.o|mm.o|boot.o|va.o|l.o;\
+vm.o-fprr.o|print.o|mm.o|l.o|boot.o;\
+va.o-fprr.o|print.o|mm.o|l.o|boot.o|vm.o;\
+\
+mal.o-sm.o|fprr.o|print.o|va.o|l.o|mm.o\
+" ./gen_client_stub